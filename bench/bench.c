@@ -0,0 +1,942 @@
+// eon benchmark harness
+//
+// Runs scripted scenarios through headless mode, each in a forked child so
+// one scenario cannot skew the next. Input is fed as a startup macro (-M/-p),
+// so keystrokes go through the same kmap dispatch as a user would. Per-op
+// latency comes from the trace ring (see trace.c). Frames render into the
+// offscreen backend in tbmem.c, which stands in for libtermbox. Results are
+// printed to stdout as JSON, one object per scenario, so runs can be diffed
+// between commits.
+//
+// Usage: eon_bench [-q] [-d dir] [scenario...]
+//   -q        Quick run (inputs scaled down 100x)
+//   -d <dir>  Directory for generated input files (default: $TMPDIR or /tmp)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "eon.h"
+#include "mlbuf.h"
+#include "tbmem.h"
+
+editor_t _editor;
+
+typedef struct bench_s bench_t; // A benchmark scenario
+typedef struct bench_result_s bench_result_t; // Timings of one scenario run
+typedef int (*bench_fn_t)(bench_t* bench, bench_result_t* result);
+
+// bench_t
+struct bench_s {
+    char* name;
+    bench_fn_t fn;
+};
+
+// bench_result_t
+struct bench_result_s {
+    char* unit;
+    uint64_t ops;
+    uint64_t wall_ns;
+    uint64_t* durs;
+    size_t durs_len;
+    char* skipped;
+    tbmem_stats_t tbmem;
+};
+
+static int _bench_open(bench_t* bench, bench_result_t* result);
+static int _bench_type(bench_t* bench, bench_result_t* result);
+static int _bench_multicursor(bench_t* bench, bench_result_t* result);
+static int _bench_kill_ring(bench_t* bench, bench_result_t* result);
+static int _bench_replace_all(bench_t* bench, bench_result_t* result);
+static int _bench_isearch(bench_t* bench, bench_result_t* result);
+static int _bench_syntax(bench_t* bench, bench_result_t* result);
+static int _bench_render(bench_t* bench, bench_result_t* result);
+static int _bench_plugin_hooks(bench_t* bench, bench_result_t* result);
+static int _bench_marks_line(bench_t* bench, bench_result_t* result);
+static int _bench_marks_lines(bench_t* bench, bench_result_t* result);
+static int _bench_follow(bench_t* bench, bench_result_t* result);
+static int _bench_journal(bench_t* bench, bench_result_t* result);
+static int _bench_server(bench_t* bench, bench_result_t* result);
+static int _bench_marks(bench_result_t* result, size_t nmarks, size_t nlines);
+static int _bench_editor_init(char* macro);
+static int _bench_editor_open(char* path, uint64_t* optret_ns);
+static uint64_t _bench_editor_run();
+static void _bench_editor_deinit();
+static void _bench_journal_start();
+static void _bench_collect(bench_result_t* result, uint64_t mark, const char* cat, const char* opt_name);
+static char* _bench_macro_repeat(char* macro, char* keys, size_t n);
+static char* _bench_gen_file(char* name, size_t nbytes, const char* line);
+static int _bench_run(bench_t* bench);
+static void _bench_print(bench_t* bench, bench_result_t* result);
+static int _bench_cmp_u64(const void* a, const void* b);
+
+#define BENCH_DURS_MAX EON_TRACE_RING_SIZE
+#define BENCH_RENDER_W 160
+#define BENCH_RENDER_H 50
+#define BENCH_SCALE(n) ((n) / _bench_scale_div > 0 ? (n) / _bench_scale_div : 1)
+
+static bench_t _benches[] = {
+  { "open_1g",         _bench_open },
+  { "type_10k",        _bench_type },
+  { "multicursor_5k",  _bench_multicursor },
+  { "kill_ring_1k",    _bench_kill_ring },
+  { "replace_all",     _bench_replace_all },
+  { "isearch",         _bench_isearch },
+  { "syntax_100k",     _bench_syntax },
+  { "render_1k",       _bench_render },
+  { "plugin_hooks",    _bench_plugin_hooks },
+  { "marks_10k_line",  _bench_marks_line },
+  { "marks_10k_lines", _bench_marks_lines },
+  { "follow_50m",      _bench_follow },
+  { "journal_100k",    _bench_journal },
+  { "server_open",     _bench_server },
+  { NULL, NULL }
+};
+
+static size_t _bench_scale_div = 1;
+static char* _bench_dir = NULL;
+
+int main(int argc, char** argv) {
+  bench_t* bench;
+  char* tmpdir;
+  int is_first;
+  int rv;
+  int c;
+  int i;
+
+  tmpdir = getenv("TMPDIR");
+  _bench_dir = tmpdir && *tmpdir ? tmpdir : "/tmp";
+
+  while ((c = getopt(argc, argv, "qd:")) != -1) {
+    switch (c) {
+    case 'q': _bench_scale_div = 100; break;
+    case 'd': _bench_dir = optarg; break;
+    default:
+      fprintf(stderr, "Usage: %s [-q] [-d dir] [scenario...]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  rv = EXIT_SUCCESS;
+  is_first = 1;
+  printf("{\"version\":\"%s\",\"scale_div\":%zu,\"scenarios\":[", EON_VERSION, _bench_scale_div);
+
+  for (bench = _benches; bench->name; bench++) {
+    if (optind < argc) {
+      for (i = optind; i < argc && strcmp(argv[i], bench->name) != 0; i++);
+      if (i >= argc) continue;
+    }
+
+    printf("%s\n", is_first ? "" : ",");
+    is_first = 0;
+
+    if (_bench_run(bench) != EON_OK) rv = EXIT_FAILURE;
+  }
+
+  printf("\n]}\n");
+  return rv;
+}
+
+// Open a 1 GB file
+static int _bench_open(bench_t* bench, bench_result_t* result) {
+  char* path;
+  size_t nbytes;
+
+  nbytes = BENCH_SCALE((size_t)1024 * 1024 * 1024);
+  path = _bench_gen_file("open.txt", nbytes, "the quick brown fox jumps over the lazy dog 0123456789\n");
+  if (!path || _bench_editor_init(NULL) != EON_OK) return EON_ERR;
+
+  _bench_editor_open(path, &result->wall_ns);
+  result->unit = "bytes";
+  result->ops = nbytes;
+  result->durs = malloc(sizeof(uint64_t));
+  result->durs[0] = result->wall_ns;
+  result->durs_len = 1;
+
+  _bench_editor_deinit();
+  unlink(path);
+  free(path);
+  return EON_OK;
+}
+
+// Type 10k chars into an empty buffer
+static int _bench_type(bench_t* bench, bench_result_t* result) {
+  char* macro;
+  uint64_t mark;
+  size_t n;
+
+  n = BENCH_SCALE(10000);
+  macro = _bench_macro_repeat(NULL, "h e l l o space w o r l d space t h e space q u i c k space f o x enter", n / 32);
+  if (_bench_editor_init(macro) != EON_OK) return EON_ERR;
+
+  mark = trace_tell();
+  result->wall_ns = _bench_editor_run();
+  result->unit = "keys";
+  _bench_collect(result, mark, "cmd", NULL);
+  result->ops = result->durs_len;
+
+  _bench_editor_deinit();
+  free(macro);
+  return EON_OK;
+}
+
+// Add 5k cursors, then type with all of them
+static int _bench_multicursor(bench_t* bench, bench_result_t* result) {
+  char* path;
+  char* macro;
+  uint64_t mark;
+  size_t n;
+
+  n = BENCH_SCALE(5000);
+  path = _bench_gen_file("multicursor.txt", n * 16, "foo bar baz qux\n");
+  macro = _bench_macro_repeat(NULL, "MS-s", n - 1);
+  macro = _bench_macro_repeat(macro, "x y z", 10);
+  if (!path || _bench_editor_init(macro) != EON_OK) return EON_ERR;
+
+  _bench_editor_open(path, NULL);
+  mark = trace_tell();
+  result->wall_ns = _bench_editor_run();
+  result->unit = "keys";
+  _bench_collect(result, mark, "cmd", "cmd_insert_data");
+  result->ops = result->durs_len;
+
+  _bench_editor_deinit();
+  unlink(path);
+  free(path);
+  free(macro);
+  return EON_OK;
+}
+
+// Cut, append-cut, paste and cycle the kill ring with 1k cursors
+static int _bench_kill_ring(bench_t* bench, bench_result_t* result) {
+  char* path;
+  char* macro;
+  uint64_t mark;
+  size_t n;
+
+  n = BENCH_SCALE(1000);
+  path = _bench_gen_file("kill_ring.txt", n * 64, "foo bar baz qux\n");
+  macro = _bench_macro_repeat(NULL, "MS-s", n - 1);
+  macro = _bench_macro_repeat(macro, "C-k C-k C-u C-u down C-k C-u M-u M-u", 10);
+  if (!path || _bench_editor_init(macro) != EON_OK) return EON_ERR;
+
+  _bench_editor_open(path, NULL);
+  mark = trace_tell();
+  result->wall_ns = _bench_editor_run();
+  result->unit = "keys";
+  _bench_collect(result, mark, "cmd", NULL);
+  result->ops = result->durs_len;
+
+  _bench_editor_deinit();
+  unlink(path);
+  free(path);
+  free(macro);
+  return EON_OK;
+}
+
+// Replace every match of a regex in a 100k line file
+static int _bench_replace_all(bench_t* bench, bench_result_t* result) {
+  char* path;
+  char* macro;
+  uint64_t mark;
+  size_t n;
+
+  n = BENCH_SCALE(100000);
+  path = _bench_gen_file("replace.txt", n * 32, "int foo = bar(foo, baz);      \n");
+  macro = _bench_macro_repeat(NULL, "C-r f o o enter q u x enter a", 1);
+  if (!path || _bench_editor_init(macro) != EON_OK) return EON_ERR;
+
+  _bench_editor_open(path, NULL);
+  mark = trace_tell();
+  result->wall_ns = _bench_editor_run();
+  result->unit = "matches";
+  result->ops = n * 2;
+  _bench_collect(result, mark, "cmd", "cmd_replace");
+
+  _bench_editor_deinit();
+  unlink(path);
+  free(path);
+  free(macro);
+  return EON_OK;
+}
+
+// Incrementally search a 100k line file, one keystroke at a time
+static int _bench_isearch(bench_t* bench, bench_result_t* result) {
+  char* path;
+  char* macro;
+  uint64_t mark;
+  size_t n;
+
+  n = BENCH_SCALE(100000);
+  path = _bench_gen_file("isearch.txt", n * 32, "lorem ipsum dolor sit amet ok  \n");
+  macro = _bench_macro_repeat(NULL, "C-f n o t space f o u n d backspace backspace backspace backspace backspace backspace backspace backspace backspace enter", 1);
+  if (!path || _bench_editor_init(macro) != EON_OK) return EON_ERR;
+
+  _bench_editor_open(path, NULL);
+  mark = trace_tell();
+  result->wall_ns = _bench_editor_run();
+  result->unit = "keys";
+  _bench_collect(result, mark, "cmd", "cmd_insert_data");
+  result->ops = result->durs_len;
+
+  _bench_editor_deinit();
+  unlink(path);
+  free(path);
+  free(macro);
+  return EON_OK;
+}
+
+// Highlight a 100k line file
+static int _bench_syntax(bench_t* bench, bench_result_t* result) {
+  char* path;
+  char* macro;
+  uint64_t mark;
+  size_t n;
+
+  n = BENCH_SCALE(100000);
+  path = _bench_gen_file("syntax.txt", n * 64, "  if (x == 0) { return \"str\"; } // comment 123 while(1) {}\n");
+  macro = _bench_macro_repeat(NULL, "M-o s g e n e r i c enter", 1);
+  if (!path || _bench_editor_init(macro) != EON_OK) return EON_ERR;
+
+  _bench_editor_open(path, NULL);
+  mark = trace_tell();
+  result->wall_ns = _bench_editor_run();
+  result->unit = "lines";
+  result->ops = n;
+  _bench_collect(result, mark, "style", NULL);
+
+  _bench_editor_deinit();
+  unlink(path);
+  free(path);
+  free(macro);
+  return EON_OK;
+}
+
+// Render 1,000 frames of a highlighted file while paging through it
+static int _bench_render(bench_t* bench, bench_result_t* result) {
+  char* path;
+  char* macro;
+  uint64_t mark;
+  size_t n;
+
+  n = BENCH_SCALE(1000);
+  path = _bench_gen_file("render.c", BENCH_SCALE(100000) * 64, "  if (x == 0) { return \"str\"; } // comment 123 while(1) {}\n");
+  macro = _bench_macro_repeat(NULL, "page-down", n / 2);
+  macro = _bench_macro_repeat(macro, "page-up", n - n / 2 - 1);
+  macro = _bench_macro_repeat(macro, "CS-q", 1);
+  if (!path || _bench_editor_init(macro) != EON_OK) return EON_ERR;
+
+  _bench_editor_open(path, NULL);
+
+  // Draw for real; the macro quits so the loop never waits on input
+  tbmem_set_size(BENCH_RENDER_W, BENCH_RENDER_H);
+  tb_init();
+  tbmem_reset_stats();
+  _editor.headless_mode = 0;
+
+  mark = trace_tell();
+  result->wall_ns = _bench_editor_run();
+  result->unit = "frames";
+  _bench_collect(result, mark, "draw", NULL);
+  result->ops = result->durs_len;
+  tbmem_get_stats(&result->tbmem);
+
+  _bench_editor_deinit();
+  tb_shutdown();
+  unlink(path);
+  free(path);
+  free(macro);
+  return EON_OK;
+}
+
+// Measure the before/after plugin hooks around each typed key
+static int _bench_plugin_hooks(bench_t* bench, bench_result_t* result) {
+  char* macro;
+  uint64_t mark;
+
+  macro = _bench_macro_repeat(NULL, "a b c d e f g h i j", BENCH_SCALE(1000));
+  if (_bench_editor_init(macro) != EON_OK) return EON_ERR;
+
+  mark = trace_tell();
+  result->wall_ns = _bench_editor_run();
+  result->unit = "hooks";
+  _bench_collect(result, mark, "plugin", NULL);
+  result->ops = result->durs_len;
+
+  if (result->durs_len < 1) {
+    result->skipped = "built without WITH_PLUGINS";
+  }
+
+  _bench_editor_deinit();
+  free(macro);
+  return EON_OK;
+}
+
+// Edit a line holding 10k marks
+static int _bench_marks_line(bench_t* bench, bench_result_t* result) {
+  return _bench_marks(result, BENCH_SCALE(10000), 1);
+}
+
+// Edit above 10k lines holding a mark each
+static int _bench_marks_lines(bench_t* bench, bench_result_t* result) {
+  return _bench_marks(result, BENCH_SCALE(10000), BENCH_SCALE(10000));
+}
+
+// Follow a log file while 50 MB is appended to it in 64 KB writes. Each op
+// is one write plus eon picking it up through inotify.
+static int _bench_follow(bench_t* bench, bench_result_t* result) {
+  char chunk[65536];
+  const char* line;
+  char* path;
+  char* macro;
+  size_t line_len;
+  size_t chunk_len;
+  size_t nchunks;
+  size_t i;
+  uint64_t start;
+  uint64_t op_start;
+  int fd;
+  int rc;
+
+  line = "2024-01-01T00:00:00Z INFO request served path=/index status=200\n";
+  line_len = strlen(line);
+
+  for (chunk_len = 0; chunk_len + line_len <= sizeof(chunk); chunk_len += line_len) {
+    memcpy(chunk + chunk_len, line, line_len);
+  }
+
+  nchunks = BENCH_SCALE((size_t)50 * 1024 * 1024) / chunk_len + 1;
+  path = _bench_gen_file("follow.log", chunk_len, line);
+  macro = _bench_macro_repeat(NULL, "M-x F", 1);
+
+  if (!path || _bench_editor_init(macro) != EON_OK) {
+    if (path) unlink(path);
+    free(path);
+    free(macro);
+    return EON_ERR;
+  }
+
+  // Headless mode does not watch files; start watching by hand
+  _editor.headless_mode = 0;
+  watch_init(&_editor);
+  _editor.headless_mode = 1;
+  rc = EON_OK;
+
+  if (!_editor.watch_proc) {
+    result->skipped = "no inotify";
+    goto _bench_follow_done;
+  }
+
+  _bench_editor_open(path, NULL);
+  _bench_editor_run();
+
+  if ((fd = open(path, O_WRONLY | O_APPEND)) < 0) {
+    rc = EON_ERR;
+    goto _bench_follow_done;
+  }
+
+  result->durs = malloc(sizeof(uint64_t) * nchunks);
+  start = trace_now();
+
+  for (i = 0; i < nchunks; i++) {
+    op_start = trace_now();
+    if (write(fd, chunk, chunk_len) != (ssize_t)chunk_len) break;
+    _editor.watch_proc->callback(_editor.watch_proc, NULL, 0);
+    result->durs[result->durs_len++] = trace_now() - op_start;
+  }
+
+  result->wall_ns = trace_now() - start;
+  result->unit = "bytes";
+  result->ops = chunk_len * result->durs_len;
+  close(fd);
+
+  // Every byte should have made it into the buffer
+  if (_editor.active_edit->buffer->byte_count != (bint_t)(chunk_len * (result->durs_len + 1))) {
+    rc = EON_ERR;
+  }
+
+_bench_follow_done:
+  _bench_editor_deinit();
+  unlink(path);
+  free(path);
+  free(macro);
+  return rc;
+}
+
+// Journal 100k edits in a child that then dies without closing the buffer,
+// and time opening the file again, which replays them
+static int _bench_journal(bench_t* bench, bench_result_t* result) {
+  buffer_t* buffer;
+  bline_t* bline;
+  struct stat st;
+  char* path;
+  size_t n;
+  size_t i;
+  pid_t pid;
+  int status;
+  int rc;
+
+  n = BENCH_SCALE(100000);
+  path = _bench_gen_file("journal.txt", BENCH_SCALE(10000) * 32, "int foo = bar(foo, baz);      \n");
+  if (!path || stat(path, &st) != 0) return EON_ERR;
+
+  if ((pid = fork()) < 0) {
+    unlink(path);
+    free(path);
+    return EON_ERR;
+
+  } else if (pid == 0) {
+    if (_bench_editor_init(NULL) != EON_OK) _exit(EXIT_FAILURE);
+    _bench_journal_start();
+    _bench_editor_open(path, NULL);
+
+    buffer = _editor.active_edit->buffer;
+    bline = buffer->first_line;
+
+    for (i = 0; i < n; i++) {
+      bline_insert(bline, 0, "x", 1, NULL);
+      bline = bline->next ? bline->next : buffer->first_line;
+    }
+
+    // Flush and stop the writer, then crash
+    journal_idle(&_editor);
+    journal_deinit(&_editor);
+    _exit(EXIT_SUCCESS);
+  }
+
+  waitpid(pid, &status, 0);
+  rc = EON_OK;
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS || _bench_editor_init(NULL) != EON_OK) {
+    unlink(path);
+    free(path);
+    return EON_ERR;
+  }
+
+  _bench_journal_start();
+  result->durs = malloc(sizeof(uint64_t));
+  _bench_editor_open(path, &result->durs[0]);
+  result->durs_len = 1;
+  result->wall_ns = result->durs[0];
+  result->unit = "records";
+  result->ops = n;
+
+  // Every journaled insert should have been replayed
+  if (_editor.active_edit->buffer->byte_count != (bint_t)st.st_size + (bint_t)n) {
+    rc = EON_ERR;
+  }
+
+  _bench_editor_deinit();
+  unlink(path);
+  free(path);
+  return rc;
+}
+
+// Spread nmarks marks evenly over nlines lines of a bare buffer, then time
+// edits at the start of the first line: a char (moves the marks on it)
+// alternating with a newline (shifts every line below). The edit mark stays
+// at the head of the marked line. This measures mlbuf's mark bookkeeping
+// alone, without the editor loop.
+static int _bench_marks(bench_result_t* result, size_t nmarks, size_t nlines) {
+  buffer_t* buffer;
+  bline_t* bline;
+  mark_t* mark;
+  char* data;
+  size_t line_len;
+  size_t nops;
+  size_t i;
+  uint64_t start;
+  uint64_t op_start;
+
+  line_len = nmarks / nlines + 1;
+  data = malloc(nlines * (line_len + 1));
+
+  for (i = 0; i < nlines * (line_len + 1); i++) {
+    data[i] = i % (line_len + 1) == line_len ? '\n' : 'a' + (char)(i % 26);
+  }
+
+  buffer = buffer_new();
+  buffer_insert(buffer, 0, data, (bint_t)(nlines * (line_len + 1)), NULL);
+  free(data);
+
+  for (i = 0, bline = buffer->first_line; i < nmarks && bline; i++) {
+    buffer_add_mark(buffer, bline, (bint_t)(i % (nmarks / nlines) + 1));
+    if ((i + 1) % (nmarks / nlines) == 0) bline = bline->next;
+  }
+
+  nops = BENCH_SCALE(1000);
+  result->durs = malloc(sizeof(uint64_t) * nops);
+  mark = buffer_add_mark(buffer, buffer->first_line, 0);
+  start = trace_now();
+
+  for (i = 0; i < nops; i++) {
+    op_start = trace_now();
+    mark_insert_before(mark, i % 2 == 0 ? "x" : "\n", 1);
+    result->durs[result->durs_len++] = trace_now() - op_start;
+  }
+
+  result->wall_ns = trace_now() - start;
+  result->unit = "edits";
+  result->ops = nops;
+
+  buffer_destroy(buffer);
+  return EON_OK;
+}
+
+// Time another eon handing a file to a running one: connect, send the
+// request, and wait for the reply once the file is open. A child plays the
+// client through server_forward while this process serves, so each op is
+// the round trip a user waits for after eon -e.
+static int _bench_server(bench_t* bench, bench_result_t* result) {
+  struct pollfd pfds[64];
+  server_client_t* client;
+  server_client_t* client_tmp;
+  char* argv[4];
+  char* path;
+  char* dir;
+  char* sock_dir;
+  uint64_t start;
+  ssize_t nbytes;
+  ssize_t nread;
+  size_t n;
+  size_t i;
+  pid_t pid;
+  int pipefd[2];
+  int exit_code;
+  int npfds;
+  int status;
+  int rc;
+
+  n = BENCH_SCALE(200);
+  path = _bench_gen_file("server.txt", 4096, "int foo = bar(foo, baz);\n");
+  dir = NULL;
+  sock_dir = NULL;
+
+  // Listen in a private dir so no running eon answers instead
+  if (!path
+    || asprintf(&dir, "%s/eon-bench-%d-server", _bench_dir, (int)getpid()) < 0
+    || asprintf(&sock_dir, "%s/%s", dir, EON_SERVER_DIR_NAME) < 0
+    || mkdir(dir, 0700) != 0
+    || _bench_editor_init(NULL) != EON_OK
+  ) {
+    rc = EON_ERR;
+    goto _bench_server_cleanup;
+  }
+
+  setenv("XDG_RUNTIME_DIR", dir, 1);
+
+  // Headless mode does not listen; start the server by hand
+  _editor.use_server = 1;
+  _editor.headless_mode = 0;
+  server_init(&_editor);
+  _editor.headless_mode = 1;
+  rc = EON_OK;
+
+  if (!_editor.server_fd) {
+    result->skipped = "no server socket";
+    goto _bench_server_done;
+  }
+
+  if (pipe(pipefd) != 0 || (pid = fork()) < 0) {
+    rc = EON_ERR;
+    goto _bench_server_done;
+
+  } else if (pid == 0) {
+    // Client: forward the file n times, then report each round trip
+    close(pipefd[0]);
+    result->durs = malloc(sizeof(uint64_t) * n);
+    argv[0] = "eon";
+    argv[1] = "-e";
+    argv[2] = path;
+    argv[3] = NULL;
+
+    for (i = 0; i < n; i++) {
+      start = trace_now();
+      if (server_forward(3, argv, &exit_code) != EON_OK || exit_code != EXIT_SUCCESS) _exit(EXIT_FAILURE);
+      result->durs[i] = trace_now() - start;
+    }
+
+    _exit(write(pipefd[1], result->durs, sizeof(uint64_t) * n) == (ssize_t)(sizeof(uint64_t) * n) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  // Serve until the client hangs up its end of the pipe. As in editor_loop,
+  // requests are read as they come in and handled from the top-level loop.
+  close(pipefd[1]);
+  result->durs = malloc(sizeof(uint64_t) * n);
+  nbytes = 0;
+  _editor.loop_depth = 1;
+  start = trace_now();
+
+  while (1) {
+    pfds[0] = (struct pollfd){ pipefd[0], POLLIN, 0 };
+    pfds[1] = (struct pollfd){ _editor.server_fd, POLLIN, 0 };
+    npfds = 2;
+
+    DL_FOREACH(_editor.server_clients, client) {
+      if (npfds >= (int)(sizeof(pfds) / sizeof(pfds[0]))) break;
+      pfds[npfds++] = (struct pollfd){ client->fd, POLLIN, 0 };
+    }
+
+    if (poll(pfds, npfds, 1000) < 0) continue;
+
+    if (pfds[0].revents) {
+      nread = read(pipefd[0], (char*)result->durs + nbytes, sizeof(uint64_t) * n - nbytes);
+      if (nread <= 0) break;
+      nbytes += nread;
+      continue;
+    }
+
+    if (pfds[1].revents) {
+      _editor.server_proc->callback(_editor.server_proc, NULL, 0);
+    }
+
+    DL_FOREACH_SAFE(_editor.server_clients, client, client_tmp) {
+      if (!client->is_ready) client->aproc->callback(client->aproc, NULL, 0);
+    }
+
+    server_idle(&_editor);
+  }
+
+  result->wall_ns = trace_now() - start;
+  _editor.loop_depth = 0;
+  close(pipefd[0]);
+  waitpid(pid, &status, 0);
+
+  result->durs_len = (size_t)nbytes / sizeof(uint64_t);
+  result->unit = "opens";
+  result->ops = result->durs_len;
+  rc = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS && result->durs_len == n ? EON_OK : EON_ERR;
+
+_bench_server_done:
+  _bench_editor_deinit();
+
+_bench_server_cleanup:
+  if (sock_dir) rmdir(sock_dir);
+  if (dir) rmdir(dir);
+  if (path) unlink(path);
+  free(sock_dir);
+  free(dir);
+  free(path);
+  return rc;
+}
+
+// Init a headless editor with macro (if any) set to run on startup
+static int _bench_editor_init(char* macro) {
+  char* argv[16];
+  int argc;
+
+  argc = 0;
+  argv[argc++] = "eon";
+  argv[argc++] = "-N";
+  argv[argc++] = "-H";
+  argv[argc++] = "1";
+  argv[argc++] = "-j";
+  argv[argc++] = "0";
+  argv[argc++] = "-o";
+  argv[argc++] = "0";
+
+  if (macro) {
+    argv[argc++] = "-M";
+    argv[argc++] = macro;
+    argv[argc++] = "-p";
+    argv[argc++] = "bench";
+  }
+
+  argv[argc] = NULL;
+
+  memset(&_editor, 0, sizeof(editor_t));
+
+  if (editor_init(&_editor, argc, argv) != EON_OK) {
+    fprintf(stderr, "editor_init failed: %s\n", _editor.errstr);
+    return EON_ERR;
+  }
+
+  trace_set_enabled(&_editor, 1);
+  return EON_OK;
+}
+
+// Open path in a new active bview
+static int _bench_editor_open(char* path, uint64_t* optret_ns) {
+  uint64_t start;
+  int rv;
+
+  start = trace_now();
+  rv = editor_open_bview(&_editor, NULL, EON_BVIEW_TYPE_EDIT, path, strlen(path), 1, 0, NULL, NULL, NULL);
+  if (optret_ns) *optret_ns = trace_now() - start;
+
+  return rv;
+}
+
+// Run the startup macro to completion; return elapsed ns
+static uint64_t _bench_editor_run() {
+  uint64_t start;
+
+  start = trace_now();
+  editor_run(&_editor);
+  return trace_now() - start;
+}
+
+// Tear down the editor
+static void _bench_editor_deinit() {
+  editor_deinit(&_editor);
+}
+
+// Headless mode does not journal; start the writer by hand
+static void _bench_journal_start() {
+  _editor.use_journal = 1;
+  _editor.headless_mode = 0;
+  journal_init(&_editor);
+  _editor.headless_mode = 1;
+}
+
+// Copy span durations since mark into result
+static void _bench_collect(bench_result_t* result, uint64_t mark, const char* cat, const char* opt_name) {
+  result->durs = malloc(sizeof(uint64_t) * BENCH_DURS_MAX);
+  result->durs_len = trace_collect(mark, cat, opt_name, result->durs, BENCH_DURS_MAX);
+}
+
+// Append keys to macro n times. If macro is NULL, start a new one.
+static char* _bench_macro_repeat(char* macro, char* keys, size_t n) {
+  size_t macro_len;
+  size_t keys_len;
+  size_t i;
+
+  if (!macro) macro = strdup("bench");
+
+  macro_len = strlen(macro);
+  keys_len = strlen(keys);
+  macro = realloc(macro, macro_len + n * (keys_len + 1) + 1);
+
+  for (i = 0; i < n; i++) {
+    macro[macro_len++] = ' ';
+    memcpy(macro + macro_len, keys, keys_len);
+    macro_len += keys_len;
+  }
+
+  macro[macro_len] = '\0';
+  return macro;
+}
+
+// Write a file of about nbytes made of line repeated
+static char* _bench_gen_file(char* name, size_t nbytes, const char* line) {
+  char buf[65536];
+  size_t line_len;
+  size_t buf_len;
+  size_t chunk_len;
+  size_t written;
+  ssize_t rc;
+  char* path;
+  int fd;
+
+  if (asprintf(&path, "%s/eon-bench-%d-%s", _bench_dir, (int)getpid(), name) < 0) {
+    return NULL;
+  }
+
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+    perror(path);
+    free(path);
+    return NULL;
+  }
+
+  line_len = strlen(line);
+
+  for (buf_len = 0; buf_len + line_len <= sizeof(buf); buf_len += line_len) {
+    memcpy(buf + buf_len, line, line_len);
+  }
+
+  for (written = 0; written < nbytes; written += (size_t)rc) {
+    chunk_len = EON_MIN(buf_len, (nbytes - written + line_len - 1) / line_len * line_len);
+    if ((rc = write(fd, buf, chunk_len)) <= 0) break;
+  }
+
+  close(fd);
+  return path;
+}
+
+// Run bench in a child and print its result
+static int _bench_run(bench_t* bench) {
+  bench_result_t result;
+  pid_t pid;
+  int status;
+  int devnull;
+
+  fflush(stdout);
+
+  if ((pid = fork()) < 0) {
+    return EON_ERR;
+
+  } else if (pid == 0) {
+    // Headless mode reads stdin into the first bview; give it nothing
+    if ((devnull = open("/dev/null", O_RDONLY)) >= 0) {
+      dup2(devnull, STDIN_FILENO);
+      close(devnull);
+    }
+
+    memset(&result, 0, sizeof(bench_result_t));
+
+    if (bench->fn(bench, &result) != EON_OK) {
+      printf("{\"name\":\"%s\",\"error\":\"scenario failed\"}", bench->name);
+      fflush(stdout);
+      _exit(EXIT_FAILURE);
+    }
+
+    _bench_print(bench, &result);
+    fflush(stdout);
+    _exit(EXIT_SUCCESS);
+  }
+
+  waitpid(pid, &status, 0);
+
+  if (!WIFEXITED(status)) {
+    printf("{\"name\":\"%s\",\"error\":\"child died with signal %d\"}", bench->name, WTERMSIG(status));
+    return EON_ERR;
+  }
+
+  return WEXITSTATUS(status) == EXIT_SUCCESS ? EON_OK : EON_ERR;
+}
+
+// Print result as a JSON object
+static void _bench_print(bench_t* bench, bench_result_t* result) {
+  double p50;
+  double p99;
+  double secs;
+
+  if (result->skipped) {
+    printf("{\"name\":\"%s\",\"skipped\":\"%s\"}", bench->name, result->skipped);
+    return;
+  }
+
+  p50 = p99 = 0;
+
+  if (result->durs_len > 0) {
+    qsort(result->durs, result->durs_len, sizeof(uint64_t), _bench_cmp_u64);
+    p50 = result->durs[(result->durs_len - 1) * 50 / 100] / 1e6;
+    p99 = result->durs[(result->durs_len - 1) * 99 / 100] / 1e6;
+  }
+
+  secs = result->wall_ns / 1e9;
+
+  printf("{\"name\":\"%s\",\"unit\":\"%s\",\"ops\":%llu,\"wall_s\":%.6f,\"ops_per_sec\":%.1f,"
+    "\"samples\":%zu,\"p50_ms\":%.4f,\"p99_ms\":%.4f",
+    bench->name, result->unit, (unsigned long long)result->ops, secs,
+    secs > 0 ? result->ops / secs : 0, result->durs_len, p50, p99);
+
+  if (result->tbmem.frames > 0) {
+    printf(",\"cells_per_frame\":%.1f,\"est_bytes_per_frame\":%.1f}",
+      (double)result->tbmem.cells / result->tbmem.frames,
+      (double)result->tbmem.bytes / result->tbmem.frames);
+  } else {
+    printf("}");
+  }
+}
+
+// qsort comparator for uint64_t
+static int _bench_cmp_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
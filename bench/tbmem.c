@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tbmem.h"
+#include "mlbuf.h"
+#include "eon.h"
+
+static int _tbmem_alloc(int w, int h);
+
+static struct tb_cell* _tbmem_back = NULL;
+static struct tb_cell* _tbmem_front = NULL;
+static int _tbmem_w = TBMEM_DEFAULT_W;
+static int _tbmem_h = TBMEM_DEFAULT_H;
+static int _tbmem_cursor_x = -1;
+static int _tbmem_cursor_y = -1;
+static struct tb_event* _tbmem_events = NULL;
+static size_t _tbmem_events_len = 0;
+static size_t _tbmem_events_head = 0;
+static tbmem_stats_t _tbmem_stats;
+
+// Resize both buffers. The next frame repaints every cell.
+int tbmem_set_size(int w, int h) {
+  return _tbmem_alloc(w, h);
+}
+
+// Queue an event for tb_poll_event/tb_peek_event
+int tbmem_push_event(struct tb_event* ev) {
+  _tbmem_events = realloc(_tbmem_events, sizeof(struct tb_event) * (_tbmem_events_len + 1));
+  _tbmem_events[_tbmem_events_len++] = *ev;
+  return 0;
+}
+
+// Copy render counters
+void tbmem_get_stats(tbmem_stats_t* ret_stats) {
+  *ret_stats = _tbmem_stats;
+}
+
+// Zero render counters
+void tbmem_reset_stats() {
+  memset(&_tbmem_stats, 0, sizeof(tbmem_stats_t));
+}
+
+// Return the last rendered frame (tb_width * tb_height cells)
+struct tb_cell* tbmem_front_buffer() {
+  return _tbmem_front;
+}
+
+// Write the last rendered frame to fp as text, one line per row
+int tbmem_dump_frame(FILE* fp) {
+  char buf[8];
+  int x;
+  int y;
+  int len;
+  uint32_t ch;
+
+  for (y = 0; y < _tbmem_h; y++) {
+    for (x = 0; x < _tbmem_w; x++) {
+      ch = _tbmem_front[y * _tbmem_w + x].ch;
+      len = utf8_unicode_to_char(buf, ch ? ch : ' ');
+      fwrite(buf, 1, len, fp);
+    }
+
+    fputc('\n', fp);
+  }
+
+  return 0;
+}
+
+int tb_init(void) {
+  return _tbmem_back ? 0 : _tbmem_alloc(_tbmem_w, _tbmem_h);
+}
+
+void tb_shutdown(void) {
+  free(_tbmem_back);
+  free(_tbmem_front);
+  free(_tbmem_events);
+  _tbmem_back = _tbmem_front = NULL;
+  _tbmem_events = NULL;
+  _tbmem_events_len = _tbmem_events_head = 0;
+}
+
+int tb_width(void) {
+  return _tbmem_w;
+}
+
+int tb_height(void) {
+  return _tbmem_h;
+}
+
+void tb_clear_buffer(void) {
+  int i;
+
+  if (!_tbmem_back) tb_init();
+
+  for (i = 0; i < _tbmem_w * _tbmem_h; i++) {
+    _tbmem_back[i] = (struct tb_cell) { ' ', TB_DEFAULT, TB_DEFAULT };
+  }
+}
+
+// Count what termbox would write for this frame, then present it
+void tb_render(void) {
+  int cells;
+  int bytes;
+
+  if (!_tbmem_back) return;
+
+  bytes = term_frame_cost(_tbmem_front, _tbmem_back, _tbmem_w, _tbmem_h, &cells);
+  memcpy(_tbmem_front, _tbmem_back, sizeof(struct tb_cell) * _tbmem_w * _tbmem_h);
+
+  if (_tbmem_cursor_x >= 0 && _tbmem_cursor_y >= 0) {
+    bytes += snprintf(NULL, 0, "\x1b[%d;%dH", _tbmem_cursor_y + 1, _tbmem_cursor_x + 1);
+  }
+
+  _tbmem_stats.frames += 1;
+  _tbmem_stats.cells += cells;
+  _tbmem_stats.bytes += bytes;
+  _tbmem_stats.last_cells = cells;
+  _tbmem_stats.last_bytes = bytes;
+}
+
+void tb_set_cursor(int cx, int cy) {
+  _tbmem_cursor_x = cx;
+  _tbmem_cursor_y = cy;
+}
+
+struct tb_cell* tb_cell_buffer(void) {
+  if (!_tbmem_back) tb_init();
+  return _tbmem_back;
+}
+
+void tb_char(int x, int y, uint16_t fg, uint16_t bg, uint32_t ch) {
+  if (!_tbmem_back) tb_init();
+  if (x < 0 || x >= _tbmem_w || y < 0 || y >= _tbmem_h) return;
+  _tbmem_back[y * _tbmem_w + x] = (struct tb_cell) { ch, fg, bg };
+}
+
+int tb_string(int x, int y, uint16_t fg, uint16_t bg, char* str) {
+  uint32_t ch;
+  char* stop;
+  int len;
+  int i;
+
+  stop = str + strlen(str);
+
+  for (i = 0; str < stop; i++) {
+    len = utf8_char_to_unicode(&ch, str, stop);
+    if (len < 1) break;
+    tb_char(x + i, y, fg, bg, ch);
+    str += len;
+  }
+
+  return i;
+}
+
+// Pop a queued event. Running dry is a script error, not a wait.
+int tb_poll_event(struct tb_event* event) {
+  if (_tbmem_events_head >= _tbmem_events_len) {
+    fprintf(stderr, "tbmem: tb_poll_event with no queued events\n");
+    exit(EXIT_FAILURE);
+  }
+
+  *event = _tbmem_events[_tbmem_events_head++];
+  return event->type;
+}
+
+int tb_peek_event(struct tb_event* event, int timeout) {
+  if (_tbmem_events_head >= _tbmem_events_len) {
+    return 0;
+  }
+
+  *event = _tbmem_events[_tbmem_events_head++];
+  return event->type;
+}
+
+void tb_enable_mouse(void) {
+}
+
+void tb_disable_mouse(void) {
+}
+
+int tb_select_output_mode(int mode) {
+  return mode;
+}
+
+int tb_utf8_char_length(char c) {
+  unsigned char u = (unsigned char)c;
+  if (u < 0x80) return 1;
+  if (u < 0xe0) return 2;
+  if (u < 0xf0) return 3;
+  return 4;
+}
+
+// (Re)allocate back and front buffers. Front is zeroed so it differs from any
+// cleared back buffer and the first frame is a full repaint.
+static int _tbmem_alloc(int w, int h) {
+  if (w < 1 || h < 1) return -1;
+
+  _tbmem_w = w;
+  _tbmem_h = h;
+  _tbmem_back = realloc(_tbmem_back, sizeof(struct tb_cell) * w * h);
+  _tbmem_front = realloc(_tbmem_front, sizeof(struct tb_cell) * w * h);
+  memset(_tbmem_front, 0, sizeof(struct tb_cell) * w * h);
+  tb_clear_buffer();
+  return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef __TBMEM_H
+#define __TBMEM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "termbox.h"
+
+// An offscreen termbox backend. tbmem.c defines the tb_* functions eon calls,
+// so linking it in place of libtermbox.a renders into memory instead of a
+// tty. tb_render counts the cells and an estimate of the escape bytes a tty
+// would have received (see term_frame_cost) and then presents the frame.
+
+typedef struct tbmem_stats_s tbmem_stats_t; // Render counters of the offscreen backend
+
+// tbmem_stats_t
+struct tbmem_stats_s {
+    uint64_t frames;
+    uint64_t cells;
+    uint64_t bytes;
+    int last_cells;
+    int last_bytes;
+};
+
+int tbmem_set_size(int w, int h);
+int tbmem_push_event(struct tb_event* ev);
+void tbmem_get_stats(tbmem_stats_t* ret_stats);
+void tbmem_reset_stats();
+struct tb_cell* tbmem_front_buffer();
+int tbmem_dump_frame(FILE* fp);
+
+#define TBMEM_DEFAULT_W 80
+#define TBMEM_DEFAULT_H 24
+
+#endif
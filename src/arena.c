@@ -0,0 +1,185 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eon.h"
+
+// arena_chunk_t
+struct arena_chunk_s {
+    arena_chunk_t* prev;
+    size_t cap;
+    size_t used;
+    char data[];
+};
+
+static arena_chunk_t* _arena_chunk_new(arena_t* self, size_t min_size);
+
+// Return a fixed-size object allocator handing out obj_size blocks carved
+// from chunks of per_chunk objects. Freed blocks go on a free list and are
+// reused before the next chunk is allocated. Chunks live until slab_destroy.
+slab_t* slab_new(size_t obj_size, size_t per_chunk) {
+  slab_t* self;
+  self = calloc(1, sizeof(slab_t));
+  self->obj_size = EON_MAX(obj_size, sizeof(void*));
+  self->obj_size = (self->obj_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  self->per_chunk = EON_MAX(per_chunk, 1);
+  return self;
+}
+
+// Return a zeroed object
+void* slab_alloc(slab_t* self) {
+  char* chunk;
+  char* obj;
+  size_t i;
+
+  if (!self->free_list) {
+    // Carve a new chunk. The first word links chunks for slab_destroy.
+    chunk = malloc(sizeof(void*) + self->obj_size * self->per_chunk);
+    *(void**)chunk = self->chunks;
+    self->chunks = chunk;
+
+    for (i = self->per_chunk; i > 0; i--) {
+      obj = chunk + sizeof(void*) + self->obj_size * (i - 1);
+      *(void**)obj = self->free_list;
+      self->free_list = obj;
+    }
+  }
+
+  obj = self->free_list;
+  self->free_list = *(void**)obj;
+  self->nused += 1;
+  memset(obj, 0, self->obj_size);
+  return obj;
+}
+
+// Return obj to the free list
+void slab_free(slab_t* self, void* obj) {
+  *(void**)obj = self->free_list;
+  self->free_list = obj;
+  self->nused -= 1;
+}
+
+// Free all chunks, including any objects still in use
+int slab_destroy(slab_t* self) {
+  void* chunk;
+  void* next;
+
+  for (chunk = self->chunks; chunk; chunk = next) {
+    next = *(void**)chunk;
+    free(chunk);
+  }
+
+  free(self);
+  return EON_OK;
+}
+
+// Return a bump allocator for short-lived data. Take a mark with arena_tell
+// before allocating and arena_rewind to it when done; marks nest, so a
+// command run from within a prompt rewinds only what it allocated.
+arena_t* arena_new(size_t chunk_size) {
+  arena_t* self;
+  self = calloc(1, sizeof(arena_t));
+  self->chunk_size = chunk_size;
+  return self;
+}
+
+// Return size bytes of zeroed memory, 16-byte aligned
+void* arena_alloc(arena_t* self, size_t size) {
+  arena_chunk_t* chunk;
+  void* ptr;
+
+  size = (size + 15) & ~(size_t)15;
+  chunk = self->chunk;
+
+  if (!chunk || chunk->cap - chunk->used < size) {
+    chunk = _arena_chunk_new(self, size);
+  }
+
+  ptr = chunk->data + chunk->used;
+  chunk->used += size;
+  self->nallocs += 1;
+  memset(ptr, 0, size);
+  return ptr;
+}
+
+// Return a copy of str in the arena
+char* arena_strndup(arena_t* self, const char* str, size_t len) {
+  char* copy;
+  copy = arena_alloc(self, len + 1);
+  memcpy(copy, str, len);
+  return copy;
+}
+
+// Return a formatted string in the arena
+char* arena_sprintf(arena_t* self, const char* fmt, ...) {
+  va_list vl;
+  char* str;
+  int len;
+
+  va_start(vl, fmt);
+  len = vsnprintf(NULL, 0, fmt, vl);
+  va_end(vl);
+
+  if (len < 0) return NULL;
+
+  str = arena_alloc(self, (size_t)len + 1);
+  va_start(vl, fmt);
+  vsnprintf(str, (size_t)len + 1, fmt, vl);
+  va_end(vl);
+  return str;
+}
+
+// Return the current allocation point
+arena_mark_t arena_tell(arena_t* self) {
+  arena_mark_t mark;
+  mark.chunk = self->chunk;
+  mark.used = self->chunk ? self->chunk->used : 0;
+  return mark;
+}
+
+// Release everything allocated since mark. One chunk is kept as a spare so
+// a steady stream of commands does not churn malloc.
+int arena_rewind(arena_t* self, arena_mark_t mark) {
+  arena_chunk_t* chunk;
+
+  while (self->chunk && self->chunk != mark.chunk) {
+    chunk = self->chunk;
+    self->chunk = chunk->prev;
+
+    if (!self->spare && chunk->cap == self->chunk_size) {
+      self->spare = chunk;
+    } else {
+      free(chunk);
+    }
+  }
+
+  if (self->chunk) self->chunk->used = mark.used;
+
+  return EON_OK;
+}
+
+// Free the arena and all its chunks
+int arena_destroy(arena_t* self) {
+  arena_rewind(self, (arena_mark_t){ NULL, 0 });
+  if (self->spare) free(self->spare);
+  free(self);
+  return EON_OK;
+}
+
+// Push a chunk with room for at least min_size bytes
+static arena_chunk_t* _arena_chunk_new(arena_t* self, size_t min_size) {
+  arena_chunk_t* chunk;
+
+  if (self->spare && min_size <= self->spare->cap) {
+    chunk = self->spare;
+    self->spare = NULL;
+  } else {
+    chunk = malloc(sizeof(arena_chunk_t) + EON_MAX(min_size, self->chunk_size));
+    chunk->cap = EON_MAX(min_size, self->chunk_size);
+  }
+
+  chunk->used = 0;
+  chunk->prev = self->chunk;
+  self->chunk = chunk;
+  return chunk;
+}
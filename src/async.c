@@ -5,6 +5,7 @@
 #include <sys/time.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/wait.h>
 #include "utlist.h"
 #include "eon.h"
 
@@ -44,6 +45,63 @@ async_proc_new_failure:
   return NULL;
 }
 
+// Return a new async_proc_t that runs fn in a forked child. The child sees a
+// copy-on-write snapshot of the editor as of the fork. Anything fn writes to
+// wfd is passed to callback.
+async_proc_t* async_proc_new_fn(editor_t* editor, void* owner, async_proc_t** owner_aproc, async_proc_fn_t fn, void* udata, async_proc_cb_t callback) {
+  async_proc_t* aproc;
+  int fds[2];
+  pid_t pid;
+
+  if (pipe(fds) != 0) {
+    return NULL;
+  }
+
+  if ((pid = fork()) < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return NULL;
+
+  } else if (pid == 0) {
+    // Child: run fn to completion even if the editor goes away
+    close(fds[0]);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGTERM, SIG_IGN);
+    signal(SIGINT, SIG_IGN);
+    signal(SIGHUP, SIG_IGN);
+    _exit(fn(udata, fds[1]) == EON_OK ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  close(fds[1]);
+
+  aproc = calloc(1, sizeof(async_proc_t));
+  aproc->editor = editor;
+  async_proc_set_owner(aproc, owner, owner_aproc);
+  aproc->pid = pid;
+  aproc->rfd = fds[0];
+  aproc->rpipe = fdopen(aproc->rfd, "r");
+  aproc->is_fn = 1;
+  setvbuf(aproc->rpipe, NULL, _IONBF, 0);
+  aproc->callback = callback;
+  DL_APPEND(editor->async_procs, aproc);
+  return aproc;
+}
+
+// Return a new async_proc_t that watches fd instead of a process. callback
+// is passed no data when fd is readable; reading it is up to the owner. fd is
+// not closed by async_proc_destroy.
+async_proc_t* async_proc_new_watch(editor_t* editor, void* owner, async_proc_t** owner_aproc, int fd, async_proc_cb_t callback) {
+  async_proc_t* aproc;
+  aproc = calloc(1, sizeof(async_proc_t));
+  aproc->editor = editor;
+  async_proc_set_owner(aproc, owner, owner_aproc);
+  aproc->rfd = fd;
+  aproc->is_watch = 1;
+  aproc->callback = callback;
+  DL_APPEND(editor->async_procs, aproc);
+  return aproc;
+}
+
 // Set aproc owner
 int async_proc_set_owner(async_proc_t* aproc, void* owner, async_proc_t** owner_aproc) {
   if (aproc->owner_aproc) {
@@ -62,6 +120,19 @@ int async_proc_destroy(async_proc_t* aproc, int preempt) {
 
   if (aproc->owner_aproc) *aproc->owner_aproc = NULL;
 
+  if (aproc->is_watch) {
+    free(aproc);
+    return EON_OK;
+  }
+
+  if (aproc->is_fn) {
+    // Forked children are never preempted; wait for them to finish
+    fclose(aproc->rpipe);
+    waitpid(aproc->pid, NULL, 0);
+    free(aproc);
+    return EON_OK;
+  }
+
   if (preempt) {
     if (aproc->rfd) close(aproc->rfd);
     if (aproc->wfd) close(aproc->wfd);
@@ -75,11 +146,13 @@ int async_proc_destroy(async_proc_t* aproc, int preempt) {
   return EON_OK;
 }
 
-// Manage async procs, giving priority to user input. Return 1 if drain should
-// be called again, else return 0.
-int async_proc_drain_all(async_proc_t* aprocs, int* ttyfd) {
+// Manage async procs, giving priority to user input. Wait at most timeout_ms
+// for something to read, or forever if timeout_ms is negative. Return 1 if
+// drain should be called again, else return 0.
+int async_proc_drain_all(async_proc_t* aprocs, int* ttyfd, int timeout_ms) {
   int maxfd;
   fd_set readfds;
+  struct timeval timeout;
   async_proc_t* aproc;
   async_proc_t* aproc_tmp;
   char buf[1024 + 1];
@@ -119,7 +192,12 @@ int async_proc_drain_all(async_proc_t* aprocs, int* ttyfd) {
   }
 
   // Perform select
-  rc = select(maxfd + 1, &readfds, NULL, NULL, NULL);
+  if (timeout_ms >= 0) {
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+  }
+
+  rc = select(maxfd + 1, &readfds, NULL, NULL, timeout_ms >= 0 ? &timeout : NULL);
 
   if (rc < 0) {
     return 0; // TODO error
@@ -135,6 +213,12 @@ int async_proc_drain_all(async_proc_t* aprocs, int* ttyfd) {
   } else {
     // Read async procs
     DL_FOREACH_SAFE(aprocs, aproc, aproc_tmp) {
+      // Watches read for themselves and live until their owner destroys them
+      if (aproc->is_watch) {
+        if (FD_ISSET(aproc->rfd, &readfds)) aproc->callback(aproc, NULL, 0);
+        continue;
+      }
+
       // Read and invoke callback
       if (FD_ISSET(aproc->rfd, &readfds)) {
         nbytes = read(aproc->rfd, &buf, 1024);
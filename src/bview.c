@@ -1,7 +1,6 @@
 #include <math.h>
 #include <unistd.h>
 #include <wctype.h>
-#include <libgen.h>
 #include "eon.h"
 #include "colors.h"
 
@@ -18,8 +17,19 @@ static buffer_t* _bview_open_buffer(bview_t* self, char* opt_path, int opt_path_
 static void _bview_draw_prompt(bview_t* self);
 static void _bview_draw_status(bview_t* self);
 static void _bview_draw_edit(bview_t* self, int x, int y, int w, int h);
-static void _bview_draw_bline(bview_t* self, bline_t* bline, int rect_y, bline_t** optret_bline, int* optret_rect_y);
+static int _bview_draw_bline(bview_t* self, bline_t* bline, int rect_y, int skip_rows);
+static bint_t _bview_get_style_run_end(bview_t* self, bline_t* bline, bint_t char_col, bint_t* ispan);
 static void _bview_highlight_bracket_pair(bview_t* self, mark_t* mark);
+static void _bview_remove_syntax(bview_t* self);
+static bview_t* _bview_get_sharer(bview_t* self);
+static void _bview_set_viewport_row(bview_t* self, bint_t row);
+static bint_t _bview_get_cursor_row(bview_t* self);
+static void _bview_draw_tab_bar(bview_t* self, int w);
+static void _bview_draw_tab(editor_t* editor, struct tb_cell* cells, int w, int offset, int num, bview_t* bview);
+static void _bview_cursor_get_lo_hi(cursor_t* cursor, mark_t** ret_lo, mark_t** ret_hi);
+static int _bview_cursor_cmp(cursor_t* a, cursor_t* b);
+static int _bview_cursors_overlap(cursor_t* a, cursor_t* b);
+static void _bview_cursor_absorb(cursor_t* keep, cursor_t* drop);
 
 // Create a new bview
 bview_t* bview_new(editor_t* editor, char* opt_path, int opt_path_len, buffer_t* opt_buffer) {
@@ -29,6 +39,7 @@ bview_t* bview_new(editor_t* editor, char* opt_path, int opt_path_len, buffer_t*
   // Allocate and init bview
   self = calloc(1, sizeof(bview_t));
   self->editor = editor;
+  self->tab_index = -1;
 
   // self->rect_caption.fg = RECT_CAPTION_FG;
   // self->rect_caption.bg = RECT_CAPTION_BG;
@@ -67,6 +78,7 @@ int bview_open(bview_t* self, char* path, int path_len) {
 // Free a bview
 int bview_destroy(bview_t* self) {
   _bview_deinit(self);
+  wrap_destroy(self);
   free(self);
   return EON_OK;
 }
@@ -264,25 +276,19 @@ int bview_split(bview_t* self, int is_vertical, float factor, bview_t** optret_b
 
 // Return number of active cursors
 int bview_get_active_cursor_count(bview_t* self) {
-  int count;
-  cursor_t* cursor;
-  count = 0;
-  DL_FOREACH(self->cursors, cursor) {
-    if (!cursor->is_asleep) {
-      count += 1;
-    }
-  }
-  return count;
+  return self->cursor_count - self->asleep_count;
 }
 
-// Add a cursor to a bview
+// Add a cursor to a bview. The cursor list is put back in position order
+// after the command by bview_merge_cursors.
 int bview_add_cursor(bview_t* self, bline_t* bline, bint_t col, cursor_t** optret_cursor) {
   cursor_t* cursor;
 
-  cursor = calloc(1, sizeof(cursor_t));
+  cursor = slab_alloc(self->editor->cursor_slab);
   cursor->bview = self;
   cursor->mark = buffer_add_mark(self->buffer, bline, col);
   DL_APPEND(self->cursors, cursor);
+  self->cursor_count += 1;
 
   if (!self->active_cursor) {
     self->active_cursor = cursor;
@@ -301,6 +307,7 @@ int bview_add_cursor_asleep(bview_t* self, bline_t* bline, bint_t col, cursor_t*
 
   bview_add_cursor(self, bline, col, &cursor);
   cursor->is_asleep = 1;
+  self->asleep_count += 1;
   if (optret_cursor) *optret_cursor = cursor;
 
   return EON_OK;
@@ -314,6 +321,7 @@ int bview_wake_sleeping_cursors(bview_t* self) {
       cursor->is_asleep = 0;
     }
   }
+  self->asleep_count = 0;
   return EON_OK;
 }
 
@@ -331,26 +339,121 @@ int bview_remove_cursors_except(bview_t* self, cursor_t* one) {
 
 // Remove a cursor from a bview
 int bview_remove_cursor(bview_t* self, cursor_t* cursor) {
-  cursor_t* el;
-  cursor_t* tmp;
-  DL_FOREACH_SAFE(self->cursors, el, tmp) {
-    if (el == cursor) {
-      self->active_cursor = el->prev && el->prev != el ? el->prev : el->next;
-      DL_DELETE(self->cursors, el);
-
-      if (el->sel_rule) {
-        buffer_remove_srule(el->bview->buffer, el->sel_rule, 0, 0);
-        srule_destroy(el->sel_rule);
-        el->sel_rule = NULL;
-      }
+  if (!cursor || cursor->bview != self) {
+    return EON_ERR;
+  }
+
+  if (cursor == self->active_cursor) {
+    self->active_cursor = cursor->prev && cursor->prev != cursor ? cursor->prev : cursor->next;
+  }
 
-      if (el->cut_buffer) free(el->cut_buffer);
+  DL_DELETE(self->cursors, cursor);
+  self->cursor_count -= 1;
+  if (cursor->is_asleep) self->asleep_count -= 1;
+
+  // The index may hold this cursor; drop it until the next merge
+  self->cursor_index_len = 0;
+
+  if (cursor->sel_rule) {
+    buffer_remove_srule(cursor->bview->buffer, cursor->sel_rule, 0, 0);
+    srule_destroy(cursor->sel_rule);
+    cursor->sel_rule = NULL;
+  }
+
+  if (cursor->kill) kill_unref(cursor->kill);
+  if (cursor->pasted) kill_unref(cursor->pasted);
+
+  slab_free(self->editor->cursor_slab, cursor);
+  return EON_OK;
+}
+
+// Put cursors in position order and merge ones that landed on each other:
+// plain cursors at the same spot, or selections that overlap. Sleeping and
+// awake cursors never merge, so a cursor can be dropped where one stands.
+// Then index them for bview_find_cursor. Called after each command.
+int bview_merge_cursors(bview_t* self) {
+  cursor_t* cursor;
+  cursor_t* next;
+  cursor_t* keep;
+  cursor_t* drop;
+  int is_sorted;
 
-      free(el);
-      return EON_OK;
+  self->cursor_index_len = 0;
+
+  if (self->cursor_count < 2) {
+    return EON_OK;
+  }
+
+  // Cursors rarely swap places, so check before sorting
+  is_sorted = 1;
+  DL_FOREACH(self->cursors, cursor) {
+    if (cursor->next && _bview_cursor_cmp(cursor, cursor->next) > 0) {
+      is_sorted = 0;
+      break;
     }
   }
-  return EON_ERR;
+
+  if (!is_sorted) {
+    DL_SORT(self->cursors, _bview_cursor_cmp);
+  }
+
+  cursor = self->cursors;
+
+  while (cursor && (next = cursor->next)) {
+    if (!_bview_cursors_overlap(cursor, next)) {
+      cursor = next;
+      continue;
+    }
+
+    keep = next == self->active_cursor ? next : cursor;
+    drop = keep == cursor ? next : cursor;
+    _bview_cursor_absorb(keep, drop);
+    bview_remove_cursor(self, drop);
+    cursor = keep;
+  }
+
+  if (self->cursor_index_cap < self->cursor_count) {
+    self->cursor_index_cap = self->cursor_count;
+    self->cursor_index = realloc(self->cursor_index, sizeof(cursor_t*) * self->cursor_index_cap);
+  }
+
+  DL_FOREACH(self->cursors, cursor) {
+    self->cursor_index[self->cursor_index_len++] = cursor;
+  }
+
+  return EON_OK;
+}
+
+// Return the cursor whose mark (or selection start) is at bline:col, or
+// NULL. Looks up the index built by the last bview_merge_cursors in O(log n),
+// so cursors added since are not seen.
+cursor_t* bview_find_cursor(bview_t* self, bline_t* bline, bint_t col) {
+  mark_t* lo_mark;
+  mark_t* hi_mark;
+  int lo;
+  int hi;
+  int mid;
+
+  lo = 0;
+  hi = self->cursor_index_len;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    _bview_cursor_get_lo_hi(self->cursor_index[mid], &lo_mark, &hi_mark);
+
+    if (lo_mark->bline->line_index < bline->line_index
+      || (lo_mark->bline == bline && lo_mark->col < col)
+    ) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo >= self->cursor_index_len) return NULL;
+
+  _bview_cursor_get_lo_hi(self->cursor_index[lo], &lo_mark, &hi_mark);
+  return lo_mark->bline == bline && lo_mark->col == col ? self->cursor_index[lo] : NULL;
 }
 
 int bview_is_line_visible(bview_t* self, bint_t number) {
@@ -373,6 +476,7 @@ int bview_move_to_line(bview_t* self, bint_t number) {
 
   // if (y + self->rect_buffer.h - 2 < self->buffer->line_count) {
   self->viewport_y = y;
+  self->viewport_y_row = 0;
   buffer_get_bline(self->buffer, self->viewport_y, &self->viewport_bline);
   // }
 
@@ -392,6 +496,19 @@ int bview_set_line_bg(bview_t * self, bint_t line_index, int color) {
 int bview_scroll_viewport(bview_t* self, int offset) {
   bint_t y;
 
+  if (wrap_is_enabled(self)) {
+    // Scroll by display rows
+    y = wrap_row_of_line(self, self->viewport_y) + self->viewport_y_row + offset;
+
+    if (y < 0) y = 0;
+
+    if (y + self->rect_buffer.h - 2 < wrap_row_count(self)) {
+      _bview_set_viewport_row(self, y);
+    }
+
+    return EON_OK;
+  }
+
   if (offset < 0 && self->viewport_y < offset * -1) {
     y = 0;
   } else {
@@ -410,6 +527,12 @@ int bview_scroll_viewport(bview_t* self, int offset) {
 int bview_center_viewport_y(bview_t* self) {
   bint_t center = self->active_cursor->mark->bline->line_index - (self->rect_buffer.h / 2);
 
+  if (wrap_is_enabled(self)) {
+    _bview_set_viewport_row(self, EON_MAX(0, _bview_get_cursor_row(self) - (self->rect_buffer.h / 2)));
+    bview_rectify_viewport(self);
+    return EON_OK;
+  }
+
   if (center < 0) center = 0;
 
   self->viewport_y = center;
@@ -421,6 +544,7 @@ int bview_center_viewport_y(bview_t* self) {
 // Zero the viewport vertically
 int bview_zero_viewport_y(bview_t* self) {
   self->viewport_y = self->active_cursor->mark->bline->line_index;
+  self->viewport_y_row = 0;
   bview_rectify_viewport(self);
   buffer_get_bline(self->buffer, self->viewport_y, &self->viewport_bline);
   return EON_OK;
@@ -431,6 +555,12 @@ int bview_max_viewport_y(bview_t* self) {
   bint_t max;
   max = self->active_cursor->mark->bline->line_index - self->rect_buffer.h;
 
+  if (wrap_is_enabled(self)) {
+    _bview_set_viewport_row(self, EON_MAX(0, _bview_get_cursor_row(self) - self->rect_buffer.h));
+    bview_rectify_viewport(self);
+    return EON_OK;
+  }
+
   if (max < 0) max = 0;
 
   self->viewport_y = max;
@@ -439,6 +569,25 @@ int bview_max_viewport_y(bview_t* self) {
   return EON_OK;
 }
 
+// Return 1 if the active cursor is on the last line and that line is in view
+int bview_is_at_end(bview_t* self) {
+  bint_t last;
+  bint_t top;
+
+  last = self->buffer->line_count - 1;
+
+  if (self->active_cursor->mark->bline->line_index != last) {
+    return 0;
+  }
+
+  if (wrap_is_enabled(self)) {
+    top = wrap_row_of_line(self, self->viewport_y) + self->viewport_y_row;
+    return wrap_row_of_line(self, last) < top + self->rect_buffer.h ? 1 : 0;
+  }
+
+  return last < self->viewport_y + self->rect_buffer.h ? 1 : 0;
+}
+
 // Rectify the viewport
 int bview_rectify_viewport(bview_t* self) {
   mark_t* mark;
@@ -446,12 +595,28 @@ int bview_rectify_viewport(bview_t* self) {
 
   // Rectify each dimension of the viewport
   MLBUF_BLINE_ENSURE_CHARS(mark->bline);
+
+  if (wrap_is_enabled(self)) {
+    bint_t row;
+
+    // No horizontal scrolling; rectify vertically in display rows
+    self->viewport_x = 0;
+    self->viewport_x_vcol = 0;
+    row = wrap_row_of_line(self, EON_MAX(0, self->viewport_y)) + self->viewport_y_row;
+
+    if (_bview_rectify_viewport_dim(self, mark->bline, _bview_get_cursor_row(self), self->viewport_scope_y, self->rect_buffer.h, &row)) {
+      _bview_set_viewport_row(self, row);
+    }
+
+    return EON_OK;
+  }
+
   _bview_rectify_viewport_dim(self, mark->bline, EON_MARK_COL_TO_VCOL(mark), self->viewport_scope_x, self->rect_buffer.w, &self->viewport_x_vcol);
   bline_get_col_from_vcol(mark->bline, self->viewport_x_vcol, &(self->viewport_x));
 
   if (_bview_rectify_viewport_dim(self, mark->bline, mark->bline->line_index, self->viewport_scope_y, self->rect_buffer.h, &self->viewport_y)) {
-    // TODO viewport_y_vrow (soft-wrapped lines, code folding, etc)
     // Refresh viewport_bline
+    self->viewport_y_row = 0;
     buffer_get_bline(self->buffer, self->viewport_y, &self->viewport_bline);
   }
 
@@ -510,16 +675,34 @@ static int _bview_rectify_viewport_dim(bview_t* self, bline_t* bline, bint_t vpo
   return rc;
 }
 
+// Scroll so display row is at the top of the viewport
+static void _bview_set_viewport_row(bview_t* self, bint_t row) {
+  self->viewport_y = wrap_line_at_row(self, row, &self->viewport_y_row);
+  buffer_get_bline(self->buffer, self->viewport_y, &self->viewport_bline);
+}
+
+// Return display row of the active cursor
+static bint_t _bview_get_cursor_row(bview_t* self) {
+  mark_t* mark;
+  mark = self->active_cursor->mark;
+  MLBUF_BLINE_ENSURE_CHARS(mark->bline);
+  return wrap_row_of_line(self, mark->bline->line_index) + EON_MARK_COL_TO_VCOL(mark) / self->rect_buffer.w;
+}
+
 // Init a bview with a buffer
 static void _bview_init(bview_t* self, buffer_t* buffer) {
   cursor_t* cursor_tmp;
   kmap_t* kmap_init;
+  bview_t* sharer;
 
   _bview_deinit(self);
 
   // Reference buffer
   self->buffer = buffer;
   self->buffer->ref_count += 1;
+  self->editor->is_tab_bar_dirty = 1;
+  self->viewport_y_row = 0;
+  wrap_invalidate(self);
   _bview_set_linenum_width(self);
 
   // Push normal mode
@@ -531,8 +714,20 @@ static void _bview_init(bview_t* self, buffer_t* buffer) {
   }
 
   bview_push_kmap(self, kmap_init);
-  bview_set_syntax(self, NULL);
+
+  // A shared buffer has one syntax and tab width; adopt them rather than
+  // resetting them under the bviews already showing it
+  if ((sharer = _bview_get_sharer(self))) {
+    self->syntax = sharer->syntax;
+    self->tab_width = sharer->tab_width;
+    self->tab_to_space = sharer->tab_to_space;
+  } else {
+    bview_set_syntax(self, NULL);
+  }
   bview_add_cursor(self, self->buffer->first_line, 0, &cursor_tmp);
+
+  // Recover unsaved edits from a previous session
+  journal_replay(self);
 }
 
 // Invoked once after a bview has been resized for the first time
@@ -570,8 +765,38 @@ static void _bview_buffer_callback(buffer_t* buffer, baction_t* action, void* ud
   editor = self->editor;
   active = editor->active;
 
+  // Account for undo memory and journal the edit
+  if (EON_BVIEW_IS_EDIT(self)) {
+    undo_track(editor, buffer, action);
+    journal_record_action(editor, buffer, action);
+    findall_update(editor, buffer, action);
+  }
+
+  // Note edits made while a background save of this buffer is running and
+  // keep soft wrap indexes current
+  if (action) {
+    bview_t* bview;
+    bview_t* tmp1;
+    bview_t* tmp2;
+    CDL_FOREACH_SAFE2(editor->all_bviews, bview, tmp1, tmp2, all_prev, all_next) {
+      if (bview->buffer != buffer) continue;
+
+      if (bview->save_proc) {
+        bview->is_save_dirty = 1;
+      }
+
+      if (!action->start_line) {
+        wrap_invalidate(bview);
+      } else if (action->line_delta != 0) {
+        wrap_update_lines(bview, action);
+      } else {
+        wrap_update_line(bview, action->start_line);
+      }
+    }
+  }
+
   // Rectify viewport if edit was on active bview
-  if (active->buffer == buffer) {
+  if (active && active->buffer == buffer) {
     bview_rectify_viewport(active);
   }
 
@@ -637,15 +862,13 @@ static void _bview_deinit(bview_t* self) {
     bview_pop_kmap(self, NULL);
   }
 
-  // Remove all syntax rules
-  if (self->syntax) {
-    srule_node_t* srule_node;
+  // Remove all syntax rules, unless another bview still shows the buffer
+  if (self->syntax && !_bview_get_sharer(self)) {
     buffer_set_styles_enabled(self->buffer, 0);
-    DL_FOREACH(self->syntax->srules, srule_node) {
-      buffer_remove_srule(self->buffer, srule_node->srule, 0, 100);
-    }
+    _bview_remove_syntax(self);
     buffer_set_styles_enabled(self->buffer, 1);
   }
+  self->syntax = NULL;
 
   // Remove all cursors
   while (self->active_cursor) {
@@ -653,12 +876,34 @@ static void _bview_deinit(bview_t* self) {
     self->active_cursor = NULL;
   }
 
+  if (self->cursor_index) {
+    free(self->cursor_index);
+    self->cursor_index = NULL;
+  }
+
   // Destroy async proc
   if (self->async_proc) {
     async_proc_destroy(self->async_proc, 1);
     self->async_proc = NULL;
   }
 
+  isearch_end(self);
+  findall_unlink_menu(self->editor, self);
+  server_unlink_bview(self->editor, self);
+
+  // Let a background save finish before the buffer goes away
+  if (self->save_proc) {
+    async_proc_destroy(self->save_proc, 0);
+    self->save_proc = NULL;
+  }
+
+  if (self->save_path) {
+    free(self->save_path);
+    self->save_path = NULL;
+  }
+
+  str_free(&self->save_pending);
+
   // Remove all listeners
   DL_FOREACH_SAFE(self->listeners, listener, listener_tmp) {
     bview_destroy_listener(self, listener);
@@ -669,7 +914,22 @@ static void _bview_deinit(bview_t* self) {
     self->buffer->ref_count -= 1;
 
     if (self->buffer->ref_count < 1) {
+      editor_unregister_buffer(self->editor, self->buffer);
+      undo_destroy(self->editor, self->buffer);
+      journal_destroy(self->editor, self->buffer);
+      findall_destroy(self->editor, self->buffer);
+      watch_destroy(self->editor, self->buffer);
       buffer_destroy(self->buffer);
+
+    } else {
+      // Hand buffer callbacks to another bview still sharing the buffer
+      bview_t* bview;
+      CDL_FOREACH2(self->editor->all_bviews, bview, all_next) {
+        if (bview != self && bview->buffer == self->buffer) {
+          buffer_set_callback(self->buffer, _bview_buffer_callback, bview);
+          break;
+        }
+      }
     }
   }
 
@@ -679,12 +939,14 @@ static void _bview_deinit(bview_t* self) {
   }
 }
 
-// Set syntax on bview buffer
+// Set syntax on bview buffer. Srules belong to the buffer, so every bview
+// sharing it gets the same syntax and tab settings.
 int bview_set_syntax(bview_t* self, char* opt_syntax) {
   syntax_t* syntax;
   syntax_t* syntax_tmp;
   syntax_t* use_syntax;
   srule_node_t* srule_node;
+  bview_t* bview;
 
   // Only set syntax on edit bviews
   if (!EON_BVIEW_IS_EDIT(self)) {
@@ -709,12 +971,7 @@ int bview_set_syntax(bview_t* self, char* opt_syntax) {
   buffer_set_styles_enabled(self->buffer, 0);
 
   // Remove current syntax
-  if (self->syntax) {
-    DL_FOREACH(self->syntax->srules, srule_node) {
-      buffer_remove_srule(self->buffer, srule_node->srule, 0, 100);
-      self->syntax = NULL;
-    }
-  }
+  _bview_remove_syntax(self);
 
   // Set syntax if found
   if (use_syntax) {
@@ -734,6 +991,14 @@ int bview_set_syntax(bview_t* self, char* opt_syntax) {
     _bview_set_tab_width(self, self->editor->tab_width);
   }
 
+  CDL_FOREACH2(self->editor->all_bviews, bview, all_next) {
+    if (bview != self && bview->buffer == self->buffer) {
+      bview->syntax = self->syntax;
+      bview->tab_width = self->tab_width;
+      bview->tab_to_space = self->tab_to_space;
+    }
+  }
+
   buffer_set_styles_enabled(self->buffer, 1);
 
   return use_syntax ? EON_OK : EON_ERR;
@@ -824,8 +1089,10 @@ static buffer_t* _bview_open_buffer(bview_t* self, char* opt_path, int opt_path_
   int fix_path_len;
   int exp_path_len;
   bint_t startup_line_num;
+  int is_shared;
 
   buffer = NULL;
+  is_shared = 0;
   has_path = opt_path && opt_path_len > 0 ? 1 : 0;
 
   if (has_path) {
@@ -833,7 +1100,15 @@ static buffer_t* _bview_open_buffer(bview_t* self, char* opt_path, int opt_path_
     exp_path_len = strlen(exp_path);
 
     _bview_fix_path(self, exp_path, exp_path_len, &fix_path, &fix_path_len, &startup_line_num);
-    buffer = buffer_new_open(fix_path);
+
+    // Share the buffer if the file is already open
+    if ((buffer = editor_find_buffer_by_path(self->editor, fix_path, fix_path_len))) {
+      is_shared = 1;
+
+    } else if ((buffer = buffer_new_open(fix_path))) {
+      editor_register_buffer(self->editor, buffer);
+      watch_add(self->editor, buffer);
+    }
 
     if (buffer) self->startup_linenum = startup_line_num;
 
@@ -849,13 +1124,20 @@ static buffer_t* _bview_open_buffer(bview_t* self, char* opt_path, int opt_path_
     }
   }
 
-  buffer_set_callback(buffer, _bview_buffer_callback, self);
-  _bview_set_tab_width(self, self->tab_width);
+  // A shared buffer keeps calling back to the bview that opened it
+  if (!is_shared) buffer_set_callback(buffer, _bview_buffer_callback, self);
+
+  if (is_shared) {
+    self->tab_width = buffer->tab_width;
+  } else {
+    _bview_set_tab_width(self, self->tab_width);
+  }
+
   return buffer;
 }
 
 static void _bview_draw_prompt(bview_t* self) {
-  _bview_draw_bline(self, self->buffer->first_line, 0, NULL, NULL);
+  _bview_draw_bline(self, self->buffer->first_line, 0, 0);
 }
 
 static void _bview_draw_status(bview_t* self) {
@@ -863,6 +1145,8 @@ static void _bview_draw_status(bview_t* self) {
   bview_t* active;
   bview_t* active_edit;
   mark_t* mark;
+  bint_t findall_nth;
+  bint_t findall_count;
 
   editor = self->editor;
   active = editor->active;
@@ -965,6 +1249,26 @@ static void _bview_draw_status(bview_t* self) {
 
   rect_printf(editor->rect_status, editor->rect_status.w - 11, 0, TB_WHITE | TB_BOLD, RECT_STATUS_BG, " eon %s", EON_VERSION);
 
+  // Background save and search progress
+  if (editor->is_searching) {
+    rect_printf(editor->rect_status, editor->rect_status.w - 34, 0, ASYNC_FG, ASYNC_BG, " searching %3d%% (C-c cancels) ", editor->search_pct);
+
+  } else if (active_edit->save_proc) {
+    rect_printf(editor->rect_status, editor->rect_status.w - 25, 0, ASYNC_FG, ASYNC_BG, " saving %3d%% ", active_edit->save_pct);
+
+  } else if (active_edit->isearch && active_edit->isearch->cre) {
+    // Incremental search matches, counted in the background
+    if (active_edit->isearch->count_proc) {
+      rect_printf(editor->rect_status, editor->rect_status.w - 34, 0, ASYNC_FG, ASYNC_BG, " %9lld+ matches %3d%% ", (long long)active_edit->isearch->match_count, active_edit->isearch->pct);
+    } else {
+      rect_printf(editor->rect_status, editor->rect_status.w - 34, 0, ASYNC_FG, ASYNC_BG, " %15lld matches ", (long long)active_edit->isearch->match_count);
+    }
+
+  } else if (findall_get_counts(editor, active_edit->active_cursor->mark, &findall_nth, &findall_count) == EON_OK) {
+    // Position among find-all matches
+    rect_printf(editor->rect_status, editor->rect_status.w - 34, 0, ASYNC_FG, ASYNC_BG, " match %9lld/%-9lld ", (long long)findall_nth, (long long)findall_count);
+  }
+
   // Overlay errstr if present
 _bview_draw_status_end:
 
@@ -986,8 +1290,8 @@ static void _bview_draw_edit(bview_t* self, int x, int y, int w, int h) {
   int min_w;
   int min_h;
   int rect_y;
-  int fg_attr;
-  int bg_attr;
+  int skip_rows;
+  bint_t line_index;
   bline_t* bline;
 
   // Handle split
@@ -1023,71 +1327,159 @@ static void _bview_draw_edit(bview_t* self, int x, int y, int w, int h) {
     return;
   }
 
-  bview_t* bview_tmp;
-  int bview_count = 0;
-  int offset = 0;
-  char * desc;
-
   // render titlebar/tabs
-  CDL_FOREACH2(self->editor->all_bviews, bview_tmp, all_next) {
+  _bview_draw_tab_bar(self, w);
 
-    // TODO: find out if this can be optimized
-    if (EON_BVIEW_IS_EDIT(bview_tmp) && ((self->split_parent && bview_tmp == self) || (!self->split_parent && !bview_tmp->split_parent && self->split_parent != bview_tmp))) {
-      bview_count += 1;
+  // Render lines and margins
+  if (!self->viewport_bline) {
+    buffer_get_bline(self->buffer, EON_MAX(0, self->viewport_y), &self->viewport_bline);
+  }
 
-      if (bview_tmp == self->editor->active_edit) {
-        fg_attr = CAPTION_ACTIVE_FG;
-        bg_attr = CAPTION_ACTIVE_BG;
+  bline = self->viewport_bline;
+  line_index = self->viewport_y;
+  skip_rows = wrap_is_enabled(self) ? (int)self->viewport_y_row : 0;
 
-      } else {
-        fg_attr = CAPTION_INACTIVE_FG;
-        bg_attr = CAPTION_INACTIVE_BG;
-      }
+  for (rect_y = 0; rect_y < self->rect_buffer.h; ) {
+    if (line_index < 0 || line_index >= self->buffer->line_count || !bline) {
+      // Draw pre/post blank
+      rect_fill(self->rect_lines, 0, rect_y, self->linenum_width, ' ', 0, 0);
+      rect_fill(self->rect_margin_left, 0, rect_y, 1, ' ', 0, 0);
+      rect_fill(self->rect_margin_right, 0, rect_y, 1, ' ', 0, 0);
+      rect_fill(self->rect_buffer, 0, rect_y, self->rect_buffer.w, ' ', 0, 0);
+      rect_y += 1;
+      line_index += 1;
 
-      desc = bview_tmp->buffer && bview_tmp->buffer->path
-             ? basename(bview_tmp->buffer->path)
-             : EON_BVIEW_IS_MENU(bview_tmp) ? "Results" : "Untitled";
+    } else {
+      // Draw bline (possibly several rows if soft wrapped)
+      if (bline->is_chars_evicted) chars_restore(self->editor, bline);
+      rect_y += _bview_draw_bline(self, bline, rect_y, skip_rows);
+      skip_rows = 0;
+      bline = bline->next;
+      line_index += 1;
+    }
+  }
+}
 
-      if (offset + self->editor->bview_tab_width <= w) {
-        rect_printf(self->rect_caption, offset, 0, fg_attr, bg_attr, "%*.*s",
-          self->rect_caption.w, self->rect_caption.w, " ");
+// Draw the caption row. A split child shows only its own tab. Top-level
+// bviews share a tab bar that is rendered once into editor->tab_bar and
+// redrawn only when tabs, the active tab, an unsaved flag or the width change.
+static void _bview_draw_tab_bar(bview_t* self, int w) {
+  editor_t* editor;
+  struct tb_cell* cells;
+  int nvisible;
+  int i;
 
-        rect_printf(self->rect_caption, offset, 0, fg_attr, bg_attr, " [%d] %s %c",
-          bview_count, desc, !EON_BVIEW_IS_MENU(bview_tmp) && bview_tmp->buffer->is_unsaved ? '*' : ' ');
+  editor = self->editor;
+  w = EON_MIN(w, self->rect_caption.w);
 
-        offset += self->editor->bview_tab_width;
-      }
+  if (w < 1 || editor->bview_tab_width < 1) {
+    return;
+  }
+
+  if (self->split_parent) {
+    if (editor->bview_tab_width <= w) {
+      cells = calloc(w, sizeof(struct tb_cell));
+      _bview_draw_tab(editor, cells, w, 0, 1, self);
+      rect_put_cells(self->rect_caption, 0, 0, cells, w);
+      free(cells);
     }
+
+    return;
   }
 
-  // Render lines and margins
-  if (!self->viewport_bline) {
-    buffer_get_bline(self->buffer, EON_MAX(0, self->viewport_y), &self->viewport_bline);
+  nvisible = EON_MIN(editor->tabs_len, w / editor->bview_tab_width);
+
+  if (!editor->is_tab_bar_dirty
+      && editor->tab_bar
+      && editor->tab_bar_w == w
+      && editor->tab_bar_active == editor->active_edit
+     ) {
+    for (i = 0; i < nvisible; i++) {
+      if (editor->tabs[i]->tab_is_unsaved != editor->tabs[i]->buffer->is_unsaved) {
+        editor->is_tab_bar_dirty = 1;
+        break;
+      }
+    }
+  } else {
+    editor->is_tab_bar_dirty = 1;
   }
 
-  bline = self->viewport_bline;
+  if (editor->is_tab_bar_dirty) {
+    if (editor->tab_bar_w != w) {
+      editor->tab_bar = realloc(editor->tab_bar, sizeof(struct tb_cell) * w);
+      editor->tab_bar_w = w;
+    }
 
-  for (rect_y = 0; rect_y < self->rect_buffer.h; rect_y++) {
-    if (self->viewport_y + rect_y < 0 || self->viewport_y + rect_y >= self->buffer->line_count || !bline) { // "|| !bline" See TODOs below
-      // Draw pre/post blank
-      rect_printf(self->rect_lines, 0, rect_y, 0, 0, "%*c", self->linenum_width, ' ');
-      rect_printf(self->rect_margin_left, 0, rect_y, 0, 0, "%c", ' ');
-      rect_printf(self->rect_margin_right, 0, rect_y, 0, 0, "%c", ' ');
-      rect_printf(self->rect_buffer, 0, rect_y, 0, 0, "%-*.*s", self->rect_buffer.w, self->rect_buffer.w, " ");
+    memset(editor->tab_bar, 0, sizeof(struct tb_cell) * w);
 
-    } else {
-      // Draw bline at self->rect_buffer self->viewport_y + rect_y
-      // TODO How can bline be NULL here?
-      // TODO How can self->viewport_y != self->viewport_bline->line_index ?
-      _bview_draw_bline(self, bline, rect_y, &bline, &rect_y);
-      bline = bline->next;
+    for (i = 0; i < nvisible; i++) {
+      _bview_draw_tab(editor, editor->tab_bar, w, i * editor->bview_tab_width, i + 1, editor->tabs[i]);
+      editor->tabs[i]->tab_is_unsaved = editor->tabs[i]->buffer->is_unsaved;
     }
+
+    editor->tab_bar_active = editor->active_edit;
+    editor->is_tab_bar_dirty = 0;
+  }
+
+  rect_put_cells(self->rect_caption, 0, 0, editor->tab_bar, w);
+}
+
+// Render one tab label into cells at offset. Like the tab bar has always
+// looked, the tab's colors run to the end of the row until the next tab.
+static void _bview_draw_tab(editor_t* editor, struct tb_cell* cells, int w, int offset, int num, bview_t* bview) {
+  char label[PATH_MAX + 32];
+  char* desc;
+  char* cur;
+  char* stop;
+  uint32_t uni;
+  uint16_t fg_attr;
+  uint16_t bg_attr;
+  int len;
+  int i;
+
+  if (bview == editor->active_edit) {
+    fg_attr = CAPTION_ACTIVE_FG;
+    bg_attr = CAPTION_ACTIVE_BG;
+
+  } else {
+    fg_attr = CAPTION_INACTIVE_FG;
+    bg_attr = CAPTION_INACTIVE_BG;
+  }
+
+  desc = bview->buffer && bview->buffer->path
+         ? strrchr(bview->buffer->path, '/')
+         : NULL;
+  desc = desc ? desc + 1
+         : bview->buffer && bview->buffer->path ? bview->buffer->path
+         : EON_BVIEW_IS_MENU(bview) ? "Results" : "Untitled";
+
+  len = snprintf(label, sizeof(label), " [%d] %s %c",
+    num, desc, !EON_BVIEW_IS_MENU(bview) && bview->buffer->is_unsaved ? '*' : ' ');
+  len = EON_MIN(len, (int)sizeof(label) - 1);
+
+  for (i = offset; i < w; i++) {
+    cells[i].ch = ' ';
+    cells[i].fg = fg_attr;
+    cells[i].bg = bg_attr;
+  }
+
+  cur = label;
+  stop = label + len;
+
+  for (i = offset; i < w && cur < stop; i++) {
+    cur += utf8_char_to_unicode(&uni, cur, stop);
+    cells[i].ch = uni;
   }
 }
 
-static void _bview_draw_bline(bview_t* self, bline_t* bline, int rect_y, bline_t** optret_bline, int* optret_rect_y) {
+// Draw bline starting at rect_y, skipping its first skip_rows wrapped rows.
+// Return number of screen rows used.
+static int _bview_draw_bline(bview_t* self, bline_t* bline, int rect_y, int skip_rows) {
   int rect_x;
+  int row;
+  int nrows;
   bint_t char_col;
+  bint_t vcol;
   int fg;
   int bg;
   uint32_t ch;
@@ -1097,15 +1489,32 @@ static void _bview_draw_bline(bview_t* self, bline_t* bline, int rect_y, bline_t
   int i;
   int is_cursor_line;
   int is_soft_wrap;
-  int orig_rect_y;
+  int is_done;
+  bint_t run_end;
+  bint_t ispan;
+  struct tb_cell* cells;
+  int cells_w;
+  int cells_h;
+  int cell_x;
+  int cell_y;
+  bint_t match_cols[EON_ISEARCH_LINE_MATCHES * 2];
+  int nmatches;
+  int imatch;
 
   MLBUF_BLINE_ENSURE_CHARS(bline);
 
   // Set is_cursor_line
   is_cursor_line = self->active_cursor->mark->bline == bline ? 1 : 0;
 
-  // Soft wrap only for current line
-  is_soft_wrap = self->editor->soft_wrap && is_cursor_line && EON_BVIEW_IS_EDIT(self) ? 1 : 0;
+  // Soft wrap every line, clipped to the bottom edge
+  is_soft_wrap = wrap_is_enabled(self);
+  nrows = 1;
+
+  if (is_soft_wrap) {
+    wrap_update_line(self, bline);
+    nrows = (int)EON_MIN(wrap_rows_for_bline(bline, self->rect_buffer.w) - skip_rows, (bint_t)(self->rect_buffer.h - rect_y));
+    nrows = EON_MAX(1, nrows);
+  }
 
   // Use viewport_x only for current line when not soft wrapping
   viewport_x = 0;
@@ -1122,44 +1531,110 @@ static void _bview_draw_bline(bview_t* self, bline_t* bline, int rect_y, bline_t
 
       int linenum_fg = is_cursor_line ? LINENUM_FG_CURSOR : LINENUM_FG;
 
-      if (self->editor->linenum_type == EON_LINENUM_TYPE_ABS
+      if (skip_rows > 0) {
+        // Top of line is scrolled off; this row continues it
+        rect_fill(self->rect_lines, 0, rect_y, self->linenum_width, '.', 0, 0);
+
+      } else if (self->editor->linenum_type == EON_LINENUM_TYPE_ABS
           || self->editor->linenum_type == EON_LINENUM_TYPE_BOTH
           || (self->editor->linenum_type == EON_LINENUM_TYPE_REL && is_cursor_line)) {
 
-        rect_printf(self->rect_lines, 0, rect_y, linenum_fg, LINENUM_BG, "%*d", self->abs_linenum_width, (int)(bline->line_index + 1) % (int)pow(10, self->linenum_width));
+        rect_put_num(self->rect_lines, 0, rect_y, self->abs_linenum_width, (unsigned long long)(bline->line_index + 1), linenum_fg, LINENUM_BG);
 
         if (self->editor->linenum_type == EON_LINENUM_TYPE_BOTH) {
-          rect_printf(self->rect_lines, self->abs_linenum_width, rect_y, linenum_fg, LINENUM_BG, " %*d", self->rel_linenum_width, (int)labs(bline->line_index - self->active_cursor->mark->bline->line_index));
+          rect_fill(self->rect_lines, self->abs_linenum_width, rect_y, 1, ' ', linenum_fg, LINENUM_BG);
+          rect_put_num(self->rect_lines, self->abs_linenum_width + 1, rect_y, self->rel_linenum_width, (unsigned long long)labs(bline->line_index - self->active_cursor->mark->bline->line_index), linenum_fg, LINENUM_BG);
         }
 
       } else if (self->editor->linenum_type == EON_LINENUM_TYPE_REL) {
-        rect_printf(self->rect_lines, 0, rect_y, linenum_fg, LINENUM_BG, "%*d", self->rel_linenum_width, (int)labs(bline->line_index - self->active_cursor->mark->bline->line_index));
+        rect_put_num(self->rect_lines, 0, rect_y, self->rel_linenum_width, (unsigned long long)labs(bline->line_index - self->active_cursor->mark->bline->line_index), linenum_fg, LINENUM_BG);
       }
 
-      rect_printf(self->rect_margin_left, 0, rect_y, 0, 0, "%c", viewport_x > 0 && bline->char_count > 0 ? '^' : ' ');
+      rect_fill(self->rect_margin_left, 0, rect_y, 1, viewport_x > 0 && bline->char_count > 0 ? '^' : ' ', 0, 0);
+
+      for (row = 1; row < nrows; row++) {
+        rect_fill(self->rect_lines, 0, rect_y + row, self->linenum_width, '.', 0, 0);
+        rect_fill(self->rect_margin_left, 0, rect_y + row, 1, ' ', 0, 0);
+      }
     }
 
     if (!is_soft_wrap && bline->char_vwidth - viewport_x_vcol > self->rect_buffer.w) {
-      rect_printf(self->rect_margin_right, 0, rect_y, 0, 0, "%c", '$');
+      rect_fill(self->rect_margin_right, 0, rect_y, 1, '$', 0, 0);
     }
   }
 
-  // Render 0 thru rect_buffer.w cell by cell
-  orig_rect_y = rect_y;
+  // Render visible chars a style run at a time, reading runs off the line's
+  // style spans. Colors are resolved once per run and cells are written
+  // straight into termbox's back buffer. When wrapping, a char at vcol sits
+  // at row vcol / w, column vcol % w (see wrap_rows_for_bline).
+  if (viewport_x >= bline->char_count || bline_update_spans(bline) != MLBUF_OK) {
+    return nrows;
+  }
+
+  cells = tb_cell_buffer();
+  cells_w = tb_width();
+  cells_h = tb_height();
   rect_x = 0;
-  char_col = viewport_x;
+  row = 0;
+  is_done = 0;
+  nmatches = isearch_get_line_matches(self, bline, match_cols, EON_ISEARCH_LINE_MATCHES);
+  imatch = 0;
+  ispan = bline_span_at(bline, viewport_x);
+
+  for (char_col = viewport_x; char_col < bline->char_count && !is_done; char_col = run_end) {
+    run_end = _bview_get_style_run_end(self, bline, char_col, &ispan);
+    fg = bline->span_styles[ispan].fg;
+    bg = bline->bg > 0 ? bline->bg : bline->span_styles[ispan].bg;
+
+    // Split runs at isearch match bounds and highlight matches
+    while (imatch < nmatches && match_cols[imatch * 2 + 1] <= char_col) imatch++;
+
+    if (imatch < nmatches && char_col >= match_cols[imatch * 2]) {
+      run_end = EON_MIN(run_end, match_cols[imatch * 2 + 1]);
+      fg = ISEARCH_FG;
+      bg = ISEARCH_BG;
+
+    } else if (imatch < nmatches) {
+      run_end = EON_MIN(run_end, match_cols[imatch * 2]);
+    }
 
-  while (1) {
-    char_w = 1;
+    if (self->editor->color_col == char_col && EON_BVIEW_IS_EDIT(self)) {
+      bg |= CURSOR_BG;
+    }
 
-    if (char_col < bline->char_count) {
+    if (EON_BVIEW_IS_MENU(self) && is_cursor_line) {
+      bg |= MENU_CURSOR_LINE_BG;
+
+    } else if (EON_BVIEW_IS_PROMPT(self)) {
+      bg = PROMPT_BG;
+    }
+
+    for (; char_col < run_end; char_col++) {
       ch = bline->chars[char_col].ch;
-      fg = bline->chars[char_col].style.fg;
-      bg = bline->bg > 0 ? bline->bg : bline->chars[char_col].style.bg;
       char_w = char_col == bline->char_count - 1
                ? bline->char_vwidth - bline->chars[char_col].vcol
                : bline->chars[char_col + 1].vcol - bline->chars[char_col].vcol;
 
+      if (is_soft_wrap) {
+        vcol = bline->chars[char_col].vcol;
+        row = (int)(vcol / self->rect_buffer.w) - skip_rows;
+        rect_x = (int)(vcol % self->rect_buffer.w);
+
+        if (row < 0) {
+          continue;
+
+        } else if (row >= nrows) {
+          // Wrapped past the bottom edge
+          is_done = 1;
+          break;
+        }
+
+      } else if (rect_x >= self->rect_buffer.w) {
+        // Past the right edge; rest of a long line is never visible
+        is_done = 1;
+        break;
+      }
+
       if (ch == '\t') {
         ch = ' ';
 
@@ -1170,48 +1645,46 @@ static void _bview_draw_bline(bview_t* self, bline_t* bline, int rect_y, bline_t
         ch = '?';
       }
 
-      if (self->editor->color_col == char_col && EON_BVIEW_IS_EDIT(self)) {
-        bg |= CURSOR_BG;
-      }
+      cell_x = self->rect_buffer.x + rect_x;
+      cell_y = self->rect_buffer.y + rect_y + row;
 
-    } else {
-      break;
-    }
-
-    if (EON_BVIEW_IS_MENU(self) && is_cursor_line) {
-      bg |= MENU_CURSOR_LINE_BG;
+      if (cell_y >= 0 && cell_y < cells_h) {
+        for (i = 0; i < char_w && rect_x + i < self->rect_buffer.w && cell_x + i < cells_w; i++) {
+          cells[cell_y * cells_w + cell_x + i] = (struct tb_cell) { ch, fg, bg };
+        }
+      }
 
-    } else if (EON_BVIEW_IS_PROMPT(self)) {
-      bg = PROMPT_BG;
+      if (!is_soft_wrap) rect_x += char_w;
     }
+  }
 
-    for (i = 0; i < char_w && rect_x < self->rect_buffer.w; i++) {
-      tb_char(self->rect_buffer.x + rect_x + i, self->rect_buffer.y + rect_y, fg, bg, ch);
-    }
+  return nrows;
+}
 
-    if (is_soft_wrap && rect_x + 1 >= self->rect_buffer.w && rect_y + 1 < self->rect_buffer.h) {
-      rect_x = 0;
-      rect_y += 1;
+// Return the column after the run of chars starting at char_col that share
+// its style, moving *ispan up to the style span holding char_col. The color
+// column always gets a run of its own.
+static bint_t _bview_get_style_run_end(bview_t* self, bline_t* bline, bint_t char_col, bint_t* ispan) {
+  bint_t color_col;
+  bint_t end;
 
-      if (self->editor->linenum_type != EON_LINENUM_TYPE_NONE) {
-        for (i = 0; i < self->linenum_width; i++) {
-          rect_printf(self->rect_lines, i, rect_y, 0, 0, "%c", '.');
-        }
-      }
+  while (bline->span_ends[*ispan] <= char_col) {
+    *ispan += 1;
+  }
 
-    } else {
-      rect_x += char_w;
-    }
+  color_col = EON_BVIEW_IS_EDIT(self) ? self->editor->color_col : -1;
 
-    char_col += 1;
+  if (color_col == char_col) {
+    return char_col + 1;
   }
 
-  for (i = orig_rect_y; i < rect_y && bline->next; i++) {
-    bline = bline->next;
+  end = bline->span_ends[*ispan];
+
+  if (color_col > char_col && color_col < end) {
+    end = color_col;
   }
 
-  if (optret_bline) *optret_bline = bline;
-  if (optret_rect_y) *optret_rect_y = rect_y;
+  return end;
 }
 
 // Highlight matching bracket pair under mark
@@ -1252,21 +1725,57 @@ static void _bview_highlight_bracket_pair(bview_t* self, mark_t* mark) {
   tb_char(screen_x, screen_y, cell->fg, cell->bg | BRACKET_HIGHLIGHT, cell->ch); // TODO configurable
 }
 
+// Remove the syntax rules of self from its buffer, for every bview sharing
+// the buffer
+static void _bview_remove_syntax(bview_t* self) {
+  srule_node_t* srule_node;
+  bview_t* bview;
+
+  if (!self->syntax) {
+    return;
+  }
+
+  DL_FOREACH(self->syntax->srules, srule_node) {
+    buffer_remove_srule(self->buffer, srule_node->srule, 0, 100);
+  }
+
+  CDL_FOREACH2(self->editor->all_bviews, bview, all_next) {
+    if (bview->buffer == self->buffer) bview->syntax = NULL;
+  }
+
+  self->syntax = NULL;
+}
+
+// Return another bview showing the buffer of self, or NULL
+static bview_t* _bview_get_sharer(bview_t* self) {
+  bview_t* bview;
+
+  if (!self->buffer || self->buffer->ref_count < 2) {
+    return NULL;
+  }
+
+  CDL_FOREACH2(self->editor->all_bviews, bview, all_next) {
+    if (bview != self && bview->buffer == self->buffer) return bview;
+  }
+
+  return NULL;
+}
+
 // Find screen coordinates for a mark
 int bview_get_screen_coords(bview_t* self, mark_t* mark, int* ret_x, int* ret_y, struct tb_cell** optret_cell) {
   int screen_x;
   int screen_y;
-  int is_soft_wrapped;
+  bint_t vcol;
 
   MLBUF_BLINE_ENSURE_CHARS(mark->bline);
 
-  is_soft_wrapped = self->editor->soft_wrap
-                    && self->active_cursor->mark->bline == mark->bline
-                    && EON_BVIEW_IS_EDIT(self) ? 1 : 0;
-
-  if (is_soft_wrapped) {
-    screen_x = self->rect_buffer.x + EON_MARK_COL_TO_VCOL(mark) % self->rect_buffer.w;
-    screen_y = self->rect_buffer.y + (mark->bline->line_index - self->viewport_bline->line_index) + (EON_MARK_COL_TO_VCOL(mark) / self->rect_buffer.w);
+  if (wrap_is_enabled(self)) {
+    // Same layout as _bview_draw_bline
+    vcol = EON_MARK_COL_TO_VCOL(mark);
+    screen_x = self->rect_buffer.x + vcol % self->rect_buffer.w;
+    screen_y = self->rect_buffer.y
+               + (wrap_row_of_line(self, mark->bline->line_index) + vcol / self->rect_buffer.w)
+               - (wrap_row_of_line(self, self->viewport_bline->line_index) + self->viewport_y_row);
 
   } else {
     screen_x = self->rect_buffer.x + EON_MARK_COL_TO_VCOL(mark) - EON_COL_TO_VCOL(mark->bline, self->viewport_x, mark->bline->char_vwidth);
@@ -1289,3 +1798,64 @@ int bview_get_screen_coords(bview_t* self, mark_t* mark, int* ret_x, int* ret_y,
 
   return EON_OK;
 }
+
+// Set the low and high ends of a cursor; both are the mark if unanchored
+static void _bview_cursor_get_lo_hi(cursor_t* cursor, mark_t** ret_lo, mark_t** ret_hi) {
+  if (cursor_get_lo_hi(cursor, ret_lo, ret_hi) != EON_OK) {
+    *ret_lo = cursor->mark;
+    *ret_hi = cursor->mark;
+  }
+}
+
+// Order cursors by their low end
+static int _bview_cursor_cmp(cursor_t* a, cursor_t* b) {
+  mark_t* a_lo;
+  mark_t* b_lo;
+  mark_t* hi;
+
+  _bview_cursor_get_lo_hi(a, &a_lo, &hi);
+  _bview_cursor_get_lo_hi(b, &b_lo, &hi);
+
+  if (a_lo->bline->line_index != b_lo->bline->line_index) {
+    return a_lo->bline->line_index < b_lo->bline->line_index ? -1 : 1;
+  }
+
+  return a_lo->col < b_lo->col ? -1 : (a_lo->col > b_lo->col ? 1 : 0);
+}
+
+// Return 1 if cursor b (ordered after a) should merge into a
+static int _bview_cursors_overlap(cursor_t* a, cursor_t* b) {
+  mark_t* a_lo;
+  mark_t* a_hi;
+  mark_t* b_lo;
+  mark_t* b_hi;
+
+  if (a->is_asleep != b->is_asleep || a->is_anchored != b->is_anchored) {
+    return 0;
+  }
+
+  _bview_cursor_get_lo_hi(a, &a_lo, &a_hi);
+  _bview_cursor_get_lo_hi(b, &b_lo, &b_hi);
+
+  if (!a->is_anchored) {
+    return mark_is_eq(a_lo, b_lo);
+  }
+
+  return mark_is_eq(a_lo, b_lo) || mark_is_lt(b_lo, a_hi);
+}
+
+// Grow keep's selection to cover drop's
+static void _bview_cursor_absorb(cursor_t* keep, cursor_t* drop) {
+  mark_t* keep_lo;
+  mark_t* keep_hi;
+  mark_t* drop_lo;
+  mark_t* drop_hi;
+
+  if (!keep->is_anchored) return;
+
+  _bview_cursor_get_lo_hi(keep, &keep_lo, &keep_hi);
+  _bview_cursor_get_lo_hi(drop, &drop_lo, &drop_hi);
+
+  if (mark_is_lt(drop_lo, keep_lo)) mark_join(keep_lo, drop_lo);
+  if (mark_is_gt(drop_hi, keep_hi)) mark_join(keep_hi, drop_hi);
+}
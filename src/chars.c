@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+#include "utlist.h"
+#include "eon.h"
+#include "mlbuf.h"
+
+// chars_hot_t
+typedef struct chars_hot_s {
+    bint_t start;
+    bint_t end;
+} chars_hot_t;
+
+static int _chars_sweep(editor_t* editor);
+static int _chars_get_hot(editor_t* editor, buffer_t* buffer, chars_hot_t* hot, int hot_cap);
+static int _chars_bucket(bline_t* bline, chars_hot_t* hot, int nhot);
+static int _chars_is_evictable(bline_t* bline);
+static int _chars_is_first_bview(editor_t* editor, bview_t* bview);
+
+// Sweep decoded chars arrays if it's time. Called while waiting for input.
+int chars_idle(editor_t* editor) {
+  uint64_t now;
+
+  if (editor->chars_max_bytes < 1) {
+    return EON_OK;
+  }
+
+  now = trace_now();
+
+  if (now < editor->chars_next_sweep_ns) {
+    // Too soon; see chars_idle_timeout
+    editor->is_chars_sweep_due = 1;
+    return EON_OK;
+  }
+
+  editor->chars_next_sweep_ns = now + (uint64_t)EON_CHARS_SWEEP_MS * 1000000ULL;
+  editor->is_chars_sweep_due = 0;
+  return _chars_sweep(editor);
+}
+
+// Return ms until a sweep put off by chars_idle can run, or -1 if none is
+// due. The editor loop stops waiting for input by then.
+int chars_idle_timeout(editor_t* editor) {
+  uint64_t now;
+
+  if (!editor->is_chars_sweep_due) {
+    return -1;
+  }
+
+  now = trace_now();
+
+  if (now >= editor->chars_next_sweep_ns) {
+    return 0;
+  }
+
+  return (int)((editor->chars_next_sweep_ns - now) / 1000000ULL) + 1;
+}
+
+// Rebuild the chars of an evicted line and restyle it before it is drawn
+int chars_restore(editor_t* editor, bline_t* bline) {
+  MLBUF_BLINE_ENSURE_CHARS(bline);
+  bline->is_chars_evicted = 0;
+  buffer_apply_styles(bline->buffer, bline, 0);
+  editor->chars_rebuilds += 1;
+  return EON_OK;
+}
+
+// Drop the chars arrays and style spans of lines far from any viewport or
+// cursor until resident chars are under 3/4 of the cap. Lines are bucketed by
+// log2 of their distance to the nearest hot range, so the farthest go first
+// without sorting.
+static int _chars_sweep(editor_t* editor) {
+  bview_t* bview;
+  bline_t* bline;
+  chars_hot_t hot[EON_CHARS_HOT_MAX];
+  size_t buckets[EON_CHARS_BUCKETS];
+  size_t total;
+  size_t target;
+  size_t evict;
+  int nhot;
+  int min_bucket;
+  int pass;
+  int b;
+
+  memset(buckets, 0, sizeof(buckets));
+  total = 0;
+  min_bucket = EON_CHARS_BUCKETS;
+
+  // Pass 0 counts resident bytes per bucket, pass 1 evicts
+  for (pass = 0; pass < 2; pass++) {
+    CDL_FOREACH2(editor->all_bviews, bview, all_next) {
+      if (!EON_BVIEW_IS_EDIT(bview) || !_chars_is_first_bview(editor, bview)) {
+        continue;
+      }
+
+      nhot = _chars_get_hot(editor, bview->buffer, hot, EON_CHARS_HOT_MAX);
+
+      for (bline = bview->buffer->first_line; bline; bline = bline->next) {
+        if (!_chars_is_evictable(bline)) continue;
+
+        b = _chars_bucket(bline, hot, nhot);
+
+        if (pass == 0) {
+          buckets[b] += sizeof(bline_char_t) * (size_t)bline->chars_cap;
+          total += sizeof(bline_char_t) * (size_t)bline->chars_cap;
+
+        } else if (b >= min_bucket) {
+          free(bline->chars);
+          bline->chars = NULL;
+          bline->chars_cap = 0;
+          bline_free_spans(bline);
+          bline->is_chars_dirty = 1;
+          bline->is_chars_evicted = 1;
+          editor->chars_evictions += 1;
+        }
+      }
+    }
+
+    if (pass == 0) {
+      if (total <= editor->chars_max_bytes) {
+        break;
+      }
+
+      // Find the nearest bucket we must evict down to; bucket 0 is hot
+      target = (editor->chars_max_bytes / 4) * 3;
+      evict = 0;
+
+      for (b = EON_CHARS_BUCKETS - 1; b > 0 && total - evict > target; b--) {
+        evict += buckets[b];
+        min_bucket = b;
+      }
+
+      if (min_bucket >= EON_CHARS_BUCKETS) {
+        break;
+      }
+    }
+  }
+
+  return EON_OK;
+}
+
+// Collect line ranges to keep decoded: each viewport showing buffer and each
+// active cursor, padded by EON_CHARS_KEEP_LINES. Return number of ranges.
+static int _chars_get_hot(editor_t* editor, buffer_t* buffer, chars_hot_t* hot, int hot_cap) {
+  bview_t* bview;
+  bint_t line;
+  int nhot;
+
+  nhot = 0;
+
+  CDL_FOREACH2(editor->all_bviews, bview, all_next) {
+    if (bview->buffer != buffer || nhot + 2 > hot_cap) {
+      continue;
+    }
+
+    hot[nhot].start = bview->viewport_y - EON_CHARS_KEEP_LINES;
+    hot[nhot].end = bview->viewport_y + bview->rect_buffer.h + EON_CHARS_KEEP_LINES;
+    nhot += 1;
+
+    if (bview->active_cursor) {
+      line = bview->active_cursor->mark->bline->line_index;
+      hot[nhot].start = line - EON_CHARS_KEEP_LINES;
+      hot[nhot].end = line + EON_CHARS_KEEP_LINES;
+      nhot += 1;
+    }
+  }
+
+  return nhot;
+}
+
+// Return 0 if bline is in a hot range, else 1 + log2 of its distance to the
+// nearest one
+static int _chars_bucket(bline_t* bline, chars_hot_t* hot, int nhot) {
+  bint_t dist;
+  bint_t d;
+  int b;
+  int i;
+
+  dist = -1;
+
+  for (i = 0; i < nhot; i++) {
+    if (bline->line_index < hot[i].start) {
+      d = hot[i].start - bline->line_index;
+    } else if (bline->line_index > hot[i].end) {
+      d = bline->line_index - hot[i].end;
+    } else {
+      return 0;
+    }
+
+    if (dist < 0 || d < dist) dist = d;
+  }
+
+  if (dist < 0) {
+    // No bview showing this buffer; nothing is hot
+    dist = bline->line_index + 1;
+  }
+
+  for (b = 1; dist > 1 && b < EON_CHARS_BUCKETS - 1; dist >>= 1) b++;
+
+  return b;
+}
+
+// Return 1 if bline owns a decoded chars array we can free, else 0. Slabbed
+// chars belong to one allocation for the whole buffer.
+static int _chars_is_evictable(bline_t* bline) {
+  return bline->chars
+    && !bline->is_chars_dirty
+    && !bline->is_slabbed
+    && bline->chars_cap > 0 ? 1 : 0;
+}
+
+// Return 1 if bview is the first bview in all_bviews on its buffer, so shared
+// buffers are swept once
+static int _chars_is_first_bview(editor_t* editor, bview_t* bview) {
+  bview_t* other;
+
+  CDL_FOREACH2(editor->all_bviews, other, all_next) {
+    if (other == bview) return 1;
+    if (EON_BVIEW_IS_EDIT(other) && other->buffer == bview->buffer) return 0;
+  }
+
+  return 1;
+}
@@ -3,6 +3,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "eon.h"
 
 #define EON_MULTI_CURSOR_MARK_FN(pcursor, pfn, ...) do {\
@@ -21,10 +24,29 @@
   } \
 } while(0)
 
+// A snapshot save of a buffer, see _cmd_save_write
+typedef struct {
+  buffer_t* buffer;
+  char* target;
+  char* dir;
+  char* tmp_path;
+  struct iovec* iov;
+} cmd_save_job_t;
+
 static void _cmd_force_redraw(cmd_context_t* ctx);
+static void _cmd_apply_styles(editor_t* editor, buffer_t* buffer, bline_t* start, bint_t n);
 static int _cmd_pre_close(editor_t* editor, bview_t* bview);
 static int _cmd_quit_inner(editor_t* editor, bview_t* bview);
-static int _cmd_save(editor_t* editor, bview_t* bview, int save_as);
+static int _cmd_save(editor_t* editor, bview_t* bview, int save_as, int allow_async);
+static int _cmd_save_sync(editor_t* editor, bview_t* bview, char* path);
+static int _cmd_save_async(editor_t* editor, bview_t* bview, char* path);
+static void _cmd_save_done(editor_t* editor, bview_t* bview, char* path, bint_t nbytes, int is_dirty, off_t journal_mark);
+static cmd_save_job_t* _cmd_save_job_new(buffer_t* buffer, char* path);
+static void _cmd_save_job_free(cmd_save_job_t* job);
+static int _cmd_save_write(cmd_save_job_t* job, int progress_fd, bint_t* ret_nbytes);
+static int _cmd_save_writev_all(int fd, struct iovec* iov, int iovcnt, bint_t* nbytes);
+static int _cmd_save_child(void* udata, int wfd);
+static void _cmd_aproc_save_cb(async_proc_t* aproc, char* buf, size_t buf_len);
 static int _cmd_search_next(bview_t* bview, cursor_t* cursor, mark_t* search_mark, char* regex, int regex_len);
 static void _cmd_aproc_bview_passthru_cb(async_proc_t* self, char* buf, size_t buf_len);
 static void _cmd_isearch_prompt_cb(bview_t* bview, baction_t* action, void* udata);
@@ -171,9 +193,14 @@ int cmd_mouse_move(cmd_context_t* ctx, int mouse_down, int mx, int my) {
   int offsetx = mx;
   int offsety = ctx->bview->viewport_y + my - 1;
 
+  if (wrap_is_enabled(ctx->bview)) {
+    offsety = (int)wrap_line_at_row(ctx->bview, wrap_row_of_line(ctx->bview, ctx->bview->viewport_y) + ctx->bview->viewport_y_row + my - 1, NULL);
+  }
+
   // hack! count the number of tabs (n) before X pos and reduce the X pos by n * tab_with
   bline_t* bline;
   buffer_get_bline(ctx->bview->buffer, offsety, &bline);
+  MLBUF_BLINE_ENSURE_CHARS(bline);
 
   int i = 0, tabs_before = 0;
   while (i < bline->char_count && i < offsetx) {
@@ -606,7 +633,7 @@ int cmd_drop_cursor_column(cmd_context_t* ctx) {
         continue;
       }
 
-      if (bline != cursor->mark->bline || col != cursor->mark->col) {
+      if ((bline != cursor->mark->bline || col != cursor->mark->col) && !bview_find_cursor(ctx->bview, bline, col)) {
         bview_add_cursor(ctx->bview, bline, col, NULL);
       }
     }
@@ -623,7 +650,7 @@ int cmd_search(cmd_context_t* ctx) {
 
   char * prompt;
   char * default_str = "Regex";
-  res = asprintf(&prompt, "search: [%s]", ctx->bview->last_search ? ctx->bview->last_search : default_str);
+  prompt = arena_sprintf(ctx->editor->scratch, "search: [%s]", ctx->bview->last_search ? ctx->bview->last_search : default_str);
 
   editor_prompt(ctx->editor, prompt, NULL, &regex);
 
@@ -710,22 +737,44 @@ int cmd_find_word(cmd_context_t* ctx) {
 
   if (cursor_select_by(cursor, "word") == EON_OK) {
   mark_get_between_mark(cursor->mark, cursor->anchor, &word, &word_len);
-    re_len = asprintf(&re, "\\b%s\\b", word);
+    re = arena_sprintf(ctx->editor->scratch, "\\b%s\\b", word);
+    re_len = strlen(re);
     free(word);
     cursor_toggle_anchor(cursor, 0);
 
-    if (mark_move_next_re(cursor->mark, re, re_len) == MLBUF_ERR) {
-      mark_move_beginning(cursor->mark);
-      mark_move_next_re(cursor->mark, re, re_len);
-    }
-
-    free(re);
+    search_next(ctx->editor, cursor->mark, re, re_len, 1);
   }
   );
   bview_rectify_viewport(ctx->bview);
   return EON_OK;
 }
 
+// Find all matches of a regex and list them in a menu
+int cmd_find_all(cmd_context_t* ctx) {
+  char* regex;
+  editor_prompt(ctx->editor, "find all: Regex?", NULL, &regex);
+
+  if (!regex) return EON_OK;
+
+  findall_run(ctx->editor, ctx->bview, regex, strlen(regex));
+  free(regex);
+  return EON_OK;
+}
+
+// Move to next find-all match
+int cmd_find_all_next(cmd_context_t* ctx) {
+  findall_move(ctx->editor, ctx->cursor->mark, 1);
+  bview_rectify_viewport(ctx->bview);
+  return EON_OK;
+}
+
+// Move to previous find-all match
+int cmd_find_all_prev(cmd_context_t* ctx) {
+  findall_move(ctx->editor, ctx->cursor->mark, -1);
+  bview_rectify_viewport(ctx->bview);
+  return EON_OK;
+}
+
 // Incremental search
 int cmd_isearch(cmd_context_t* ctx) {
   editor_prompt(ctx->editor, "isearch: Regex?", &(editor_prompt_params_t) {
@@ -733,12 +782,7 @@ int cmd_isearch(cmd_context_t* ctx) {
     .prompt_cb = _cmd_isearch_prompt_cb
   }, NULL);
 
-  if (ctx->bview->isearch_rule) {
-    buffer_remove_srule(ctx->bview->buffer, ctx->bview->isearch_rule, 1, 100);
-    srule_destroy(ctx->bview->isearch_rule);
-    ctx->bview->isearch_rule = NULL;
-  }
-
+  isearch_end(ctx->bview);
   return EON_OK;
 }
 
@@ -746,6 +790,8 @@ int cmd_isearch(cmd_context_t* ctx) {
 int cmd_cut(cmd_context_t* ctx) {
   int append;
   append = ctx->loop_ctx->last_cmd && ctx->loop_ctx->last_cmd->func == cmd_cut ? 1 : 0;
+  if (!append) kill_begin_batch(ctx->editor);
+
   EON_MULTI_CURSOR_CODE(ctx->cursor,
     cursor_cut_copy(cursor, 1, 1, append);
   );
@@ -757,6 +803,7 @@ int cmd_copy(cmd_context_t* ctx) {
   if (!ctx->cursor->is_anchored)
     return EON_OK;
 
+  kill_begin_batch(ctx->editor);
   EON_MULTI_CURSOR_CODE(ctx->cursor,
     cursor_cut_copy(cursor, 0, 1, 0);
   );
@@ -775,8 +822,27 @@ int cmd_uncut(cmd_context_t* ctx) {
   return EON_OK;
 }
 
+// Replace the text just pasted with the next older clip in the kill ring
+int cmd_uncut_prev(cmd_context_t* ctx) {
+  cmd_t* last_cmd;
+  last_cmd = ctx->loop_ctx->last_cmd;
+
+  if (!last_cmd || (last_cmd->func != cmd_uncut && last_cmd->func != cmd_uncut_prev)) {
+    EON_RETURN_ERR(ctx->editor, "%s", "uncut_prev: Paste first");
+  }
+
+  ctx->editor->kill_ring_pos += 1;
+  if (!kill_ring_get(ctx->editor, ctx->editor->kill_ring_pos)) ctx->editor->kill_ring_pos = 0;
+
+  EON_MULTI_CURSOR_CODE(ctx->cursor,
+    cursor_uncut_replace(cursor, ctx->editor->kill_ring_pos);
+  );
+  return EON_OK;
+}
+
 // Copy in between chars
 int cmd_copy_by(cmd_context_t* ctx) {
+  kill_begin_batch(ctx->editor);
   EON_MULTI_CURSOR_CODE(ctx->cursor,
     if (cursor_select_by(cursor, ctx->static_param) == EON_OK) {
       cursor_cut_copy(cursor, 0, 0, 0);
@@ -787,6 +853,7 @@ int cmd_copy_by(cmd_context_t* ctx) {
 
 // Cut in between chars
 int cmd_cut_by(cmd_context_t* ctx) {
+  kill_begin_batch(ctx->editor);
   EON_MULTI_CURSOR_CODE(ctx->cursor,
     if (cursor_select_by(cursor, ctx->static_param) == EON_OK) {
       cursor_cut_copy(cursor, 1, 0, 0);
@@ -946,13 +1013,13 @@ int cmd_browse(cmd_context_t* ctx) {
 
 // Save-as file
 int cmd_save_as(cmd_context_t* ctx) {
-  _cmd_save(ctx->editor, ctx->bview, 1);
+  _cmd_save(ctx->editor, ctx->bview, 1, 1);
   return EON_OK;
 }
 
 // Save file
 int cmd_save(cmd_context_t* ctx) {
-  _cmd_save(ctx->editor, ctx->bview, 0);
+  _cmd_save(ctx->editor, ctx->bview, 0, 1);
   return EON_OK;
 }
 
@@ -1138,24 +1205,9 @@ int cmd_move_until_back(cmd_context_t* ctx) {
 
 // Undo
 int cmd_undo(cmd_context_t* ctx) {
-
-  // TODO: fix this duplication from mlbuf.c
   baction_t* action_to_undo;
 
-  if (ctx->buffer->action_undone) {
-    if (ctx->buffer->action_undone == ctx->buffer->actions) {
-      return MLBUF_ERR;
-
-    } else if (!ctx->buffer->action_undone->prev) {
-      return MLBUF_ERR;
-    }
-
-    action_to_undo = ctx->buffer->action_undone->prev;
-
-  } else if (ctx->buffer->action_tail) {
-    action_to_undo = ctx->buffer->action_tail;
-
-  } else {
+  if (!(action_to_undo = undo_peek(ctx->buffer, 0))) {
     return MLBUF_ERR;
   }
 
@@ -1167,23 +1219,19 @@ int cmd_undo(cmd_context_t* ctx) {
   }
 
   EON_MULTI_CURSOR_CODE(ctx->cursor,
-    buffer_undo(ctx->bview->buffer);
+    undo_undo(ctx->editor, ctx->bview->buffer);
   );
   return EON_OK;
 }
 
 // Redo
 int cmd_redo(cmd_context_t* ctx) {
-
-  // TODO: fix this duplication from mlbuf.c
   baction_t* action_to_redo;
 
-  if (!ctx->buffer->action_undone) {
+  if (!(action_to_redo = undo_peek(ctx->buffer, 1))) {
     return MLBUF_ERR;
   }
 
-  action_to_redo = ctx->buffer->action_undone;
-
   if (bview_get_active_cursor_count(ctx->bview) > 1) {
     bview_move_to_line(ctx->bview, action_to_redo->start_line_index);
 
@@ -1192,7 +1240,7 @@ int cmd_redo(cmd_context_t* ctx) {
   }
 
   EON_MULTI_CURSOR_CODE(ctx->cursor,
-    buffer_redo(ctx->bview->buffer);
+    undo_redo(ctx->editor, ctx->bview->buffer);
   );
   return EON_OK;
 }
@@ -1215,9 +1263,8 @@ int cmd_set_opt(cmd_context_t* ctx) {
 
   if (!ctx->static_param) return EON_ERR;
 
-  int res = asprintf(&prompt, "[set option] %s: ", ctx->static_param);
+  prompt = arena_sprintf(ctx->editor->scratch, "[set option] %s: ", ctx->static_param);
   editor_prompt(ctx->editor, prompt, NULL, &val);
-  free(prompt);
 
   if (!val) return EON_OK;
 
@@ -1232,7 +1279,7 @@ int cmd_set_opt(cmd_context_t* ctx) {
 
   } else if (strcmp(ctx->static_param, "syntax") == 0) {
     bview_set_syntax(ctx->bview, val);
-    buffer_apply_styles(ctx->bview->buffer, ctx->bview->buffer->first_line, ctx->bview->buffer->line_count);
+    _cmd_apply_styles(ctx->editor, ctx->bview->buffer, ctx->bview->buffer->first_line, ctx->bview->buffer->line_count);
 
   } else if (strcmp(ctx->static_param, "soft_wrap") == 0) {
     ctx->editor->soft_wrap = vali ? 1 : 0;
@@ -1309,6 +1356,75 @@ int cmd_toggle_mouse_mode(cmd_context_t* ctx) {
   return EON_OK;
 }
 
+// Toggle the command timing overlay (and span recording with it)
+int cmd_toggle_trace(cmd_context_t* ctx) {
+  ctx->editor->is_trace_overlay = !ctx->editor->is_trace_overlay;
+  trace_set_enabled(ctx->editor, ctx->editor->is_trace_overlay || ctx->editor->trace_path);
+  return EON_OK;
+}
+
+// Toggle following the file of the buffer as it grows, like tail -f. The
+// view stays on the last line unless the cursor or viewport leaves it.
+int cmd_toggle_follow(cmd_context_t* ctx) {
+  bview_t* bview;
+  bview = ctx->bview;
+
+  if (bview->is_following) {
+    bview->is_following = 0;
+    EON_SET_INFO(ctx->editor, "Stopped following %s", bview->buffer->path);
+    return EON_OK;
+  }
+
+  if (!bview->buffer->path || watch_follow(ctx->editor, bview->buffer) != EON_OK) {
+    EON_RETURN_ERR(ctx->editor, "Cannot follow this buffer; it needs a file on disk and -r 1%s", "");
+  }
+
+  bview->is_following = 1;
+  mark_move_end(bview->active_cursor->mark);
+  bview_max_viewport_y(bview);
+  EON_SET_INFO(ctx->editor, "Following %s", bview->buffer->path);
+  return EON_OK;
+}
+
+// Write recorded spans to a Chrome trace-event JSON file
+int cmd_dump_trace(cmd_context_t* ctx) {
+  char* path;
+
+  if (!ctx->editor->trace_enabled) {
+    EON_RETURN_ERR(ctx->editor, "Tracing is off; enable it with cmd_toggle_trace or -T%s", "");
+  }
+
+  path = NULL;
+
+  if (ctx->static_param) {
+    path = strdup(ctx->static_param);
+
+  } else {
+    editor_prompt(ctx->editor, "dump_trace: Path?", &(editor_prompt_params_t) {
+      .data = EON_TRACE_DEFAULT_PATH,
+      .data_len = strlen(EON_TRACE_DEFAULT_PATH)
+    }, &path);
+  }
+
+  if (!path) return EON_OK;
+
+  if (trace_dump(ctx->editor, path) == EON_OK) {
+    EON_SET_INFO(ctx->editor, "Wrote trace to %s", path);
+  }
+
+  free(path);
+  return EON_OK;
+}
+
+// Apply styles inside a trace span
+static void _cmd_apply_styles(editor_t* editor, buffer_t* buffer, bline_t* start, bint_t n) {
+  uint64_t trace_start;
+
+  trace_start = trace_begin(editor);
+  buffer_apply_styles(buffer, start, n);
+  trace_end(editor, "style", "buffer_apply_styles", trace_start);
+}
+
 // Force a redraw of the screen
 static void _cmd_force_redraw(cmd_context_t* ctx) {
   int w;
@@ -1330,7 +1446,8 @@ static void _cmd_force_redraw(cmd_context_t* ctx) {
     }
   }
 
-  tb_render();
+  term_invalidate(ctx->editor);
+  term_render(ctx->editor);
 }
 
 // Indent or outdent line(s)
@@ -1368,7 +1485,7 @@ static int _cmd_indent(cmd_context_t* ctx, int outdent) {
     }
 
     ctx->buffer->is_style_disabled--;
-    buffer_apply_styles(ctx->buffer, start, 0);
+    _cmd_apply_styles(ctx->editor, ctx->buffer, start, 0);
   );
   return EON_OK;
 }
@@ -1678,20 +1795,22 @@ static int _cmd_pre_close(editor_t* editor, bview_t* bview) {
     return EON_OK;
   }
 
-  return _cmd_save(editor, bview, 1);
+  // The bview is about to go away, so save in the foreground
+  return _cmd_save(editor, bview, 1, 0);
 }
 
-// Prompt to save changes. Return EON_OK if file was saved or EON_ERR if the action
-// was cancelled.
-static int _cmd_save(editor_t* editor, bview_t* bview, int save_as) {
+// Prompt to save changes. Return EON_OK if file was saved (or a background
+// save was started) or EON_ERR if the action was cancelled. Large buffers are
+// saved in the background if allow_async is set.
+static int _cmd_save(editor_t* editor, bview_t* bview, int save_as, int allow_async) {
   int rc;
   char* path;
   char* yn;
-  int fname_changed;
   struct stat st;
-  bint_t nbytes;
 
-  fname_changed = 0;
+  if (bview->save_proc) {
+    EON_RETURN_ERR(editor, "Save: %s", "already in progress");
+  }
 
   do {
     if (!bview->buffer->path || save_as) {
@@ -1708,9 +1827,6 @@ static int _cmd_save(editor_t* editor, bview_t* bview, int save_as) {
       path = strdup(bview->buffer->path);
     }
 
-    // Remember if fname is changing for refreshing syntax later
-    fname_changed = !bview->buffer->path || strcmp(bview->buffer->path, path) != 0 ? 1 : 0;
-
     // Check clobber warning
     if (stat(path, &st) == 0
         && st.st_dev == bview->buffer->st.st_dev
@@ -1727,25 +1843,315 @@ static int _cmd_save(editor_t* editor, bview_t* bview, int save_as) {
       }
     }
 
+    // Hand large buffers to a background writer; fall back to saving here
+    if (allow_async
+        && bview->buffer->byte_count >= EON_ASYNC_SAVE_MIN_BYTES
+        && _cmd_save_async(editor, bview, path) == EON_OK
+       ) {
+      free(path);
+      return EON_OK;
+    }
+
     // Save, check error
-    rc = buffer_save_as(bview->buffer, path, &nbytes);
+    rc = _cmd_save_sync(editor, bview, path);
     free(path);
 
-    if (rc == MLBUF_ERR) {
-      EON_SET_ERR(editor, "Save: %s", errno ? strerror(errno) : "failed");
+  } while (rc == EON_ERR && (!bview->buffer->path || save_as));
 
-    } else {
-      EON_SET_INFO(editor, "Done. Wrote %ld bytes", (long int)nbytes);
-    }
+  return rc;
+}
+
+// Save buffer to path now
+static int _cmd_save_sync(editor_t* editor, bview_t* bview, char* path) {
+  cmd_save_job_t* job;
+  bint_t nbytes;
+  int rc;
+  int err;
+
+  job = _cmd_save_job_new(bview->buffer, path);
+  errno = 0;
+  rc = _cmd_save_write(job, -1, &nbytes);
+  err = errno;
+  _cmd_save_job_free(job);
+
+  if (rc != EON_OK) {
+    EON_RETURN_ERR(editor, "Save: %s", err ? strerror(err) : "failed");
+  }
+
+  _cmd_save_done(editor, bview, path, nbytes, 0, -1);
+  return EON_OK;
+}
+
+// Save buffer to path from a forked child. The child writes a copy-on-write
+// snapshot of the buffer, so editing can continue while it runs.
+static int _cmd_save_async(editor_t* editor, bview_t* bview, char* path) {
+  cmd_save_job_t* job;
+
+  job = _cmd_save_job_new(bview->buffer, path);
+  bview->save_pct = 0;
+  bview->save_pending.len = 0;
+  bview->is_save_dirty = 0;
+  bview->is_save_done = 0;
+  bview->save_journal_mark = journal_tell(editor, bview->buffer);
+
+  if (!async_proc_new_fn(editor, bview, &bview->save_proc, _cmd_save_child, job, _cmd_aproc_save_cb)) {
+    _cmd_save_job_free(job);
+    return EON_ERR;
+  }
+
+  // The child has its own copy of job
+  _cmd_save_job_free(job);
+
+  if (bview->save_path) free(bview->save_path);
+  bview->save_path = strdup(path);
+  return EON_OK;
+}
+
+// Update buffer after it was written to path. If is_dirty, the buffer was
+// edited while a background save ran, so it stays unsaved and journal records
+// from journal_mark on are kept.
+static void _cmd_save_done(editor_t* editor, bview_t* bview, char* path, bint_t nbytes, int is_dirty, off_t journal_mark) {
+  buffer_t* buffer;
+  int fname_changed;
+
+  buffer = bview->buffer;
+  fname_changed = !buffer->path || strcmp(buffer->path, path) != 0 ? 1 : 0;
+
+  if (fname_changed) {
+    if (buffer->path) free(buffer->path);
+    buffer->path = strdup(path);
+    editor->is_tab_bar_dirty = 1;
+  }
+
+  // The rename gave the file a new inode
+  stat(path, &buffer->st);
+  editor_register_buffer(editor, buffer);
+  watch_add(editor, buffer);
+
+  if (!is_dirty) {
+    buffer->is_unsaved = 0;
+  }
 
-  } while (rc == MLBUF_ERR && (!bview->buffer->path || save_as));
+  journal_rebase(editor, buffer, is_dirty ? journal_mark : -1);
+  EON_SET_INFO(editor, "Done. Wrote %ld bytes", (long int)nbytes);
 
   // Refresh syntax if fname changed
   if (fname_changed) {
     bview_set_syntax(bview, NULL);
   }
+}
+
+// Prepare a save of buffer to path. Everything the writer needs is allocated
+// here so a forked writer does not have to.
+static cmd_save_job_t* _cmd_save_job_new(buffer_t* buffer, char* path) {
+  cmd_save_job_t* job;
+  char* tmp;
 
-  return rc == MLBUF_OK ? EON_OK : EON_ERR;
+  job = calloc(1, sizeof(cmd_save_job_t));
+  job->buffer = buffer;
+
+  // Write through symlinks to the file they point at
+  if (!(job->target = realpath(path, NULL))) {
+    job->target = strdup(path);
+  }
+
+  tmp = strdup(job->target);
+  job->dir = strdup(dirname(tmp));
+  free(tmp);
+
+  tmp = strdup(job->target);
+
+  if (asprintf(&job->tmp_path, "%s/.%s.eon-XXXXXX", job->dir, basename(tmp)) < 0) {
+    job->tmp_path = NULL;
+  }
+
+  free(tmp);
+  job->iov = calloc(EON_SAVE_IOV_MAX, sizeof(struct iovec));
+  return job;
+}
+
+// Free a save job
+static void _cmd_save_job_free(cmd_save_job_t* job) {
+  free(job->target);
+  free(job->dir);
+  if (job->tmp_path) free(job->tmp_path);
+  free(job->iov);
+  free(job);
+}
+
+// Write buffer to a temp file beside the target, fsync it, and rename it over
+// the target so a crash never leaves a half-written file. If progress_fd is
+// set, report "P <percent>" lines on it.
+static int _cmd_save_write(cmd_save_job_t* job, int progress_fd, bint_t* ret_nbytes) {
+  bline_t* bline;
+  struct stat st;
+  mode_t mask;
+  bint_t nbytes;
+  bint_t total;
+  int fd;
+  int dirfd;
+  int iovcnt;
+  int pct;
+  int last_pct;
+  int err;
+
+  if (!job->tmp_path || (fd = mkstemp(job->tmp_path)) < 0) {
+    return EON_ERR;
+  }
+
+  // mkstemp creates 0600; match the file being replaced or the umask
+  if (stat(job->target, &st) == 0) {
+    fchmod(fd, st.st_mode & 07777);
+  } else {
+    mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+  }
+
+  total = EON_MAX(job->buffer->byte_count, 1);
+  nbytes = 0;
+  iovcnt = 0;
+  last_pct = -1;
+
+  for (bline = job->buffer->first_line; bline; bline = bline->next) {
+    job->iov[iovcnt].iov_base = bline->data;
+    job->iov[iovcnt].iov_len = bline->data_len;
+    iovcnt += 1;
+
+    if (bline->next) {
+      job->iov[iovcnt].iov_base = "\n";
+      job->iov[iovcnt].iov_len = 1;
+      iovcnt += 1;
+    }
+
+    if (iovcnt < EON_SAVE_IOV_MAX - 1 && bline->next) {
+      continue;
+    }
+
+    if (_cmd_save_writev_all(fd, job->iov, iovcnt, &nbytes) != EON_OK) {
+      goto _cmd_save_write_fail;
+    }
+
+    iovcnt = 0;
+    pct = (int)EON_MIN(100, (nbytes * 100) / total);
+
+    if (progress_fd >= 0 && pct != last_pct) {
+      dprintf(progress_fd, "P %d\n", pct);
+      last_pct = pct;
+    }
+  }
+
+  if (fsync(fd) != 0) {
+    goto _cmd_save_write_fail;
+  }
+
+  close(fd);
+
+  if (rename(job->tmp_path, job->target) != 0) {
+    err = errno;
+    unlink(job->tmp_path);
+    errno = err;
+    return EON_ERR;
+  }
+
+  // Make the rename itself durable
+  if ((dirfd = open(job->dir, O_RDONLY)) >= 0) {
+    fsync(dirfd);
+    close(dirfd);
+  }
+
+  *ret_nbytes = nbytes;
+  return EON_OK;
+
+_cmd_save_write_fail:
+  err = errno;
+  close(fd);
+  unlink(job->tmp_path);
+  errno = err;
+  return EON_ERR;
+}
+
+// writev(2) until all of iov is written, resuming after partial writes
+static int _cmd_save_writev_all(int fd, struct iovec* iov, int iovcnt, bint_t* nbytes) {
+  ssize_t rc;
+
+  while (iovcnt > 0) {
+    if ((rc = writev(fd, iov, iovcnt)) < 0) {
+      if (errno == EINTR) continue;
+      return EON_ERR;
+    }
+
+    *nbytes += rc;
+
+    while (iovcnt > 0 && (size_t)rc >= iov->iov_len) {
+      rc -= iov->iov_len;
+      iov += 1;
+      iovcnt -= 1;
+    }
+
+    if (iovcnt > 0) {
+      iov->iov_base = (char*)iov->iov_base + rc;
+      iov->iov_len -= rc;
+    }
+  }
+
+  return EON_OK;
+}
+
+// Background save (runs in the forked child)
+static int _cmd_save_child(void* udata, int wfd) {
+  bint_t nbytes;
+
+  if (_cmd_save_write((cmd_save_job_t*)udata, wfd, &nbytes) != EON_OK) {
+    dprintf(wfd, "ERR %d\n", errno);
+    return EON_ERR;
+  }
+
+  dprintf(wfd, "OK %lld\n", (long long)nbytes);
+  return EON_OK;
+}
+
+// Background save progress and result. A line may straddle pipe reads, so
+// buffer output and parse only complete lines.
+static void _cmd_aproc_save_cb(async_proc_t* aproc, char* buf, size_t buf_len) {
+  editor_t* editor;
+  bview_t* bview;
+  char* line;
+  char* eol;
+  size_t off;
+  long long val;
+
+  editor = aproc->editor;
+  bview = (bview_t*)aproc->owner;
+
+  if (buf_len > 0) str_append_len(&bview->save_pending, buf, buf_len);
+
+  for (off = 0; off < bview->save_pending.len; off = eol - bview->save_pending.data + 1) {
+    line = bview->save_pending.data + off;
+    if (!(eol = memchr(line, '\n', bview->save_pending.len - off))) break;
+    *eol = '\0';
+
+    if (sscanf(line, "P %lld", &val) == 1) {
+      bview->save_pct = (int)val;
+
+    } else if (sscanf(line, "OK %lld", &val) == 1) {
+      bview->is_save_done = 1;
+      _cmd_save_done(editor, bview, bview->save_path, (bint_t)val, bview->is_save_dirty, bview->save_journal_mark);
+
+    } else if (sscanf(line, "ERR %lld", &val) == 1) {
+      bview->is_save_done = 1;
+      EON_SET_ERR(editor, "Save: %s", val ? strerror((int)val) : "failed");
+    }
+  }
+
+  if (off > 0) {
+    memmove(bview->save_pending.data, bview->save_pending.data + off, bview->save_pending.len - off);
+    bview->save_pending.len -= off;
+  }
+
+  if (buf_len == 0 && !bview->is_save_done) {
+    EON_SET_ERR(editor, "Save: %s", "background writer exited");
+  }
 }
 
 // Move cursor to next occurrence of term, wrap if necessary. Return EON_OK if
@@ -1757,21 +2163,11 @@ static int _cmd_search_next(bview_t* bview, cursor_t* cursor, mark_t* search_mar
   // Move search_mark to cursor
   mark_join(search_mark, cursor->mark);
 
-  // Look for match ahead of us
-  if (mark_move_next_re(search_mark, regex, regex_len) == MLBUF_OK) {
+  // Look for match ahead of us, then from the beginning
+  if (search_next(bview->editor, search_mark, regex, regex_len, 1) == EON_OK) {
     // Match! Move there
     mark_join(cursor->mark, search_mark);
     rc = EON_OK;
-
-  } else {
-    // No match, try from beginning
-    mark_move_beginning(search_mark);
-
-    if (mark_move_next_re(search_mark, regex, regex_len) == MLBUF_OK) {
-      // Match! Move there
-      mark_join(cursor->mark, search_mark);
-      rc = EON_OK;
-    }
   }
 
   // Rectify viewport if needed
@@ -1812,28 +2208,19 @@ static void _cmd_isearch_prompt_cb(bview_t* bview_prompt, baction_t* action, voi
 
   bview = bview_prompt->editor->active_edit;
 
-  if (bview->isearch_rule) {
-    buffer_remove_srule(bview->buffer, bview->isearch_rule, 1, 100);
-    srule_destroy(bview->isearch_rule);
-    bview->isearch_rule = NULL;
-  }
-
   regex = bview_prompt->buffer->first_line->data;
   regex_len = bview_prompt->buffer->first_line->data_len;
 
-  if (regex_len < 1) return;
-
-  bview->isearch_rule = srule_new_single(regex, regex_len, 1, 0, TB_YELLOW);
-
-  if (!bview->isearch_rule) return;
-
-  buffer_add_srule(bview->buffer, bview->isearch_rule, 0, 100);
-  mark_move_by(bview->active_cursor->mark, -1);
-
-  if (mark_move_next_cre(bview->active_cursor->mark, bview->isearch_rule->cre) != MLBUF_OK) {
-    mark_move_by(bview->active_cursor->mark, 1);
+  if (regex_len < 1) {
+    isearch_end(bview);
+    return;
   }
 
+  // Matches are drawn as an overlay of the visible lines (see
+  // _bview_draw_bline), so the buffer is never restyled here
+  if (isearch_set_pattern(bview, regex, regex_len) != EON_OK) return;
+
+  isearch_move(bview, bview->active_cursor->mark, 1, 1);
   bview_center_viewport_y(bview);
 }
 
@@ -1910,14 +2297,13 @@ static int _cmd_menu_ctag_cb(cmd_context_t* ctx, char * action) {
   util_pcre_replace("([\\.\\\\\\+\\*\\?\\^\\$\\[\\]\\(\\)\\{\\}\\=\\!\\>\\<\\|\\:\\-])", re, "\\\\$1", &qre, &qre_len);
   editor_close_bview(ctx->editor, ctx->bview, NULL);
   editor_open_bview(ctx->editor, NULL, EON_BVIEW_TYPE_EDIT, fname, strlen(fname), 1, 0, &ctx->editor->rect_edit, NULL, &bview);
-  int len = asprintf(&qre2, "^%s", qre);
+  qre2 = arena_sprintf(ctx->editor->scratch, "^%s", qre);
 
   mark_move_next_re(bview->active_cursor->mark, qre2, qre_len+1);
   bview_center_viewport_y(bview);
 
   free(line);
   free(qre);
-  free(qre2);
 
   return EON_OK;
 }
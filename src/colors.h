@@ -19,6 +19,9 @@
 #define INFO_FG TB_WHITE
 #define INFO_BG TB_DEFAULT
 
+#define TRACE_FG TB_WHITE
+#define TRACE_BG TB_BLUE
+
 #define MODE_FG TB_LIGHT_MAGENTA
 #define SYNTAX_FG TB_LIGHT_CYAN
 #define MOUSE_STATUS_FG TB_LIGHTEST_GREY
@@ -33,6 +36,9 @@
 
 #define BRACKET_HIGHLIGHT TB_REVERSE
 
+#define ISEARCH_FG TB_DEFAULT
+#define ISEARCH_BG TB_YELLOW
+
 // #define RECT_CAPTION_FG TB_DARK_GREY
 // #define RECT_CAPTION_BG TB_BLACK
 
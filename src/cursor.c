@@ -2,7 +2,7 @@
 #include <ctype.h>
 #include "eon.h"
 
-char* shared_cutbuf;
+static int _cursor_uncut_kill(cursor_t* cursor, kill_t* kill);
 
 // Clone cursor
 int cursor_clone(cursor_t* cursor, int use_srules, cursor_t** ret_clone) {
@@ -235,13 +235,15 @@ int cursor_select_by_word(cursor_t* cursor) {
 
 // Cut or copy text
 int cursor_cut_copy(cursor_t* cursor, int is_cut, int use_srules, int append) {
+  editor_t* editor;
   char* cutbuf;
   bint_t cutbuf_len;
-  bint_t cur_len;
 
-  if (!append && cursor->cut_buffer) {
-    free(cursor->cut_buffer);
-    cursor->cut_buffer = NULL;
+  editor = cursor->bview->editor;
+
+  if (!append && cursor->kill) {
+    kill_unref(cursor->kill);
+    cursor->kill = NULL;
   }
 
   if (!cursor->is_anchored) {
@@ -254,27 +256,19 @@ int cursor_cut_copy(cursor_t* cursor, int is_cut, int use_srules, int append) {
 
   mark_get_between_mark(cursor->mark, cursor->anchor, &cutbuf, &cutbuf_len);
 
-  if (append && cursor->cut_buffer) {
-    cur_len = strlen(cursor->cut_buffer);
-
-    // cursor buf
-    cursor->cut_buffer = realloc(cursor->cut_buffer, cur_len + cutbuf_len + 1);
-    strncat(cursor->cut_buffer, cutbuf, cutbuf_len);
-
-    // shared buf
-    shared_cutbuf = realloc(shared_cutbuf, cur_len + cutbuf_len + 1);
-    strncat(shared_cutbuf, cutbuf, cutbuf_len);
-
+  if (append && cursor->kill) {
+    // The clip may be in the kill ring too; both see the append
+    kill_append(cursor->kill, cutbuf, cutbuf_len);
     free(cutbuf);
 
   } else {
+    cursor->kill = kill_new(cutbuf, cutbuf_len, editor->kill_batch);
+    editor->kill_batch_count += 1;
 
-    cursor->cut_buffer = cutbuf;
-
-    // copy to shared cutbuf
-    free(shared_cutbuf);
-    shared_cutbuf = malloc(cutbuf_len + 1);
-    strcpy(shared_cutbuf, cursor->cut_buffer);
+    // The active cursor's clip is the one shared with other bviews
+    if (cursor == cursor->bview->active_cursor) {
+      kill_ring_push(editor, cursor->kill);
+    }
   }
 
   if (is_cut) {
@@ -285,15 +279,54 @@ int cursor_cut_copy(cursor_t* cursor, int is_cut, int use_srules, int append) {
   return EON_OK;
 }
 
-// Uncut (paste) text
+// Uncut (paste) text. If every awake cursor cut its own clip in the last
+// batch, each pastes its own; otherwise all paste the newest in the ring.
 int cursor_uncut(cursor_t* cursor) {
+  editor_t* editor;
+  kill_t* kill;
+
+  editor = cursor->bview->editor;
+
+  if (cursor->kill
+    && cursor->kill->batch == editor->kill_batch
+    && editor->kill_batch_count > 1
+    && editor->kill_batch_count == bview_get_active_cursor_count(cursor->bview)
+  ) {
+    kill = cursor->kill;
+  } else if (!(kill = kill_ring_get(editor, 0))) {
+    kill = cursor->kill;
+  }
+
+  editor->kill_ring_pos = 0;
+  return _cursor_uncut_kill(cursor, kill);
+}
+
+// Replace the text cursor just pasted with the nth newest clip in the ring
+int cursor_uncut_replace(cursor_t* cursor, int n) {
+  kill_t* kill;
+
+  if (!cursor->pasted || !(kill = kill_ring_get(cursor->bview->editor, n))) {
+    return EON_ERR;
+  }
+
+  mark_delete_before(cursor->mark, kill_get_nchars(cursor->pasted));
+  return _cursor_uncut_kill(cursor, kill);
+}
+
+// Paste kill at cursor and remember it for cursor_uncut_replace
+static int _cursor_uncut_kill(cursor_t* cursor, kill_t* kill) {
+  if (cursor->pasted) {
+    kill_unref(cursor->pasted);
+    cursor->pasted = NULL;
+  }
+
+  if (!kill) return EON_ERR;
 
-  if (shared_cutbuf && strlen(shared_cutbuf) > 1) {
-    mark_insert_before(cursor->mark, shared_cutbuf, strlen(shared_cutbuf));
-  } else if (cursor->cut_buffer) {
-    mark_insert_before(cursor->mark, cursor->cut_buffer, strlen(cursor->cut_buffer));
+  if (kill->len > 0) {
+    mark_insert_before(cursor->mark, kill->data, kill->len);
   }
 
+  cursor->pasted = kill_ref(kill);
   return EON_OK;
 }
 
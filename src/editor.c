@@ -45,10 +45,15 @@ static int _editor_maybe_toggle_macro(editor_t* editor, kinput_t* input);
 static void _editor_resize(editor_t* editor, int w, int h);
 static void _editor_draw_cursors(editor_t* editor, bview_t* bview);
 static void _editor_get_user_input(editor_t* editor, cmd_context_t* ctx);
+static int _editor_get_idle_timeout(editor_t* editor);
 static void _editor_ingest_paste(editor_t* editor, cmd_context_t* ctx);
 static void _editor_record_macro_input(kmacro_t* macro, kinput_t* input);
 static cmd_t* _editor_get_command(editor_t* editor, cmd_context_t* ctx, kinput_t* opt_peek_input);
-static kbinding_t* _editor_get_kbinding_node(kbinding_t* node, kinput_t* input, loop_context_t* loop_ctx, int is_peek, int* ret_again);
+static kbinding_t* _editor_get_kbinding_node(kbinding_t* node, kbinding_t** opt_flat, kinput_t* input, loop_context_t* loop_ctx, int is_peek, int* ret_again);
+static int _editor_get_flat_slot(kinput_t* input);
+static void _editor_compile_kmaps(editor_t* editor);
+static void _editor_compile_kmap(editor_t* editor, kmap_t* kmap);
+static void _editor_compile_kbinding(editor_t* editor, kbinding_t* node);
 static cmd_t* _editor_resolve_cmd(editor_t* editor, cmd_t** rcmd, char* cmd_name);
 static int _editor_key_to_input(char* key, kinput_t* ret_input);
 static void _editor_init_signal_handlers(editor_t* editor);
@@ -96,6 +101,15 @@ int editor_init(editor_t* editor, int argc, char** argv) {
     editor->highlight_bracket_pairs = EON_DEFAULT_HILI_BRACKET_PAIRS;
     editor->read_rc_file = EON_DEFAULT_READ_RC_FILE;
     editor->soft_wrap = EON_DEFAULT_SOFT_WRAP;
+    editor->undo_max_bytes = EON_DEFAULT_UNDO_MAX_BYTES;
+    editor->use_journal = EON_DEFAULT_USE_JOURNAL;
+    editor->sync_output = EON_DEFAULT_SYNC_OUTPUT;
+    editor->chars_max_bytes = EON_DEFAULT_CHARS_MAX_BYTES;
+    editor->use_server = EON_DEFAULT_USE_SERVER;
+    editor->auto_reload = EON_DEFAULT_AUTO_RELOAD;
+    editor->cursor_slab = slab_new(sizeof(cursor_t), EON_CURSOR_SLAB_SIZE);
+    editor->scratch = arena_new(EON_SCRATCH_CHUNK_SIZE);
+    editor->search_threads = (int)EON_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
     editor->viewport_scope_x = -4;
     editor->viewport_scope_y = -1;
     editor->color_col = -1;
@@ -137,6 +151,15 @@ int editor_init(editor_t* editor, int argc, char** argv) {
     rv = _editor_init_from_args(editor, argc, argv);
     if (rv != EON_OK) break;
 
+    // Start journal writer before opening files so they can be recovered
+    journal_init(editor);
+
+    // Take files from later eon invocations (see server_forward)
+    server_init(editor);
+
+    // Reload open files when they change on disk
+    watch_init(editor);
+
     _editor_init_status(editor);
     _editor_init_bviews(editor, argc, argv);
     _editor_init_or_deinit_commands(editor, 0);
@@ -147,6 +170,9 @@ int editor_init(editor_t* editor, int argc, char** argv) {
     load_plugins(editor);
 #endif
 
+    // Bindings from rc files and plugins are in; build dispatch tables
+    _editor_compile_kmaps(editor);
+
   } while (0);
 
   editor->is_in_init = 0;
@@ -178,6 +204,14 @@ int editor_deinit(editor_t* editor) {
   prompt_hnode_t* prompt_hnode_tmp1;
   prompt_hnode_t* prompt_hnode_tmp2;
 
+  // Write trace while span names (cmd names) are still alive
+  if (editor->trace_path) {
+    trace_dump(editor, editor->trace_path);
+    free(editor->trace_path);
+  }
+
+  trace_set_enabled(editor, 0);
+
 #ifdef WITH_PLUGINS
   unload_plugins();
 #endif
@@ -190,10 +224,14 @@ int editor_deinit(editor_t* editor) {
     bview_destroy(bview);
   }
 
+  if (editor->tabs) free(editor->tabs);
+  if (editor->tab_bar) free(editor->tab_bar);
+
   HASH_ITER(hh, editor->kmap_map, kmap, kmap_tmp) {
     HASH_DEL(editor->kmap_map, kmap);
     _editor_destroy_kmap(kmap, kmap->bindings->children);
     if (kmap->default_cmd_name) free(kmap->default_cmd_name);
+    if (kmap->flat) free(kmap->flat);
 
     free(kmap->bindings);
     free(kmap->name);
@@ -236,6 +274,14 @@ int editor_deinit(editor_t* editor) {
   if (editor->ttyfd) close(editor->ttyfd);
   if (editor->startup_macro_name) free(editor->startup_macro_name);
 
+  journal_deinit(editor);
+  server_deinit(editor);
+  watch_deinit(editor);
+  term_deinit(editor);
+  if (editor->cursor_slab) slab_destroy(editor->cursor_slab);
+  if (editor->scratch) arena_destroy(editor->scratch);
+  kill_ring_destroy(editor);
+
   return EON_OK;
 }
 
@@ -373,9 +419,17 @@ int editor_open_bview(editor_t* editor, bview_t* parent, int type, char* opt_pat
   // debug("Opening bview [%d], path %s, buffer len %ld\n", type, opt_path, opt_buffer == NULL ? -1 : opt_buffer->byte_count);
 
   if (opt_path) { // Check if already open and not dirty
+    buffer_t* buffer;
+    buffer = editor_find_buffer_by_path(editor, opt_path, opt_path_len);
+
     CDL_FOREACH2(editor->all_bviews, bview, all_next) {
       // debug("Checking if bview (%s) matches path %s\n", bview->buffer && bview->buffer->path, opt_path);
-      if (bview->buffer && bview->buffer->path && strcmp(opt_path, bview->buffer->path) == 0) {
+      if (!bview->buffer || !EON_BVIEW_IS_EDIT(bview)) {
+        continue;
+
+      } else if (buffer ? bview->buffer == buffer
+                        : bview->buffer->path && strcmp(opt_path, bview->buffer->path) == 0) {
+        // Same file (by inode), or same unsaved path
         found = 1;
         break;
       }
@@ -390,6 +444,7 @@ int editor_open_bview(editor_t* editor, bview_t* parent, int type, char* opt_pat
     CDL_APPEND2(editor->all_bviews, bview, all_prev, all_next);
     if (!parent) {
       DL_APPEND2(editor->top_bviews, bview, top_prev, top_next);
+      if (EON_BVIEW_IS_EDIT(bview)) editor_tab_add(editor, bview);
     } else {
       parent->split_child = bview;
     }
@@ -489,6 +544,121 @@ int editor_count_bviews_by_buffer(editor_t* editor, buffer_t* buffer) {
   return count;
 }
 
+// Return the open buffer for the file at path, matched by device and inode so
+// symlinks and relative paths resolve to the same buffer. Return NULL if the
+// file is not open.
+buffer_t* editor_find_buffer_by_path(editor_t* editor, char* path, int path_len) {
+  buffer_ino_t* entry;
+  buffer_ino_t find;
+  struct stat st;
+  char* path_nt;
+  char* exp_path;
+  int rc;
+
+  if (!editor->buffer_ino_map || path_len < 1) {
+    return NULL;
+  }
+
+  path_nt = strndup(path, path_len);
+  util_expand_tilde(path_nt, path_len, &exp_path);
+  rc = stat(exp_path, &st);
+  free(exp_path);
+  free(path_nt);
+
+  if (rc != 0) {
+    return NULL;
+  }
+
+  memset(&find, 0, sizeof(buffer_ino_t));
+  find.key.dev = st.st_dev;
+  find.key.ino = st.st_ino;
+  HASH_FIND(hh, editor->buffer_ino_map, &find.key, sizeof(find.key), entry);
+  return entry ? entry->buffer : NULL;
+}
+
+// Add a file-backed buffer to the inode registry, or re-key it after its file
+// was replaced (e.g., by a save)
+int editor_register_buffer(editor_t* editor, buffer_t* buffer) {
+  buffer_ino_t* entry;
+  buffer_ino_t* other;
+
+  editor_unregister_buffer(editor, buffer);
+
+  if (!buffer->path || buffer->st.st_ino == 0) {
+    return EON_ERR;
+  }
+
+  entry = calloc(1, sizeof(buffer_ino_t));
+  entry->key.dev = buffer->st.st_dev;
+  entry->key.ino = buffer->st.st_ino;
+  entry->buffer = buffer;
+
+  // Another buffer of the same file wins
+  HASH_FIND(hh, editor->buffer_ino_map, &entry->key, sizeof(entry->key), other);
+
+  if (other) {
+    free(entry);
+    return EON_ERR;
+  }
+
+  HASH_ADD(hh, editor->buffer_ino_map, key, sizeof(entry->key), entry);
+  HASH_ADD(hh_buffer, editor->buffer_ino_by_buffer, buffer, sizeof(buffer_t*), entry);
+  return EON_OK;
+}
+
+// Remove a buffer from the inode registry
+int editor_unregister_buffer(editor_t* editor, buffer_t* buffer) {
+  buffer_ino_t* entry;
+
+  HASH_FIND(hh_buffer, editor->buffer_ino_by_buffer, &buffer, sizeof(buffer_t*), entry);
+
+  if (!entry) {
+    return EON_ERR;
+  }
+
+  HASH_DELETE(hh, editor->buffer_ino_map, entry);
+  HASH_DELETE(hh_buffer, editor->buffer_ino_by_buffer, entry);
+  free(entry);
+  return EON_OK;
+}
+
+// Append a top-level edit bview to the tab list
+int editor_tab_add(editor_t* editor, bview_t* bview) {
+  if (editor->tabs_len >= editor->tabs_cap) {
+    editor->tabs_cap = EON_MAX(16, editor->tabs_cap * 2);
+    editor->tabs = realloc(editor->tabs, sizeof(bview_t*) * editor->tabs_cap);
+  }
+
+  bview->tab_index = editor->tabs_len;
+  editor->tabs[editor->tabs_len++] = bview;
+  editor->is_tab_bar_dirty = 1;
+  return EON_OK;
+}
+
+// Remove a bview from the tab list
+int editor_tab_remove(editor_t* editor, bview_t* bview) {
+  int i;
+
+  if (bview->tab_index < 0 || bview->tab_index >= editor->tabs_len || editor->tabs[bview->tab_index] != bview) {
+    return EON_ERR;
+  }
+
+  for (i = bview->tab_index; i + 1 < editor->tabs_len; i++) {
+    editor->tabs[i] = editor->tabs[i + 1];
+    editor->tabs[i]->tab_index = i;
+  }
+
+  editor->tabs_len -= 1;
+  bview->tab_index = -1;
+  editor->is_tab_bar_dirty = 1;
+  return EON_OK;
+}
+
+// Return the bview of the tab at index, or NULL
+bview_t* editor_tab_at(editor_t* editor, int index) {
+  return index >= 0 && index < editor->tabs_len ? editor->tabs[index] : NULL;
+}
+
 // Register a command
 static int _editor_register_cmd_fn(editor_t* editor, char* name, int (*func)(cmd_context_t* ctx)) {
   cmd_t cmd = {0};
@@ -553,9 +723,11 @@ int editor_get_input(editor_t* editor, loop_context_t* loop_ctx, cmd_context_t*
 // Display the editor
 int editor_display(editor_t* editor) {
   bview_t* bview;
+  uint64_t trace_start;
 
   if (editor->headless_mode) return EON_OK;
 
+  trace_start = trace_begin(editor);
   tb_clear_buffer();
   bview_draw(editor->active_edit_root);
   bview_draw(editor->status);
@@ -566,7 +738,9 @@ int editor_display(editor_t* editor) {
     _editor_draw_cursors(editor, bview);
   }
 
-  tb_render();
+  trace_draw_overlay(editor);
+  term_render(editor);
+  trace_end(editor, "draw", "editor_display", trace_start);
   return EON_OK;
 }
 
@@ -614,6 +788,7 @@ static int _editor_close_bview_inner(editor_t* editor, bview_t* bview, int *optr
 
   if (!bview->split_parent) {
     DL_DELETE2(editor->top_bviews, bview, top_prev, top_next);
+    editor_tab_remove(editor, bview);
   }
 
   CDL_DELETE2(editor->all_bviews, bview, all_prev, all_next);
@@ -887,8 +1062,8 @@ static int _editor_prompt_menu_page_down(cmd_context_t* ctx) {
 
 // Invoked when user hits down in a prompt_isearch
 static int _editor_prompt_isearch_next(cmd_context_t* ctx) {
-  if (ctx->editor->active_edit->isearch_rule) {
-    mark_move_next_cre(ctx->editor->active_edit->active_cursor->mark, ctx->editor->active_edit->isearch_rule->cre);
+  if (ctx->editor->active_edit->isearch) {
+    isearch_move(ctx->editor->active_edit, ctx->editor->active_edit->active_cursor->mark, 1, 0);
     bview_center_viewport_y(ctx->editor->active_edit);
   }
 
@@ -897,8 +1072,8 @@ static int _editor_prompt_isearch_next(cmd_context_t* ctx) {
 
 // Invoked when user hits up in a prompt_isearch
 static int _editor_prompt_isearch_prev(cmd_context_t* ctx) {
-  if (ctx->editor->active_edit->isearch_rule) {
-    mark_move_prev_cre(ctx->editor->active_edit->active_cursor->mark, ctx->editor->active_edit->isearch_rule->cre);
+  if (ctx->editor->active_edit->isearch) {
+    isearch_move(ctx->editor->active_edit, ctx->editor->active_edit->active_cursor->mark, -1, 0);
     bview_center_viewport_y(ctx->editor->active_edit);
   }
 
@@ -929,24 +1104,20 @@ static int _editor_prompt_toggle_replace(cmd_context_t* ctx) {
 static int _editor_prompt_isearch_drop_cursors(cmd_context_t* ctx) {
   bview_t* bview;
   mark_t* mark;
-  pcre* cre;
   cursor_t* orig_cursor;
   cursor_t* last_cursor;
+  int rc;
   bview = ctx->editor->active_edit;
 
-  if (!bview->isearch_rule) return EON_OK;
+  if (!bview->isearch || !bview->isearch->cre) return EON_OK;
 
   orig_cursor = bview->active_cursor;
   mark = bview->active_cursor->mark;
-  cre = bview->isearch_rule->cre;
   mark_move_beginning(mark);
   last_cursor = NULL;
 
-  while (mark_move_next_cre(mark, cre) == MLBUF_OK) {
-    if (mark->col == 0 && mark->bline->line_index == 0) {
-      break; // otherwise hell breaks loose. FIXME: we should skip to the next one.
-    }
-
+  // isearch_move never wraps, so this ends at the last match
+  for (rc = isearch_move(bview, mark, 1, 1); rc == EON_OK; rc = isearch_move(bview, mark, 1, 0)) {
     bview_add_cursor(bview, mark->bline, mark->col, &last_cursor);
   }
 
@@ -964,6 +1135,10 @@ static void _editor_loop(editor_t* editor, loop_context_t* loop_ctx) {
   cmd_t* cmd;
   cmd_context_t cmd_ctx;
   char event_name[64];
+  uint64_t trace_start;
+  uint64_t allocs;
+  arena_mark_t scratch_mark;
+  int is_drained;
 
   // Increment loop_depth
   editor->loop_depth += 1;
@@ -981,15 +1156,31 @@ static void _editor_loop(editor_t* editor, loop_context_t* loop_ctx) {
     // Set loop_ctx
     editor->loop_ctx = loop_ctx;
 
+    // Open files sent by other eon invocations
+    server_idle(editor);
+
+    // Append the rest of files that grew by more than one read
+    watch_idle(editor);
+
+    // Hand journal records to the writer before we wait for input
+    journal_idle(editor);
+
+    // Free decoded chars of lines far off screen
+    chars_idle(editor);
+
     // Display editor
     if (!editor->is_display_disabled) {
       editor_display(editor);
     }
 
     // Check for async io
-    // async_proc_drain_all will bail and return 0 if there's any tty data
-    if (editor->async_procs && async_proc_drain_all(editor->async_procs, &editor->ttyfd)) {
-      continue;
+    // async_proc_drain_all will bail and return 0 if there's any tty data.
+    // It also returns 1 once a put-off chars sweep or watch append is due.
+    if (editor->async_procs) {
+      trace_start = trace_begin(editor);
+      is_drained = async_proc_drain_all(editor->async_procs, &editor->ttyfd, _editor_get_idle_timeout(editor));
+      trace_end(editor, "async", "async_proc_drain_all", trace_start);
+      if (is_drained) continue;
     }
 
     // Get input
@@ -997,15 +1188,6 @@ static void _editor_loop(editor_t* editor, loop_context_t* loop_ctx) {
       break;
     }
 
-// #define SHOW_KEYS 1
-#ifdef SHOW_KEYS
-    if (cmd_ctx.is_user_input) {
-      //  rect_printf(editor->rect_status, editor->rect_status.w - 20, 0, TB_DEFAULT, TB_DEFAULT,
-      //    "k:%d/ch:%d/m:%d", cmd_ctx.input.key, cmd_ctx.input.ch, cmd_ctx.input.meta);
-      printf("k:%d/ch:%d/m:%d\n", cmd_ctx.input.key, cmd_ctx.input.ch, cmd_ctx.input.meta);
-    }
-#endif
-
     // Toggle macro?
     if (_editor_maybe_toggle_macro(editor, &cmd_ctx.input)) {
       continue;
@@ -1031,20 +1213,41 @@ static void _editor_loop(editor_t* editor, loop_context_t* loop_ctx) {
 
 #ifdef WITH_PLUGINS
       if (cmd->name[0] != '_') {
+        trace_start = trace_begin(editor);
         snprintf(event_name, strlen(cmd->name) + 6, "before.%s", cmd->name + 4);
         trigger_plugin_event(event_name, cmd_ctx);
+        trace_end(editor, "plugin", cmd->name, trace_start);
       }
 #endif
 
+      // Anything a command puts in editor->scratch is released when it returns
+      scratch_mark = arena_tell(editor->scratch);
+      allocs = trace_allocs();
+      trace_start = trace_begin(editor);
       cmd->func(&cmd_ctx); // call the function itself
+      trace_end_allocs(editor, "cmd", cmd->name, trace_start, trace_allocs() - allocs);
+      arena_rewind(editor->scratch, scratch_mark);
 
 #ifdef WITH_PLUGINS
       if (cmd->name[0] != '_') {
+        trace_start = trace_begin(editor);
         snprintf(event_name, strlen(cmd->name) + 7, "after.%s", cmd->name + 4);
         trigger_plugin_event(event_name, cmd_ctx);
+        trace_end(editor, "plugin", cmd->name, trace_start);
       }
 #endif
 
+      // Merge undo actions and enforce undo memory cap
+      if (editor->active_edit) {
+        undo_commit(editor, editor->active_edit->buffer, cmd->func);
+      }
+
+      // Merge cursors that met. Not from nested loops: a command that
+      // prompts may still be walking its cursor list.
+      if (editor->loop_depth == 1 && editor->active && EON_BVIEW_IS_EDIT(editor->active)) {
+        bview_merge_cursors(editor->active);
+      }
+
       loop_ctx->binding_node = NULL;
       loop_ctx->wildcard_params_len = 0;
       loop_ctx->numeric_params_len = 0;
@@ -1156,69 +1359,32 @@ static void _editor_draw_cursors(editor_t* editor, bview_t* bview) {
   }
 }
 
-static int _get_bview_count(cmd_context_t * ctx) {
-  bview_t* bview_tmp;
-  int bview_count = 0;
-
-  CDL_FOREACH2(ctx->editor->all_bviews, bview_tmp, all_next) {
-    if (EON_BVIEW_IS_EDIT(bview_tmp)) {
-      bview_count += 1;
-    }
-  }
-
-  return bview_count;
-}
-
 static int _find_bview_at(cmd_context_t * ctx, int offset) {
-  int bview_count = _get_bview_count(ctx);
-
-  int from = -1, index = bview_count, to = -1;
-
-  while (index--) {
-    to   = to == -1 ? ctx->editor->w : from;
-    from = (index) * ctx->editor->bview_tab_width;
+  int index;
 
-    if (from < offset && offset < to) {
-      break;
-    }
-  }
+  if (offset < 0 || ctx->editor->bview_tab_width < 1) return -1;
 
-  return index;
+  index = offset / ctx->editor->bview_tab_width;
+  return index < ctx->editor->tabs_len ? index : -1;
 }
 
 static void _open_bview_at(cmd_context_t * ctx, int offset) {
   bview_t* bview_tmp;
-  int index = _find_bview_at(ctx, offset);
-
-  if (index == -1) return;
 
-  int a = 0;
-  CDL_FOREACH2(ctx->editor->all_bviews, bview_tmp, all_next) {
-    if (EON_BVIEW_IS_EDIT(bview_tmp)) {
-      if (a++ == index) {
-        editor_set_active(ctx->editor, bview_tmp);
-      }
-    }
+  if ((bview_tmp = editor_tab_at(ctx->editor, _find_bview_at(ctx, offset)))) {
+    editor_set_active(ctx->editor, bview_tmp);
   }
 }
 
 static void _close_bview_at(cmd_context_t * ctx, int offset) {
-  int bview_count = _get_bview_count(ctx);
-
-  if (bview_count <= 1) return;
-
   bview_t* bview_tmp;
-  int index = _find_bview_at(ctx, offset);
 
-  if (index == -1) return;
+  if (ctx->editor->tabs_len <= 1) return;
 
-  int a = 0;
-  CDL_FOREACH2(ctx->editor->all_bviews, bview_tmp, all_next) {
-    if (EON_BVIEW_IS_EDIT(bview_tmp)) {
-      if (a++ == index && (!bview_tmp->buffer->is_unsaved || EON_BVIEW_IS_MENU(bview_tmp))) {
-        editor_close_bview(ctx->editor, bview_tmp, NULL);
-      }
-    }
+  if ((bview_tmp = editor_tab_at(ctx->editor, _find_bview_at(ctx, offset)))
+      && (!bview_tmp->buffer->is_unsaved || EON_BVIEW_IS_MENU(bview_tmp))
+     ) {
+    editor_close_bview(ctx->editor, bview_tmp, NULL);
   }
 }
 
@@ -1307,6 +1473,19 @@ static void _handle_mouse_event(cmd_context_t* ctx, tb_event_t ev) {
   last_click.y = ev.y;
 }
 
+// Return ms until the soonest idle work is due, or -1 if none is
+static int _editor_get_idle_timeout(editor_t* editor) {
+  int chars_ms;
+  int watch_ms;
+
+  chars_ms = chars_idle_timeout(editor);
+  watch_ms = watch_idle_timeout(editor);
+
+  if (chars_ms < 0) return watch_ms;
+  if (watch_ms < 0) return chars_ms;
+  return EON_MIN(chars_ms, watch_ms);
+}
+
 // Get user input
 static void _editor_get_user_input(editor_t* editor, cmd_context_t* ctx) {
   int rc;
@@ -1445,10 +1624,14 @@ static cmd_t* _editor_get_command(editor_t* editor, cmd_context_t* ctx, kinput_t
 
   // Look for key binding
   while (kmap_node) {
+    if (kmap_node->kmap->is_flat_dirty || !kmap_node->kmap->flat) {
+      _editor_compile_kmap(editor, kmap_node->kmap);
+    }
+
     if (is_top) node = kmap_node->kmap->bindings;
 
     again = 0;
-    binding = _editor_get_kbinding_node(node, input, loop_ctx, is_peek, &again);
+    binding = _editor_get_kbinding_node(node, node == kmap_node->kmap->bindings ? kmap_node->kmap->flat : NULL, input, loop_ctx, is_peek, &again);
 
     if (binding) {
       if (again) {
@@ -1509,19 +1692,17 @@ static cmd_t* _editor_get_command(editor_t* editor, cmd_context_t* ctx, kinput_t
   return NULL;
 }
 
-// Find binding by input in trie, taking into account numeric and wildcards patterns
-static kbinding_t* _editor_get_kbinding_node(kbinding_t* node, kinput_t* input, loop_context_t* loop_ctx, int is_peek, int* ret_again) {
+// Find binding by input in trie, taking into account numeric and wildcards patterns.
+// opt_flat is the dispatch table of node if it is the top of a kmap.
+static kbinding_t* _editor_get_kbinding_node(kbinding_t* node, kbinding_t** opt_flat, kinput_t* input, loop_context_t* loop_ctx, int is_peek, int* ret_again) {
   kbinding_t* binding;
-  kinput_t input_tmp;
-  memset(&input_tmp, 0, sizeof(kinput_t));
+  int slot;
 
   if (!is_peek) {
-    // Look for numeric .. TODO can be more efficient about this
+    // Look for numeric
     if (input->ch >= '0' && input->ch <= '9') {
       if (!loop_ctx->numeric_node) {
-        input_tmp = EON_KINPUT_NUMERIC;
-        HASH_FIND(hh, node->children, &input_tmp, sizeof(kinput_t), binding);
-        loop_ctx->numeric_node = binding;
+        loop_ctx->numeric_node = node->numeric_child;
       }
 
       if (loop_ctx->numeric_node) {
@@ -1544,6 +1725,7 @@ static kbinding_t* _editor_get_kbinding_node(kbinding_t* node, kinput_t* input,
         loop_ctx->numeric_params_len += 1;
         loop_ctx->numeric_len = 0;
         node = loop_ctx->numeric_node; // Resume on numeric's children
+        opt_flat = NULL;
         loop_ctx->numeric_node = NULL;
 
       } else {
@@ -1554,8 +1736,12 @@ static kbinding_t* _editor_get_kbinding_node(kbinding_t* node, kinput_t* input,
     }
   }
 
-  // Look for input
-  HASH_FIND(hh, node->children, input, sizeof(kinput_t), binding);
+  // Look for input; plain keys are direct-indexed at the top of a kmap
+  if (opt_flat && (slot = _editor_get_flat_slot(input)) >= 0) {
+    binding = opt_flat[slot];
+  } else {
+    HASH_FIND(hh, node->children, input, sizeof(kinput_t), binding);
+  }
 
   if (binding) {
     return binding;
@@ -1563,8 +1749,7 @@ static kbinding_t* _editor_get_kbinding_node(kbinding_t* node, kinput_t* input,
 
   if (!is_peek) {
     // Look for wildcard
-    input_tmp = EON_KINPUT_WILDCARD;
-    HASH_FIND(hh, node->children, &input_tmp, sizeof(kinput_t), binding);
+    binding = node->wildcard_child;
 
     if (binding) {
       if (loop_ctx->wildcard_params_len < EON_LOOP_CTX_MAX_WILDCARD_PARAMS) {
@@ -1582,6 +1767,91 @@ static kbinding_t* _editor_get_kbinding_node(kbinding_t* node, kinput_t* input,
   return NULL;
 }
 
+// Return the index of input in a kmap dispatch table, or -1 if it has none.
+// Slots 0-127 are ASCII chars, 128-255 control keys, 256-383 termbox special
+// keys (counted down from 0xffff), repeated per meta combo.
+static int _editor_get_flat_slot(kinput_t* input) {
+  int slot;
+
+  if (input->meta >= EON_KMAP_FLAT_META) {
+    return -1;
+
+  } else if (input->ch) {
+    if (input->ch >= 128 || input->key) return -1;
+    slot = (int)input->ch;
+
+  } else if (input->key < 128) {
+    slot = 128 + input->key;
+
+  } else if (input->key > 0xffff - 128) {
+    slot = 256 + (0xffff - input->key);
+
+  } else {
+    return -1;
+  }
+
+  return input->meta * EON_KMAP_FLAT_SLOTS + slot;
+}
+
+// Compile every kmap
+static void _editor_compile_kmaps(editor_t* editor) {
+  kmap_t* kmap;
+  kmap_t* kmap_tmp;
+
+  HASH_ITER(hh, editor->kmap_map, kmap, kmap_tmp) {
+    _editor_compile_kmap(editor, kmap);
+  }
+}
+
+// Build the dispatch table of a kmap's top-level bindings, and link numeric
+// and wildcard children and resolve commands throughout its trie. Redone
+// lazily when a binding is added.
+static void _editor_compile_kmap(editor_t* editor, kmap_t* kmap) {
+  kbinding_t* binding;
+  kbinding_t* binding_tmp;
+  int slot;
+
+  if (!kmap->flat) {
+    kmap->flat = malloc(sizeof(kbinding_t*) * EON_KMAP_FLAT_SLOTS * EON_KMAP_FLAT_META);
+  }
+
+  memset(kmap->flat, 0, sizeof(kbinding_t*) * EON_KMAP_FLAT_SLOTS * EON_KMAP_FLAT_META);
+
+  HASH_ITER(hh, kmap->bindings->children, binding, binding_tmp) {
+    if ((slot = _editor_get_flat_slot(&binding->input)) >= 0) {
+      kmap->flat[slot] = binding;
+    }
+  }
+
+  _editor_compile_kbinding(editor, kmap->bindings);
+
+  if (kmap->default_cmd_name) {
+    _editor_resolve_cmd(editor, &kmap->default_cmd, kmap->default_cmd_name);
+  }
+
+  kmap->is_flat_dirty = 0;
+}
+
+// Link sentinel children and resolve leaf commands under node
+static void _editor_compile_kbinding(editor_t* editor, kbinding_t* node) {
+  kbinding_t* binding;
+  kbinding_t* binding_tmp;
+  kinput_t input_tmp;
+
+  input_tmp = EON_KINPUT_NUMERIC;
+  HASH_FIND(hh, node->children, &input_tmp, sizeof(kinput_t), node->numeric_child);
+  input_tmp = EON_KINPUT_WILDCARD;
+  HASH_FIND(hh, node->children, &input_tmp, sizeof(kinput_t), node->wildcard_child);
+
+  if (node->is_leaf && node->cmd_name) {
+    _editor_resolve_cmd(editor, &node->cmd, node->cmd_name);
+  }
+
+  HASH_ITER(hh, node->children, binding, binding_tmp) {
+    _editor_compile_kbinding(editor, binding);
+  }
+}
+
 // Resolve a potentially unresolved cmd by name
 static cmd_t* _editor_resolve_cmd(editor_t* editor, cmd_t** rcmd, char* cmd_name) {
   cmd_t* tcmd;
@@ -1698,6 +1968,10 @@ static void _editor_register_cmds(editor_t* editor) {
   _editor_register_cmd_fn(editor, "cmd_delete_word_before", cmd_delete_word_before);
   _editor_register_cmd_fn(editor, "cmd_drop_cursor_column", cmd_drop_cursor_column);
   _editor_register_cmd_fn(editor, "cmd_drop_sleeping_cursor", cmd_drop_sleeping_cursor);
+  _editor_register_cmd_fn(editor, "cmd_dump_trace", cmd_dump_trace);
+  _editor_register_cmd_fn(editor, "cmd_find_all", cmd_find_all);
+  _editor_register_cmd_fn(editor, "cmd_find_all_next", cmd_find_all_next);
+  _editor_register_cmd_fn(editor, "cmd_find_all_prev", cmd_find_all_prev);
   _editor_register_cmd_fn(editor, "cmd_find_word", cmd_find_word);
   _editor_register_cmd_fn(editor, "cmd_fsearch", cmd_fsearch);
   _editor_register_cmd_fn(editor, "cmd_grep", cmd_grep);
@@ -1749,6 +2023,8 @@ static void _editor_register_cmds(editor_t* editor) {
   _editor_register_cmd_fn(editor, "cmd_split_vertical", cmd_split_vertical);
   _editor_register_cmd_fn(editor, "cmd_toggle_mouse_mode", cmd_toggle_mouse_mode);
   _editor_register_cmd_fn(editor, "cmd_toggle_anchor", cmd_toggle_anchor);
+  _editor_register_cmd_fn(editor, "cmd_toggle_trace", cmd_toggle_trace);
+  _editor_register_cmd_fn(editor, "cmd_toggle_follow", cmd_toggle_follow);
   _editor_register_cmd_fn(editor, "cmd_select_bol", cmd_select_bol);
   _editor_register_cmd_fn(editor, "cmd_select_eol", cmd_select_eol);
   _editor_register_cmd_fn(editor, "cmd_select_beginning", cmd_select_beginning);
@@ -1764,6 +2040,7 @@ static void _editor_register_cmds(editor_t* editor) {
   _editor_register_cmd_fn(editor, "cmd_new_cursor_up", cmd_new_cursor_up);
   _editor_register_cmd_fn(editor, "cmd_new_cursor_down", cmd_new_cursor_down);
   _editor_register_cmd_fn(editor, "cmd_uncut", cmd_uncut);
+  _editor_register_cmd_fn(editor, "cmd_uncut_prev", cmd_uncut_prev);
   _editor_register_cmd_fn(editor, "cmd_undo", cmd_undo);
   _editor_register_cmd_fn(editor, "cmd_viewport_top", cmd_viewport_top);
   _editor_register_cmd_fn(editor, "cmd_viewport_mid", cmd_viewport_mid);
@@ -1836,6 +2113,9 @@ static void _editor_init_kmaps(editor_t* editor) {
     EON_KBINDING_DEF("cmd_search_next", "F3"),
     EON_KBINDING_DEF("cmd_find_word", "C-v"),
     EON_KBINDING_DEF("cmd_isearch", "C-f"),
+    EON_KBINDING_DEF("cmd_find_all", "M-x f"),
+    EON_KBINDING_DEF("cmd_find_all_next", "F4"),
+    EON_KBINDING_DEF("cmd_find_all_prev", "F5"),
     EON_KBINDING_DEF("cmd_replace", "C-r"),
     EON_KBINDING_DEF("cmd_cut", "C-k"),
     // EON_KBINDING_DEF("cmd_cut", "M-c"),
@@ -1844,6 +2124,7 @@ static void _editor_init_kmaps(editor_t* editor) {
     EON_KBINDING_DEF("cmd_copy", "C-c"),
     EON_KBINDING_DEF("cmd_uncut", "C-u"),
     EON_KBINDING_DEF("cmd_uncut", "C-v"),
+    EON_KBINDING_DEF("cmd_uncut_prev", "M-u"),
     EON_KBINDING_DEF("cmd_redraw", "M-x l"),
     EON_KBINDING_DEF("cmd_less", "M-l"),
     EON_KBINDING_DEF("cmd_viewport_top", "M--"),
@@ -1851,6 +2132,9 @@ static void _editor_init_kmaps(editor_t* editor) {
     EON_KBINDING_DEF("cmd_viewport_bot", "M-="),
     EON_KBINDING_DEF("cmd_push_kmap", "M-x p"),
     EON_KBINDING_DEF("cmd_pop_kmap", "M-x P"),
+    EON_KBINDING_DEF("cmd_toggle_trace", "M-x t"),
+    EON_KBINDING_DEF("cmd_dump_trace", "M-x T"),
+    EON_KBINDING_DEF("cmd_toggle_follow", "M-x F"),
     // EON_KBINDING_DEF_EX("cmd_copy_by", "C-c d", "bracket"),
     // EON_KBINDING_DEF_EX("cmd_copy_by", "C-c w", "word"),
     // EON_KBINDING_DEF_EX("cmd_copy_by", "C-c s", "word_back"),
@@ -2061,6 +2345,7 @@ static void _editor_init_kmap_add_binding(editor_t* editor, kmap_t* kmap, kbindi
   char* cur_key_patt;
   cur_key_patt = strdup(binding_def->key_patt);
   _editor_init_kmap_add_binding_to_trie(&kmap->bindings->children, binding_def->cmd_name, cur_key_patt, binding_def->key_patt, binding_def->static_param);
+  kmap->is_flat_dirty = 1;
 
   if (strcmp(binding_def->cmd_name, "cmd_show_help") == 0) {
     // TODO kind of hacky
@@ -2489,7 +2774,7 @@ static int _editor_init_from_args(editor_t* editor, int argc, char** argv) {
   cur_syntax = NULL;
   optind = 0;
 
-  while (rv == EON_OK && (c = getopt(argc, argv, "ha:b:c:gn:H:i:K:k:l:M:m:Nn:p:S:s:t:vw:y:z:")) != -1) {
+  while (rv == EON_OK && (c = getopt(argc, argv, EON_OPTSTRING)) != -1) {
     switch (c) {
     case 'h':
       printf("eon version %s\n\n", EON_VERSION);
@@ -2497,21 +2782,30 @@ static int _editor_init_from_args(editor_t* editor, int argc, char** argv) {
       printf("    -h           Show this message\n");
       printf("    -a <1|0>     Enable/disable tab_to_space (default: %d)\n", EON_DEFAULT_TAB_TO_SPACE);
       printf("    -b <1|0>     Enable/disbale highlight bracket pairs (default: %d)\n", EON_DEFAULT_HILI_BRACKET_PAIRS);
+      printf("    -C <bytes>   Set decoded line memory cap, 0 to disable (default: %d)\n", EON_DEFAULT_CHARS_MAX_BYTES);
       printf("    -c <column>  Color column\n");
+      printf("    -e           Open files in an eon that is already running, if any\n");
+      printf("    -E           Like -e, and wait until the files are closed there\n");
       printf("    -g           Disable mouse\n");
       printf("    -H <1|0>     Enable/disable headless mode (default: 1 if no tty, else 0)\n");
       printf("    -i <1|0>     Enable/disable smart_indent (default: %d)\n", EON_DEFAULT_SMART_INDENT);
+      printf("    -j <1|0>     Enable/disable crash recovery journal (default: %d)\n", EON_DEFAULT_USE_JOURNAL);
       printf("    -K <kdef>    Set current kmap definition (use with -k)\n");
       printf("    -k <kbind>   Add key binding to current kmap definition (use with -K)\n");
+      printf("    -L <1|0>     Enable/disable taking files from -e/-E invocations (default: %d)\n", EON_DEFAULT_USE_SERVER);
       printf("    -l <ltype>   Set linenum type (default: 0)\n");
       printf("    -M <macro>   Add a macro\n");
       printf("    -m <key>     Set macro toggle key (default: %s)\n", EON_DEFAULT_MACRO_TOGGLE_KEY);
       printf("    -N           Skip reading of rc file\n");
       printf("    -n <kmap>    Set init kmap (default: eon_normal)\n");
+      printf("    -o <1|0>     Enable/disable synchronized terminal output (default: %d)\n", EON_DEFAULT_SYNC_OUTPUT);
       printf("    -p <macro>   Set startup macro\n");
+      printf("    -r <1|0>     Enable/disable reloading files changed on disk (default: %d)\n", EON_DEFAULT_AUTO_RELOAD);
       printf("    -S <syndef>  Set current syntax definition (use with -s)\n");
       printf("    -s <synrule> Add syntax rule to current syntax definition (use with -S)\n");
+      printf("    -T <path>    Record a command trace and write it to path on exit\n");
       printf("    -t <size>    Set tab size (default: %d)\n", EON_DEFAULT_TAB_WIDTH);
+      printf("    -u <bytes>   Set undo memory cap, 0 to disable (default: %d)\n", EON_DEFAULT_UNDO_MAX_BYTES);
       printf("    -v           Print version and exit\n");
       printf("    -w <1|0>     Enable/disable soft word wrap (default: %d)\n", EON_DEFAULT_SOFT_WRAP);
       printf("    -y <syntax>  Set override syntax for files opened at start up\n");
@@ -2539,10 +2833,19 @@ static int _editor_init_from_args(editor_t* editor, int argc, char** argv) {
       editor->highlight_bracket_pairs = atoi(optarg) ? 1 : 0;
       break;
 
+    case 'C':
+      editor->chars_max_bytes = (size_t)strtoull(optarg, NULL, 10);
+      break;
+
     case 'c':
       editor->color_col = atoi(optarg);
       break;
 
+    case 'E':
+    case 'e':
+      // See server_forward
+      break;
+
     case 'g':
       editor->no_mouse = 1;
       break;
@@ -2555,6 +2858,10 @@ static int _editor_init_from_args(editor_t* editor, int argc, char** argv) {
       editor->smart_indent = atoi(optarg) ? 1 : 0;
       break;
 
+    case 'j':
+      editor->use_journal = atoi(optarg) ? 1 : 0;
+      break;
+
     case 'K':
       if (_editor_init_kmap_by_str(editor, &cur_kmap, optarg) != EON_OK) {
         EON_LOG_ERR("Could not init kmap by str: %s\n", optarg);
@@ -2571,6 +2878,10 @@ static int _editor_init_from_args(editor_t* editor, int argc, char** argv) {
       }
       break;
 
+    case 'L':
+      editor->use_server = atoi(optarg) ? 1 : 0;
+      break;
+
     case 'l':
       editor->linenum_type = atoi(optarg);
       if (editor->linenum_type < -1 || editor->linenum_type > 2) editor->linenum_type = 0;
@@ -2600,10 +2911,18 @@ static int _editor_init_from_args(editor_t* editor, int argc, char** argv) {
       editor->kmap_init_name = strdup(optarg);
       break;
 
+    case 'o':
+      editor->sync_output = atoi(optarg) ? 1 : 0;
+      break;
+
     case 'p':
       editor->startup_macro_name = strdup(optarg);
       break;
 
+    case 'r':
+      editor->auto_reload = atoi(optarg) ? 1 : 0;
+      break;
+
     case 'S':
       if (_editor_init_syntax_by_str(editor, &cur_syntax, optarg) != EON_OK) {
         EON_LOG_ERR("Could not init syntax by str: %s\n", optarg);
@@ -2620,10 +2939,20 @@ static int _editor_init_from_args(editor_t* editor, int argc, char** argv) {
       }
       break;
 
+    case 'T':
+      if (editor->trace_path) free(editor->trace_path);
+      editor->trace_path = strdup(optarg);
+      trace_set_enabled(editor, 1);
+      break;
+
     case 't':
       editor->tab_width = atoi(optarg);
       break;
 
+    case 'u':
+      editor->undo_max_bytes = (size_t)strtoull(optarg, NULL, 10);
+      break;
+
     case 'v':
       printf("eon version %s\n", EON_VERSION);
       rv = EON_ERR;
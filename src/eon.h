@@ -27,10 +27,29 @@ typedef struct syntax_node_s syntax_node_t; // A node in a linked list of syntax
 typedef struct srule_def_s srule_def_t; // A definition of a syntax
 typedef struct async_proc_s async_proc_t; // An asynchronous process
 typedef void (*async_proc_cb_t)(async_proc_t* self, char* buf, size_t buf_len); // An async_proc_t callback
+typedef int (*async_proc_fn_t)(void* udata, int wfd); // A function run by async_proc_new_fn in a child
 typedef struct editor_prompt_params_s editor_prompt_params_t; // Extra params for editor_prompt
 typedef struct tb_event tb_event_t; // A termbox event
 typedef struct prompt_history_s prompt_history_t; // A map of prompt histories keyed by prompt_str
 typedef struct prompt_hnode_s prompt_hnode_t; // A node in a linked list of prompt history
+typedef struct undo_s undo_t; // Undo bookkeeping for a buffer (memory cap, spill file)
+typedef struct undo_spill_s undo_spill_t; // An action's data kept out of line (compressed in memory, or in the spill file)
+typedef struct undo_join_s undo_join_t; // An action undone and redone together with the one before it
+typedef struct journal_s journal_t; // An on-disk journal of a buffer's edits for crash recovery
+typedef struct wrap_s wrap_t; // A soft wrap index of display rows per line
+typedef struct wrap_block_s wrap_block_t; // A run of row counts in a wrap_t
+typedef struct buffer_ino_s buffer_ino_t; // An entry in the registry of open buffers keyed by inode
+typedef struct slab_s slab_t; // A free-list allocator of fixed-size objects
+typedef struct arena_s arena_t; // A bump allocator for short-lived data
+typedef struct arena_chunk_s arena_chunk_t; // A block of memory in an arena
+typedef struct arena_mark_s arena_mark_t; // A point in an arena to rewind to
+typedef struct isearch_s isearch_t; // Incremental search state of a bview (pattern, matching line index)
+typedef struct findall_s findall_t; // A sorted index of all matches of a regex in a buffer
+typedef struct findall_match_s findall_match_t; // A match in a findall_t (line index, byte offset)
+typedef struct findall_block_s findall_block_t; // A run of matches in a findall_t sharing a lazy line delta
+typedef struct kill_s kill_t; // A refcounted clip of cut or copied text
+typedef struct server_client_s server_client_t; // A connection from another eon invocation asking to open files
+typedef struct watch_s watch_t; // An inotify watch on the file of an open buffer
 typedef int (*cmd_func_t)(cmd_context_t* ctx); // A command function
 typedef int (*cb_func_t)(cmd_context_t* ctx, char * action); // A command function
 
@@ -116,6 +135,56 @@ struct editor_s {
     int bview_tab_width;
     int no_mouse;
     char * start_dir;
+    undo_t* undo_map;
+    size_t undo_max_bytes;
+    journal_t* journal_map;
+    int use_journal;
+    buffer_ino_t* buffer_ino_map;
+    buffer_ino_t* buffer_ino_by_buffer;
+    bview_t** tabs;
+    int tabs_len;
+    int tabs_cap;
+    struct tb_cell* tab_bar;
+    int tab_bar_w;
+    bview_t* tab_bar_active;
+    int is_tab_bar_dirty;
+    int trace_enabled;
+    int is_trace_overlay;
+    char* trace_path;
+    int sync_output;
+    int term_fd;
+    struct tb_cell* term_front;
+    int term_w;
+    int term_h;
+    int term_last_bytes;
+    int term_last_cells;
+    size_t chars_max_bytes;
+    uint64_t chars_next_sweep_ns;
+    int is_chars_sweep_due;
+    uint64_t chars_evictions;
+    uint64_t chars_rebuilds;
+    slab_t* cursor_slab;
+    arena_t* scratch;
+    int search_threads;
+    int is_searching;
+    int search_pct;
+    findall_t* findall_map;
+    #define EON_KILL_RING_SIZE 16
+    kill_t* kill_ring[EON_KILL_RING_SIZE];
+    int kill_ring_head;
+    int kill_ring_len;
+    int kill_ring_pos;
+    uint64_t kill_batch;
+    int kill_batch_count;
+    int use_server;
+    int server_fd;
+    char* server_path;
+    async_proc_t* server_proc;
+    server_client_t* server_clients;
+    int auto_reload;
+    int watch_fd;
+    async_proc_t* watch_proc;
+    watch_t* watch_map;
 };
 
 // srule_def_t
@@ -167,7 +236,9 @@ struct bview_s {
     bint_t viewport_x;
     bint_t viewport_x_vcol;
     bint_t viewport_y;
+    bint_t viewport_y_row;
     bline_t* viewport_bline;
+    wrap_t* wrap;
     int viewport_scope_x;
     int viewport_scope_y;
     bview_t* split_parent;
@@ -181,12 +252,27 @@ struct bview_s {
     kmap_node_t* kmap_tail;
     cursor_t* cursors;
     cursor_t* active_cursor;
+    int cursor_count;
+    int asleep_count;
+    cursor_t** cursor_index;
+    int cursor_index_len;
+    int cursor_index_cap;
     char* last_search;
-    srule_t* isearch_rule;
+    isearch_t* isearch;
     int tab_width;
     int tab_to_space;
     syntax_t* syntax;
     async_proc_t* async_proc;
+    int tab_index;
+    int tab_is_unsaved;
+    async_proc_t* save_proc;
+    char* save_path;
+    str_t save_pending;
+    int save_pct;
+    int is_save_dirty;
+    int is_save_done;
+    off_t save_journal_mark;
+    int is_following;
     cb_func_t menu_callback;
     int is_menu;
     char init_cwd[PATH_MAX + 1];
@@ -213,7 +299,8 @@ struct cursor_s {
     int is_anchored;
     int is_asleep;
     srule_t* sel_rule;
-    char* cut_buffer;
+    kill_t* kill;
+    kill_t* pasted;
     cursor_t* next;
     cursor_t* prev;
 };
@@ -258,6 +345,8 @@ struct kbinding_s {
     char* key_patt;
     int is_leaf;
     kbinding_t* children;
+    kbinding_t* numeric_child;
+    kbinding_t* wildcard_child;
     UT_hash_handle hh;
 };
 
@@ -276,6 +365,8 @@ struct kmap_s {
     int allow_fallthru;
     char* default_cmd_name;
     cmd_t* default_cmd;
+    kbinding_t** flat;
+    int is_flat_dirty;
     UT_hash_handle hh;
 };
 
@@ -336,6 +427,8 @@ struct async_proc_s {
     int wfd;
     int is_done;
     int is_solo;
+    int is_fn;
+    int is_watch;
     async_proc_cb_t callback;
     async_proc_t* next;
     async_proc_t* prev;
@@ -365,13 +458,217 @@ struct prompt_hnode_s {
     prompt_hnode_t* next;
 };
 
+// undo_t
+struct undo_s {
+    buffer_t* buffer;
+    size_t mem_bytes;
+    int spill_fd;
+    off_t spill_len;
+    off_t spill_dead;
+    undo_spill_t* spill_map;
+    undo_join_t* join_map;
+    baction_t* commit_first;
+    cmd_func_t commit_func;
+    baction_t* suspend_tail;
+    int is_replaying;
+    int is_suspended;
+    UT_hash_handle hh;
+};
+
+// undo_spill_t
+struct undo_spill_s {
+    baction_t* action;
+    char* data;
+    size_t len;
+    bint_t data_len;
+    off_t offset;
+    int is_compressed;
+    int is_live;
+    UT_hash_handle hh;
+};
+
+// undo_join_t
+struct undo_join_s {
+    baction_t* action;
+    UT_hash_handle hh;
+};
+
+// journal_t
+struct journal_s {
+    buffer_t* buffer;
+    char* src_path;
+    char* path;
+    int fd;
+    off_t base;
+    off_t size;
+    uint64_t hdr_size;
+    uint64_t hdr_mtime;
+    str_t pending;
+    str_t flushing;
+    journal_t* flush_next;
+    int is_suspended;
+    int is_failed;
+    bint_t cursor_line;
+    bint_t cursor_col;
+    UT_hash_handle hh;
+};
+
+// wrap_block_t
+struct wrap_block_s {
+    bint_t* rows;
+    bint_t len;
+    bint_t sum;
+};
+
+// wrap_t
+struct wrap_s {
+    wrap_block_t* blocks;
+    bint_t nblocks;
+    bint_t blocks_cap;
+    bint_t* line_tree;
+    bint_t* row_tree;
+    bint_t tree_cap;
+    bint_t n;
+    int w;
+    int tab_width;
+    int is_dirty;
+};
+
+// buffer_ino_t
+struct buffer_ino_s {
+    struct {
+        dev_t dev;
+        ino_t ino;
+    } key;
+    buffer_t* buffer;
+    UT_hash_handle hh;
+    UT_hash_handle hh_buffer;
+};
+
+// isearch_t
+struct isearch_s {
+    char* regex;
+    int regex_len;
+    pcre* cre;
+    bint_t* lines;
+    bint_t lines_len;
+    bint_t lines_cap;
+    bint_t match_count;
+    int is_indexed;
+    int pct;
+    bint_t byte_count;
+    baction_t* action_tail;
+    async_proc_t* count_proc;
+    str_t pending;
+};
+
+// findall_match_t
+struct findall_match_s {
+    bint_t line_index;
+    bint_t offset;
+};
+
+// findall_block_t
+struct findall_block_s {
+    findall_match_t* matches;
+    bint_t len;
+    bint_t line_delta;
+};
+
+// findall_t
+struct findall_s {
+    buffer_t* buffer;
+    char* regex;
+    pcre* cre;
+    findall_block_t* blocks;
+    bint_t nblocks;
+    bint_t blocks_cap;
+    bint_t len;
+    findall_match_t* found;
+    bint_t found_cap;
+    int is_stale;
+    bview_t* menu;
+    UT_hash_handle hh;
+};
+
+// kill_t
+struct kill_s {
+    char* data;
+    bint_t len;
+    bint_t cap;
+    bint_t nchars;
+    uint64_t batch;
+    int refs;
+};
+
+// server_client_t
+struct server_client_s {
+    editor_t* editor;
+    int fd;
+    async_proc_t* aproc;
+    str_t request;
+    int is_ready;
+    int is_handled;
+    int is_wait;
+    bview_t** bviews;
+    int bviews_len;
+    server_client_t* next;
+    server_client_t* prev;
+};
+
+// watch_t
+struct watch_s {
+    buffer_t* buffer;
+    int wd;
+    char* dir;
+    char* name;
+    async_proc_t* diff_proc;
+    str_t diff_out;
+    baction_t* diff_action_tail;
+    int is_diff_stale;
+    int is_warned;
+    int is_pending;
+    int is_append_pending;
+    UT_hash_handle hh;
+};
+
+// slab_t
+struct slab_s {
+    size_t obj_size;
+    size_t per_chunk;
+    size_t nused;
+    void* free_list;
+    void* chunks;
+};
+
+// arena_t
+struct arena_s {
+    arena_chunk_t* chunk;
+    arena_chunk_t* spare;
+    size_t chunk_size;
+    size_t nallocs;
+};
+
+// arena_mark_t
+struct arena_mark_s {
+    arena_chunk_t* chunk;
+    size_t used;
+};
+
 // editor functions
 int editor_init(editor_t* editor, int argc, char** argv);
 int editor_deinit(editor_t* editor);
 int editor_run(editor_t* editor);
+int editor_display(editor_t* editor);
 int editor_bview_edit_count(editor_t* editor);
 int editor_close_bview(editor_t* editor, bview_t* bview, int* optret_num_closed);
 int editor_count_bviews_by_buffer(editor_t* editor, buffer_t* buffer);
+buffer_t* editor_find_buffer_by_path(editor_t* editor, char* path, int path_len);
+int editor_register_buffer(editor_t* editor, buffer_t* buffer);
+int editor_unregister_buffer(editor_t* editor, buffer_t* buffer);
+int editor_tab_add(editor_t* editor, bview_t* bview);
+int editor_tab_remove(editor_t* editor, bview_t* bview);
+bview_t* editor_tab_at(editor_t* editor, int index);
 int editor_page_menu(editor_t* editor, cb_func_t callback, char* opt_buf_data, int opt_buf_data_len, async_proc_t* opt_aproc, bview_t** optret_menu);
 int editor_prompt_menu(editor_t* editor, cb_func_t callback, char* opt_buf_data, int opt_buf_data_len);
 int editor_open_bview(editor_t* editor, bview_t* parent, int type, char* opt_path, int opt_path_len, int make_active, bint_t linenum, bview_rect_t* opt_rect, buffer_t* opt_buffer, bview_t** optret_bview);
@@ -396,9 +693,12 @@ int bview_destroy(bview_t* self);
 int bview_destroy_listener(bview_t* self, bview_listener_t* listener);
 int bview_draw(bview_t* self);
 int bview_draw_cursor(bview_t* self, int set_real_cursor);
+cursor_t* bview_find_cursor(bview_t* self, bline_t* bline, bint_t col);
 int bview_get_active_cursor_count(bview_t* self);
 int bview_get_screen_coords(bview_t* self, mark_t* mark, int* ret_x, int* ret_y, struct tb_cell** optret_cell);
 int bview_max_viewport_y(bview_t* self);
+int bview_is_at_end(bview_t* self);
+int bview_merge_cursors(bview_t* self);
 int bview_open(bview_t* self, char* path, int path_len);
 int bview_pop_kmap(bview_t* bview, kmap_t** optret_kmap);
 int bview_push_kmap(bview_t* bview, kmap_t* kmap);
@@ -429,6 +729,7 @@ int cursor_select_by_word(cursor_t* cursor);
 int cursor_select_by_word_forward(cursor_t* cursor);
 int cursor_toggle_anchor(cursor_t* cursor, int use_srules);
 int cursor_uncut(cursor_t* cursor);
+int cursor_uncut_replace(cursor_t* cursor, int n);
 
 // cmd functions
 int cmd_apply_macro_by(cmd_context_t* ctx);
@@ -447,6 +748,10 @@ int cmd_delete_word_after(cmd_context_t* ctx);
 int cmd_delete_word_before(cmd_context_t* ctx);
 int cmd_drop_cursor_column(cmd_context_t* ctx);
 int cmd_drop_sleeping_cursor(cmd_context_t* ctx);
+int cmd_dump_trace(cmd_context_t* ctx);
+int cmd_find_all(cmd_context_t* ctx);
+int cmd_find_all_next(cmd_context_t* ctx);
+int cmd_find_all_prev(cmd_context_t* ctx);
 int cmd_find_word(cmd_context_t* ctx);
 int cmd_fsearch(cmd_context_t* ctx);
 int cmd_grep(cmd_context_t* ctx);
@@ -518,18 +823,145 @@ int cmd_split_horizontal(cmd_context_t* ctx);
 int cmd_split_vertical(cmd_context_t* ctx);
 int cmd_toggle_anchor(cmd_context_t* ctx);
 int cmd_toggle_mouse_mode(cmd_context_t* ctx);
+int cmd_toggle_trace(cmd_context_t* ctx);
+int cmd_toggle_follow(cmd_context_t* ctx);
 int cmd_uncut(cmd_context_t* ctx);
+int cmd_uncut_prev(cmd_context_t* ctx);
 int cmd_undo(cmd_context_t* ctx);
 int cmd_viewport_bot(cmd_context_t* ctx);
 int cmd_viewport_mid(cmd_context_t* ctx);
 int cmd_viewport_top(cmd_context_t* ctx);
 int cmd_wake_sleeping_cursors(cmd_context_t* ctx);
 
+// lz4 functions
+size_t lz4_compress_bound(size_t src_len);
+size_t lz4_compress(const char* src, size_t src_len, char* dst);
+int lz4_decompress(const char* src, size_t src_len, char* dst, size_t dst_len);
+
 // async functions
 async_proc_t* async_proc_new(editor_t* editor, void* owner, async_proc_t** owner_aproc, char* shell_cmd, int rw, async_proc_cb_t callback);
+async_proc_t* async_proc_new_fn(editor_t* editor, void* owner, async_proc_t** owner_aproc, async_proc_fn_t fn, void* udata, async_proc_cb_t callback);
+async_proc_t* async_proc_new_watch(editor_t* editor, void* owner, async_proc_t** owner_aproc, int fd, async_proc_cb_t callback);
 int async_proc_set_owner(async_proc_t* aproc, void* owner, async_proc_t** owner_aproc);
 int async_proc_destroy(async_proc_t* aproc, int preempt);
-int async_proc_drain_all(async_proc_t* aprocs, int* ttyfd);
+int async_proc_drain_all(async_proc_t* aprocs, int* ttyfd, int timeout_ms);
+
+// undo functions
+int undo_track(editor_t* editor, buffer_t* buffer, baction_t* action);
+int undo_commit(editor_t* editor, buffer_t* buffer, cmd_func_t func);
+int undo_undo(editor_t* editor, buffer_t* buffer);
+int undo_redo(editor_t* editor, buffer_t* buffer);
+baction_t* undo_peek(buffer_t* buffer, int is_redo);
+int undo_merge(buffer_t* buffer);
+int undo_join(editor_t* editor, buffer_t* buffer);
+int undo_suspend(editor_t* editor, buffer_t* buffer, int is_suspended);
+int undo_destroy(editor_t* editor, buffer_t* buffer);
+
+// journal functions
+int journal_init(editor_t* editor);
+int journal_deinit(editor_t* editor);
+int journal_record_action(editor_t* editor, buffer_t* buffer, baction_t* action);
+int journal_record_undo(editor_t* editor, buffer_t* buffer, int is_redo);
+int journal_record_merge(editor_t* editor, buffer_t* buffer);
+int journal_suspend(editor_t* editor, buffer_t* buffer, int is_suspended);
+int journal_idle(editor_t* editor);
+off_t journal_tell(editor_t* editor, buffer_t* buffer);
+int journal_rebase(editor_t* editor, buffer_t* buffer, off_t mark);
+int journal_destroy(editor_t* editor, buffer_t* buffer);
+int journal_replay(bview_t* bview);
+
+// wrap functions
+int wrap_is_enabled(bview_t* bview);
+bint_t wrap_rows_for_bline(bline_t* bline, int w);
+bint_t wrap_row_of_line(bview_t* bview, bint_t line_index);
+bint_t wrap_line_at_row(bview_t* bview, bint_t row, bint_t* optret_subrow);
+bint_t wrap_row_count(bview_t* bview);
+int wrap_update_line(bview_t* bview, bline_t* bline);
+int wrap_update_lines(bview_t* bview, baction_t* action);
+int wrap_invalidate(bview_t* bview);
+int wrap_destroy(bview_t* bview);
+
+// trace functions
+uint64_t trace_now();
+uint64_t trace_begin(editor_t* editor);
+void trace_end(editor_t* editor, const char* cat, const char* name, uint64_t start);
+void trace_end_allocs(editor_t* editor, const char* cat, const char* name, uint64_t start, uint64_t allocs);
+uint64_t trace_allocs();
+int trace_set_enabled(editor_t* editor, int is_enabled);
+int trace_draw_overlay(editor_t* editor);
+uint64_t trace_tell();
+size_t trace_collect(uint64_t mark, const char* cat, const char* opt_name, uint64_t* ret_durs, size_t max);
+int trace_dump(editor_t* editor, char* path);
+
+// term functions
+int term_render(editor_t* editor);
+int term_invalidate(editor_t* editor);
+int term_deinit(editor_t* editor);
+int term_frame_cost(struct tb_cell* front, struct tb_cell* back, int w, int h, int* optret_cells);
+
+// chars functions
+int chars_idle(editor_t* editor);
+int chars_idle_timeout(editor_t* editor);
+int chars_restore(editor_t* editor, bline_t* bline);
+
+// isearch functions
+int isearch_set_pattern(bview_t* bview, char* regex, int regex_len);
+int isearch_move(bview_t* bview, mark_t* mark, int dir, int is_inclusive);
+int isearch_get_line_matches(bview_t* bview, bline_t* bline, bint_t* ret_cols, int max);
+int isearch_update_append(bview_t* bview, baction_t* action);
+int isearch_update_tail(bview_t* bview, baction_t* old_tail);
+int isearch_end(bview_t* bview);
+
+// search functions
+int search_next(editor_t* editor, mark_t* mark, char* regex, int regex_len, int is_wrap);
+
+// findall functions
+int findall_run(editor_t* editor, bview_t* bview, char* regex, int regex_len);
+int findall_move(editor_t* editor, mark_t* mark, int dir);
+int findall_get_counts(editor_t* editor, mark_t* mark, bint_t* ret_nth, bint_t* ret_count);
+int findall_update(editor_t* editor, buffer_t* buffer, baction_t* action);
+int findall_unlink_menu(editor_t* editor, bview_t* menu);
+int findall_destroy(editor_t* editor, buffer_t* buffer);
+
+// kill functions
+kill_t* kill_new(char* data, bint_t len, uint64_t batch);
+kill_t* kill_ref(kill_t* self);
+void kill_unref(kill_t* self);
+int kill_append(kill_t* self, char* data, bint_t len);
+bint_t kill_get_nchars(kill_t* self);
+int kill_begin_batch(editor_t* editor);
+int kill_ring_push(editor_t* editor, kill_t* kill);
+kill_t* kill_ring_get(editor_t* editor, int n);
+int kill_ring_destroy(editor_t* editor);
+
+// server functions
+int server_forward(int argc, char** argv, int* ret_exit_code);
+int server_init(editor_t* editor);
+int server_idle(editor_t* editor);
+int server_unlink_bview(editor_t* editor, bview_t* bview);
+int server_deinit(editor_t* editor);
+
+// watch functions
+int watch_init(editor_t* editor);
+int watch_add(editor_t* editor, buffer_t* buffer);
+int watch_follow(editor_t* editor, buffer_t* buffer);
+int watch_destroy(editor_t* editor, buffer_t* buffer);
+int watch_idle(editor_t* editor);
+int watch_idle_timeout(editor_t* editor);
+int watch_deinit(editor_t* editor);
+
+// arena functions
+slab_t* slab_new(size_t obj_size, size_t per_chunk);
+void* slab_alloc(slab_t* self);
+void slab_free(slab_t* self, void* obj);
+int slab_destroy(slab_t* self);
+arena_t* arena_new(size_t chunk_size);
+void* arena_alloc(arena_t* self, size_t size);
+char* arena_strndup(arena_t* self, const char* str, size_t len);
+char* arena_sprintf(arena_t* self, const char* fmt, ...);
+arena_mark_t arena_tell(arena_t* self);
+int arena_rewind(arena_t* self, arena_mark_t mark);
+int arena_destroy(arena_t* self);
 
 // util functions
 const char * util_get_url(const char * url);
@@ -547,6 +979,10 @@ int util_timeval_is_gt(struct timeval* a, struct timeval* b);
 char* util_escape_shell_arg(char* str, int l);
 int rect_printf(bview_rect_t rect, int x, int y, uint16_t fg, uint16_t bg, const char *fmt, ...);
 int rect_printf_attr(bview_rect_t rect, int x, int y, const char *fmt, ...);
+int rect_fill(bview_rect_t rect, int x, int y, int w, uint32_t ch, uint16_t fg, uint16_t bg);
+int rect_put_num(bview_rect_t rect, int x, int y, int width, unsigned long long n, uint16_t fg, uint16_t bg);
+int rect_put_str(bview_rect_t rect, int x, int y, char* str, int len, uint16_t fg, uint16_t bg);
+int rect_put_cells(bview_rect_t rect, int x, int y, struct tb_cell* cells, int len);
 void str_append_stop(str_t* str, char* data, char* data_stop);
 void str_append(str_t* str, char* data);
 void str_append_len(str_t* str, char* data, size_t data_len);
@@ -584,6 +1020,12 @@ extern cmd_context_t * plugin_ctx;
 #define EON_DEFAULT_HILI_BRACKET_PAIRS 1
 #define EON_DEFAULT_READ_RC_FILE 1
 #define EON_DEFAULT_SOFT_WRAP 0
+#define EON_DEFAULT_UNDO_MAX_BYTES (64 * 1024 * 1024)
+#define EON_DEFAULT_USE_JOURNAL 1
+#define EON_DEFAULT_SYNC_OUTPUT 1
+#define EON_DEFAULT_CHARS_MAX_BYTES (128 * 1024 * 1024)
+#define EON_DEFAULT_USE_SERVER 1
+#define EON_DEFAULT_AUTO_RELOAD 1
 
 #define EON_LOG_ERR(fmt, ...) do { \
     fprintf(stderr, (fmt), __VA_ARGS__); \
@@ -626,6 +1068,8 @@ extern cmd_context_t * plugin_ctx;
 // Sentinel values for numeric and wildcard kinputs
 #define EON_KINPUT_NUMERIC (kinput_t){ 0xffffffff, 0xffff, 0x40 }
 #define EON_KINPUT_WILDCARD (kinput_t){ 0xffffffff, 0xffff, 0x80 }
+#define EON_KMAP_FLAT_SLOTS 384
+#define EON_KMAP_FLAT_META 8
 
 #define EON_LINENUM_TYPE_NONE -1
 #define EON_LINENUM_TYPE_ABS 0
@@ -639,6 +1083,40 @@ extern cmd_context_t * plugin_ctx;
 )
 
 #define EON_BRACKET_PAIR_MAX_SEARCH 10000
+#define EON_UNDO_MERGE_MAX_BYTES 64
+#define EON_UNDO_COMPRESS_MIN_BYTES 256
+#define EON_UNDO_SPILL_COMPACT_MIN (1024 * 1024)
+#define EON_JOURNAL_DIR "~/.config/eon/journal"
+#define EON_JOURNAL_SYNC_MS 1000
+#define EON_ASYNC_SAVE_MIN_BYTES (1024 * 1024)
+#define EON_SAVE_IOV_MAX 1024
+#define EON_TRACE_RING_SIZE 65536
+#define EON_TRACE_OVERLAY_ROWS 10
+#define EON_TRACE_OVERLAY_W 36
+#define EON_TRACE_DEFAULT_PATH "/tmp/eon-trace.json"
+#define EON_CHARS_SWEEP_MS 1000
+#define EON_CHARS_KEEP_LINES 256
+#define EON_CHARS_HOT_MAX 64
+#define EON_CHARS_BUCKETS 32
+#define EON_CURSOR_SLAB_SIZE 256
+#define EON_WRAP_BLOCK_SIZE 1024
+#define EON_ISEARCH_CHILD_RECS 512
+#define EON_ISEARCH_LINE_MATCHES 64
+#define EON_SEARCH_MT_MIN_LINES 100000
+#define EON_SEARCH_BLOCK_LINES 4096
+#define EON_SEARCH_MAX_THREADS 16
+#define EON_SEARCH_POLL_MS 100
+#define EON_FINDALL_INIT_CAP 64
+#define EON_FINDALL_BLOCK_SIZE 512
+#define EON_FINDALL_MENU_MAX 10000
+#define EON_FINDALL_MENU_LINE_MAX 256
+#define EON_SERVER_DIR_NAME "eon"
+#define EON_SERVER_SOCK_NAME "eon.sock"
+#define EON_SERVER_REQUEST_MAX (64 * 1024)
+#define EON_WATCH_TAIL_CHECK 4096
+#define EON_WATCH_APPEND_CHUNK (4 * 1024 * 1024)
+#define EON_OPTSTRING "ha:b:C:c:EegH:i:j:K:k:L:l:M:m:Nn:o:p:r:S:s:T:t:u:vw:y:z:"
+#define EON_SCRATCH_CHUNK_SIZE (64 * 1024)
 #define EON_RE_WORD_FORWARD "((?<=\\w)\\W|$)"
 #define EON_RE_WORD_BACK "((?<=\\W)\\w|^)"
 
@@ -0,0 +1,549 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uthash.h"
+#include "utlist.h"
+#include "eon.h"
+#include "mlbuf.h"
+
+static findall_t* _findall_get(editor_t* editor, buffer_t* buffer, int create);
+static int _findall_refresh(findall_t* self);
+static bint_t _findall_scan(findall_t* self, bline_t* bline, bint_t nlines, findall_match_t** ret_matches, bint_t* ret_cap);
+static bint_t _findall_lower_bound(findall_t* self, bint_t line_index, bint_t offset);
+static findall_match_t _findall_at(findall_t* self, bint_t i);
+static bint_t _findall_locate(findall_t* self, bint_t i, bint_t* ret_offset);
+static void _findall_splice(findall_t* self, bint_t at, bint_t nremove, findall_match_t* add, bint_t nadd, bint_t line_delta);
+static findall_block_t* _findall_splice_blocks(findall_t* self, bint_t at, bint_t nremove, bint_t nadd);
+static bint_t _findall_get_offset(mark_t* mark);
+static int _findall_open_menu(editor_t* editor, findall_t* self);
+static int _findall_menu_cb(cmd_context_t* ctx, char* action);
+
+// Find all matches of regex in bview's buffer in one pass, keep them as a
+// sorted index that follows edits, and list them in a menu
+int findall_run(editor_t* editor, bview_t* bview, char* regex, int regex_len) {
+  findall_t* self;
+  pcre* cre;
+  char* re;
+  const char* err;
+  int erroffset;
+  uint64_t trace_start;
+
+  re = strndup(regex, regex_len);
+  cre = pcre_compile(re, PCRE_NO_AUTO_CAPTURE, &err, &erroffset, NULL);
+
+  if (!cre) {
+    free(re);
+    EON_RETURN_ERR(editor, "find all: %s", err);
+  }
+
+  self = _findall_get(editor, bview->buffer, 1);
+  if (self->regex) free(self->regex);
+  if (self->cre) pcre_free(self->cre);
+  self->regex = re;
+  self->cre = cre;
+
+  trace_start = trace_begin(editor);
+  _findall_refresh(self);
+  trace_end(editor, "search", "find_all", trace_start);
+
+  if (self->len < 1) {
+    EON_SET_INFO(editor, "find all: no matches for %s", self->regex);
+    return EON_OK;
+  }
+
+  return _findall_open_menu(editor, self);
+}
+
+// Move mark to the next (dir > 0) or previous match in the index, wrapping
+// around the buffer. Return EON_OK on a match.
+int findall_move(editor_t* editor, mark_t* mark, int dir) {
+  findall_t* self;
+  findall_match_t match;
+  bline_t* bline;
+  bint_t offset;
+  bint_t col;
+  bint_t i;
+
+  if (!(self = _findall_get(editor, mark->bline->buffer, 0)) || !self->cre) {
+    EON_RETURN_ERR(editor, "%s", "find all: no results for this buffer");
+  }
+
+  if (self->is_stale) _findall_refresh(self);
+
+  if (self->len < 1) return EON_ERR;
+
+  offset = _findall_get_offset(mark);
+
+  if (dir > 0) {
+    i = _findall_lower_bound(self, mark->bline->line_index, offset + 1);
+    if (i >= self->len) i = 0;
+  } else {
+    i = _findall_lower_bound(self, mark->bline->line_index, offset) - 1;
+    if (i < 0) i = self->len - 1;
+  }
+
+  match = _findall_at(self, i);
+  buffer_get_bline(mark->bline->buffer, match.line_index, &bline);
+  MLBUF_BLINE_ENSURE_CHARS(bline);
+  bline_get_col(bline, match.offset, &col);
+  mark_move_to(mark, bline->line_index, col);
+  return EON_OK;
+}
+
+// Set ret_nth to the number of matches at or before mark and ret_count to the
+// number of matches in its buffer. Return EON_ERR if there is no index.
+int findall_get_counts(editor_t* editor, mark_t* mark, bint_t* ret_nth, bint_t* ret_count) {
+  findall_t* self;
+
+  if (!(self = _findall_get(editor, mark->bline->buffer, 0)) || !self->cre) {
+    return EON_ERR;
+  }
+
+  if (self->is_stale) _findall_refresh(self);
+
+  *ret_nth = _findall_lower_bound(self, mark->bline->line_index, _findall_get_offset(mark) + 1);
+  *ret_count = self->len;
+  return EON_OK;
+}
+
+// Keep the index current after an edit. Only lines the action touched are
+// rescanned; matches below them are shifted by its line delta, lazily per
+// block, so an edit costs the lines it touched plus O(blocks). Undo and redo
+// replay old actions, so they mark the index stale for a full rescan on next
+// use instead.
+int findall_update(editor_t* editor, buffer_t* buffer, baction_t* action) {
+  findall_t* self;
+  bline_t* bline;
+  bint_t nfound;
+  bint_t start;
+  bint_t lo;
+  bint_t hi;
+
+  if (!action || !(self = _findall_get(editor, buffer, 0)) || !self->cre || self->is_stale) {
+    return EON_OK;
+  }
+
+  if (action != buffer->action_tail || buffer->action_undone) {
+    self->is_stale = 1;
+    return EON_OK;
+  }
+
+  // Old lines start..start+removed became new lines start..start+added
+  start = action->start_line_index;
+  lo = _findall_lower_bound(self, start, 0);
+  hi = _findall_lower_bound(self, start + EON_MAX(0, -action->line_delta) + 1, 0);
+
+  if (action->start_line) {
+    bline = action->start_line;
+  } else {
+    buffer_get_bline(buffer, start, &bline);
+  }
+
+  // Rescan into a buffer kept across edits, so typing does not malloc
+  nfound = bline ? _findall_scan(self, bline, EON_MAX(0, action->line_delta) + 1, &self->found, &self->found_cap) : 0;
+
+  // Splice the rescanned matches in place of the old ones
+  _findall_splice(self, lo, hi - lo, self->found, nfound, action->line_delta);
+  return EON_OK;
+}
+
+// Forget a results menu that is being closed
+int findall_unlink_menu(editor_t* editor, bview_t* menu) {
+  findall_t* self;
+  findall_t* tmp;
+
+  HASH_ITER(hh, editor->findall_map, self, tmp) {
+    if (self->menu == menu) self->menu = NULL;
+  }
+
+  return EON_OK;
+}
+
+// Free the match index of a buffer that is about to be destroyed
+int findall_destroy(editor_t* editor, buffer_t* buffer) {
+  findall_t* self;
+
+  if (!(self = _findall_get(editor, buffer, 0))) {
+    return EON_OK;
+  }
+
+  HASH_DEL(editor->findall_map, self);
+  if (self->regex) free(self->regex);
+  if (self->cre) pcre_free(self->cre);
+  if (self->nblocks > 0) _findall_splice_blocks(self, 0, self->nblocks, 0);
+  if (self->blocks) free(self->blocks);
+  if (self->found) free(self->found);
+  free(self);
+  return EON_OK;
+}
+
+// Return the match index for a buffer, optionally creating it
+static findall_t* _findall_get(editor_t* editor, buffer_t* buffer, int create) {
+  findall_t* self;
+  HASH_FIND_PTR(editor->findall_map, &buffer, self);
+
+  if (!self && create) {
+    self = calloc(1, sizeof(findall_t));
+    self->buffer = buffer;
+    HASH_ADD_PTR(editor->findall_map, buffer, self);
+  }
+
+  return self;
+}
+
+// Rebuild the whole index
+static int _findall_refresh(findall_t* self) {
+  findall_block_t* block;
+  bint_t nfound;
+  bint_t fill;
+  bint_t i;
+
+  nfound = _findall_scan(self, self->buffer->first_line, self->buffer->line_count, &self->found, &self->found_cap);
+  fill = EON_FINDALL_BLOCK_SIZE * 3 / 4;
+
+  if (self->nblocks > 0) _findall_splice_blocks(self, 0, self->nblocks, 0);
+  block = _findall_splice_blocks(self, 0, 0, EON_MAX(1, (nfound + fill - 1) / fill));
+
+  for (i = 0; i < nfound; i++) {
+    if (block->len >= fill) block += 1;
+    block->matches[block->len++] = self->found[i];
+  }
+
+  self->len = nfound;
+  self->is_stale = 0;
+  return EON_OK;
+}
+
+// Append matches in nlines lines from bline to ret_matches, growing it as
+// needed. Offsets are bytes, so lines need not be decoded. Return the number
+// of matches.
+static bint_t _findall_scan(findall_t* self, bline_t* bline, bint_t nlines, findall_match_t** ret_matches, bint_t* ret_cap) {
+  bint_t len;
+  bint_t offset;
+  int ovector[3];
+
+  len = 0;
+
+  for (; bline && nlines > 0; bline = bline->next, nlines--) {
+    offset = 0;
+
+    while (offset <= bline->data_len
+      && pcre_exec(self->cre, NULL, bline->data, bline->data_len, offset, 0, ovector, 3) >= 0
+    ) {
+      if (len >= *ret_cap) {
+        *ret_cap = EON_MAX(*ret_cap * 2, EON_FINDALL_INIT_CAP);
+        *ret_matches = realloc(*ret_matches, sizeof(findall_match_t) * *ret_cap);
+      }
+
+      (*ret_matches)[len].line_index = bline->line_index;
+      (*ret_matches)[len].offset = ovector[0];
+      len += 1;
+
+      // Step past empty matches
+      offset = ovector[1] > ovector[0] ? ovector[1] : ovector[0] + 1;
+    }
+  }
+
+  return len;
+}
+
+// Return the index of the first match at or after line_index:offset
+static bint_t _findall_lower_bound(findall_t* self, bint_t line_index, bint_t offset) {
+  findall_block_t* block;
+  findall_match_t* match;
+  bint_t before;
+  bint_t b;
+  bint_t lo;
+  bint_t hi;
+  bint_t mid;
+
+  // Find the first block whose last match is at or after the target
+  for (b = 0, before = 0; b < self->nblocks; before += self->blocks[b++].len) {
+    block = &self->blocks[b];
+    if (block->len < 1) continue;
+    match = &block->matches[block->len - 1];
+    if (match->line_index + block->line_delta > line_index
+      || (match->line_index + block->line_delta == line_index && match->offset >= offset)
+    ) {
+      break;
+    }
+  }
+
+  if (b >= self->nblocks) {
+    return self->len;
+  }
+
+  // Then search within it. Stored line indexes are relative to its delta.
+  line_index -= block->line_delta;
+  lo = 0;
+  hi = block->len;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    match = &block->matches[mid];
+
+    if (match->line_index < line_index || (match->line_index == line_index && match->offset < offset)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return before + lo;
+}
+
+// Return match i with its block's line delta applied
+static findall_match_t _findall_at(findall_t* self, bint_t i) {
+  findall_block_t* block;
+  findall_match_t match;
+  bint_t offset;
+
+  block = &self->blocks[_findall_locate(self, i, &offset)];
+  match = block->matches[offset];
+  match.line_index += block->line_delta;
+  return match;
+}
+
+// Return the block holding match i and set ret_offset to its position in the
+// block. i == len maps past the last block.
+static bint_t _findall_locate(findall_t* self, bint_t i, bint_t* ret_offset) {
+  bint_t b;
+
+  for (b = 0; b < self->nblocks && i >= self->blocks[b].len; b++) {
+    i -= self->blocks[b].len;
+  }
+
+  *ret_offset = i;
+  return b;
+}
+
+// Replace nremove matches at index at with nadd matches from add, then shift
+// the lines of every match after them by line_delta. Blocks past the edit
+// take the shift in their delta instead of per match.
+static void _findall_splice(findall_t* self, bint_t at, bint_t nremove, findall_match_t* add, bint_t nadd, bint_t line_delta) {
+  findall_block_t* block;
+  findall_block_t* next;
+  findall_match_t* merged;
+  bint_t offset;
+  bint_t total;
+  bint_t fill;
+  bint_t count;
+  bint_t block_delta;
+  bint_t b;
+  bint_t i;
+
+  // Drop removed matches, and blocks they empty
+  while (nremove > 0) {
+    b = _findall_locate(self, at, &offset);
+    if (b >= self->nblocks) break;
+
+    block = &self->blocks[b];
+    count = EON_MIN(nremove, block->len - offset);
+    memmove(block->matches + offset, block->matches + offset + count, sizeof(findall_match_t) * (block->len - offset - count));
+    block->len -= count;
+    self->len -= count;
+    nremove -= count;
+
+    if (block->len < 1 && self->nblocks > 1) {
+      _findall_splice_blocks(self, b, 1, 0);
+    }
+  }
+
+  // Insert new matches, splitting the block if it overflows
+  b = _findall_locate(self, at, &offset);
+
+  if (b >= self->nblocks) {
+    b = self->nblocks - 1;
+    offset = self->blocks[b].len;
+  }
+
+  block = &self->blocks[b];
+
+  if (block->len + nadd <= EON_FINDALL_BLOCK_SIZE) {
+    memmove(block->matches + offset + nadd, block->matches + offset, sizeof(findall_match_t) * (block->len - offset));
+    for (i = 0; i < nadd; i++) {
+      block->matches[offset + i].line_index = add[i].line_index - block->line_delta;
+      block->matches[offset + i].offset = add[i].offset;
+    }
+    block->len += nadd;
+  } else {
+    total = block->len + nadd;
+    merged = malloc(sizeof(findall_match_t) * total);
+    memcpy(merged, block->matches, sizeof(findall_match_t) * offset);
+    for (i = 0; i < nadd; i++) {
+      merged[offset + i].line_index = add[i].line_index - block->line_delta;
+      merged[offset + i].offset = add[i].offset;
+    }
+    memcpy(merged + offset + nadd, block->matches + offset, sizeof(findall_match_t) * (block->len - offset));
+
+    fill = EON_FINDALL_BLOCK_SIZE / 2;
+    block_delta = block->line_delta;
+    block = _findall_splice_blocks(self, b, 1, (total + fill - 1) / fill);
+
+    for (count = 0; count < total; count++) {
+      if (block->len >= fill) block += 1;
+      block->line_delta = block_delta;
+      block->matches[block->len++] = merged[count];
+    }
+    free(merged);
+  }
+
+  self->len += nadd;
+
+  // Shift what follows: the rest of its block directly, later blocks lazily
+  if (line_delta != 0) {
+    b = _findall_locate(self, at + nadd, &offset);
+
+    if (b < self->nblocks) {
+      block = &self->blocks[b];
+      for (i = offset; i < block->len; i++) block->matches[i].line_index += line_delta;
+    }
+
+    for (b += 1; b < self->nblocks; b++) {
+      self->blocks[b].line_delta += line_delta;
+    }
+  }
+
+  // Merge a shrunken block with the one after it if both fit in one
+  b = _findall_locate(self, at, &offset);
+  if (b >= self->nblocks) b = self->nblocks - 1;
+
+  if (b + 1 < self->nblocks) {
+    block = &self->blocks[b];
+    next = &self->blocks[b + 1];
+
+    if (block->len + next->len <= EON_FINDALL_BLOCK_SIZE / 2) {
+      for (i = 0; i < next->len; i++) {
+        block->matches[block->len].line_index = next->matches[i].line_index + next->line_delta - block->line_delta;
+        block->matches[block->len].offset = next->matches[i].offset;
+        block->len += 1;
+      }
+      _findall_splice_blocks(self, b + 1, 1, 0);
+    }
+  }
+}
+
+// Replace nremove blocks at index at with nadd empty ones. Return the first
+// added block.
+static findall_block_t* _findall_splice_blocks(findall_t* self, bint_t at, bint_t nremove, bint_t nadd) {
+  bint_t i;
+
+  for (i = at; i < at + nremove; i++) {
+    free(self->blocks[i].matches);
+  }
+
+  if (self->nblocks - nremove + nadd > self->blocks_cap) {
+    self->blocks_cap = EON_MAX(self->blocks_cap * 2, self->nblocks - nremove + nadd);
+    self->blocks = realloc(self->blocks, sizeof(findall_block_t) * self->blocks_cap);
+  }
+
+  memmove(self->blocks + at + nadd, self->blocks + at + nremove, sizeof(findall_block_t) * (self->nblocks - at - nremove));
+  self->nblocks += nadd - nremove;
+
+  for (i = at; i < at + nadd; i++) {
+    self->blocks[i].matches = malloc(sizeof(findall_match_t) * EON_FINDALL_BLOCK_SIZE);
+    self->blocks[i].len = 0;
+    self->blocks[i].line_delta = 0;
+  }
+
+  return self->blocks + at;
+}
+
+// Return the byte offset of mark in its line
+static bint_t _findall_get_offset(mark_t* mark) {
+  MLBUF_BLINE_ENSURE_CHARS(mark->bline);
+  return mark->col < mark->bline->char_count ? mark->bline->chars[mark->col].index : mark->bline->data_len;
+}
+
+// List matches as "line:col: text" in a menu, like grep results
+static int _findall_open_menu(editor_t* editor, findall_t* self) {
+  bview_t* menu;
+  bline_t* bline;
+  findall_match_t match;
+  str_t data = {0};
+  char* line;
+  bint_t col;
+  bint_t offset;
+  bint_t b;
+  bint_t i;
+
+  bline = self->buffer->first_line;
+  b = 0;
+  offset = 0;
+
+  for (i = 0; i < self->len && i < EON_FINDALL_MENU_MAX; i++, offset++) {
+    while (offset >= self->blocks[b].len) {
+      b += 1;
+      offset = 0;
+    }
+
+    match = self->blocks[b].matches[offset];
+    match.line_index += self->blocks[b].line_delta;
+
+    while (bline && bline->line_index < match.line_index) bline = bline->next;
+    if (!bline) break;
+
+    MLBUF_BLINE_ENSURE_CHARS(bline);
+    bline_get_col(bline, match.offset, &col);
+
+    line = arena_sprintf(editor->scratch, "%lld:%lld: %.*s\n",
+      (long long)bline->line_index + 1,
+      (long long)col + 1,
+      (int)EON_MIN(bline->data_len, EON_FINDALL_MENU_LINE_MAX),
+      bline->data
+    );
+    str_append(&data, line);
+  }
+
+  if (self->len > EON_FINDALL_MENU_MAX) {
+    line = arena_sprintf(editor->scratch, "(%lld more, use find next/prev)\n", (long long)(self->len - EON_FINDALL_MENU_MAX));
+    str_append(&data, line);
+  }
+
+  editor_page_menu(editor, _findall_menu_cb, data.data, (int)data.len, NULL, &menu);
+  str_free(&data);
+
+  self->menu = menu;
+  mark_move_beginning(menu->active_cursor->mark);
+  EON_SET_INFO(editor, "find all: %lld matches", (long long)self->len);
+  return EON_OK;
+}
+
+// Jump to the match under the menu cursor
+static int _findall_menu_cb(cmd_context_t* ctx, char* action) {
+  findall_t* self;
+  findall_t* tmp;
+  bview_t* bview;
+  bline_t* bline;
+  char* line;
+  long long linenum;
+  long long colnum;
+  int rc;
+
+  if (!action) return EON_OK; // cancelled
+
+  HASH_ITER(hh, ctx->editor->findall_map, self, tmp) {
+    if (self->menu == ctx->bview) break;
+  }
+
+  if (!self) {
+    EON_RETURN_ERR(ctx->editor, "%s", "find all: buffer was closed");
+  }
+
+  bline = ctx->bview->active_cursor->mark->bline;
+  line = arena_strndup(ctx->editor->scratch, bline->data ? bline->data : "", (size_t)EON_MIN(bline->data_len, 64));
+  rc = sscanf(line, "%lld:%lld:", &linenum, &colnum);
+
+  if (rc != 2) return EON_OK;
+
+  CDL_FOREACH2(ctx->editor->all_bviews, bview, all_next) {
+    if (bview->buffer == self->buffer && EON_BVIEW_IS_EDIT(bview)) break;
+  }
+
+  if (!bview || bview->buffer != self->buffer) return EON_OK;
+
+  editor_set_active(ctx->editor, bview);
+  mark_move_to(bview->active_cursor->mark, (bint_t)linenum - 1, (bint_t)colnum - 1);
+  bview_center_viewport_y(bview);
+  return EON_OK;
+}
@@ -0,0 +1,528 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include "eon.h"
+#include "mlbuf.h"
+
+// isearch_count_job_t
+typedef struct isearch_count_job_s {
+    buffer_t* buffer;
+    pcre* cre;
+} isearch_count_job_t;
+
+static int _isearch_compile(isearch_t* self, char* regex, int regex_len);
+static int _isearch_is_narrowing(isearch_t* self, char* regex, int regex_len);
+static int _isearch_is_literal(char* regex, int regex_len);
+static int _isearch_is_index_valid(bview_t* bview);
+static void _isearch_reset_index(isearch_t* self);
+static void _isearch_filter_index(bview_t* bview);
+static int _isearch_start_count(bview_t* bview);
+static void _isearch_stop_count(isearch_t* self);
+static int _isearch_count_child(void* udata, int wfd);
+static void _isearch_aproc_count_cb(async_proc_t* aproc, char* buf, size_t buf_len);
+static void _isearch_add_line(isearch_t* self, bint_t line_index, bint_t count);
+static int _isearch_count_line(pcre* cre, bline_t* bline);
+static int _isearch_count_data(pcre* cre, char* data, bint_t data_len);
+static int _isearch_find_in_line(pcre* cre, bline_t* bline, bint_t from_col, int dir, bint_t* ret_col);
+static bline_t* _isearch_walk_to(bline_t* bline, bint_t line_index);
+static bint_t _isearch_lower_bound(isearch_t* self, bint_t line_index);
+
+// Set the isearch pattern of bview. If the new pattern only narrows the old
+// one (a literal extended by more pattern) and the buffer is fully indexed,
+// filter the matching lines we already know of. Otherwise drop the index and
+// count matches from scratch in a forked child.
+int isearch_set_pattern(bview_t* bview, char* regex, int regex_len) {
+  isearch_t* self;
+  int is_narrowing;
+
+  if (!bview->isearch) {
+    bview->isearch = calloc(1, sizeof(isearch_t));
+  }
+
+  self = bview->isearch;
+  is_narrowing = _isearch_is_index_valid(bview) && _isearch_is_narrowing(self, regex, regex_len);
+
+  if (_isearch_compile(self, regex, regex_len) != EON_OK) {
+    _isearch_stop_count(self);
+    _isearch_reset_index(self);
+    return EON_ERR;
+  }
+
+  if (is_narrowing) {
+    _isearch_filter_index(bview);
+    return EON_OK;
+  }
+
+  _isearch_stop_count(self);
+  _isearch_reset_index(self);
+  return _isearch_start_count(bview);
+}
+
+// Move mark to the next (dir > 0) or previous (dir < 0) match. With
+// is_inclusive, a match starting right at mark counts. Use the line index to
+// skip non-matching lines when we have one.
+int isearch_move(bview_t* bview, mark_t* mark, int dir, int is_inclusive) {
+  isearch_t* self;
+  bline_t* bline;
+  bint_t from_col;
+  bint_t col;
+  bint_t i;
+
+  if (!(self = bview->isearch) || !self->cre) {
+    return EON_ERR;
+  }
+
+  MLBUF_BLINE_ENSURE_CHARS(mark->bline);
+
+  // Try the rest of the current line first
+  from_col = dir > 0 ? mark->col + (is_inclusive ? 0 : 1) : mark->col - 1;
+
+  if (_isearch_find_in_line(self->cre, mark->bline, from_col, dir, &col) == EON_OK) {
+    mark_move_to(mark, mark->bline->line_index, col);
+    return EON_OK;
+  }
+
+  if (!_isearch_is_index_valid(bview)) {
+    // No index yet; scan lines the slow way
+    return (dir > 0 ? mark_move_next_cre(mark, self->cre) : mark_move_prev_cre(mark, self->cre)) == MLBUF_OK ? EON_OK : EON_ERR;
+  }
+
+  // Find the nearest indexed line past the current one
+  i = _isearch_lower_bound(self, mark->bline->line_index);
+
+  if (dir > 0) {
+    if (i < self->lines_len && self->lines[i] == mark->bline->line_index) i++;
+  } else {
+    i--;
+  }
+
+  if (i < 0 || i >= self->lines_len) {
+    return EON_ERR;
+  }
+
+  bline = _isearch_walk_to(mark->bline, self->lines[i]);
+  MLBUF_BLINE_ENSURE_CHARS(bline);
+
+  if (_isearch_find_in_line(self->cre, bline, dir > 0 ? 0 : bline->char_count, dir, &col) != EON_OK) {
+    return EON_ERR;
+  }
+
+  mark_move_to(mark, bline->line_index, col);
+  return EON_OK;
+}
+
+// Fill ret_cols with [start, end) char col pairs of the matches in bline, for
+// drawing. Return the number of matches.
+int isearch_get_line_matches(bview_t* bview, bline_t* bline, bint_t* ret_cols, int max) {
+  isearch_t* self;
+  int ovector[3];
+  int offset;
+  int n;
+
+  if (!(self = bview->isearch) || !self->cre || bline->data_len < 1) {
+    return 0;
+  }
+
+  MLBUF_BLINE_ENSURE_CHARS(bline);
+  offset = 0;
+
+  for (n = 0; n < max && offset <= bline->data_len; n++) {
+    if (pcre_exec(self->cre, NULL, bline->data, bline->data_len, offset, 0, ovector, 3) < 0) {
+      break;
+    }
+
+    bline_get_col(bline, ovector[0], &ret_cols[n * 2]);
+    bline_get_col(bline, ovector[1], &ret_cols[n * 2 + 1]);
+
+    if (ovector[1] == ovector[0]) {
+      // Nothing to draw for an empty match
+      offset = ovector[1] + 1;
+      n--;
+      continue;
+    }
+
+    offset = ovector[1];
+  }
+
+  return n;
+}
+
+// Extend the line index over text that action appended to the end of the
+// buffer, scanning only the lines it touched. Does nothing unless the index
+// was complete and current right before action.
+int isearch_update_append(bview_t* bview, baction_t* action) {
+  isearch_t* self;
+  buffer_t* buffer;
+  baction_t* prev;
+  bline_t* bline;
+  bint_t old_len;
+  int count;
+
+  buffer = bview->buffer;
+  prev = action == buffer->actions ? NULL : action->prev;
+
+  if (!(self = bview->isearch) || !self->cre || !self->is_indexed
+    || action->type != MLBUF_BACTION_TYPE_INSERT
+    || action->start_line_index + action->line_delta != buffer->line_count - 1
+    || self->action_tail != prev
+    || self->byte_count != buffer->byte_count - action->byte_delta
+  ) {
+    return EON_OK;
+  }
+
+  if (action->start_line) {
+    bline = action->start_line;
+  } else {
+    buffer_get_bline(buffer, action->start_line_index, &bline);
+  }
+
+  // The line the text went onto was indexed as it was before
+  if (self->lines_len > 0 && self->lines[self->lines_len - 1] == bline->line_index) {
+    MLBUF_BLINE_ENSURE_CHARS(bline);
+    old_len = action->start_col >= bline->char_count ? bline->data_len : bline->chars[action->start_col].index;
+    self->match_count -= _isearch_count_data(self->cre, bline->data, old_len);
+    self->lines_len -= 1;
+  }
+
+  for (; bline; bline = bline->next) {
+    if ((count = _isearch_count_line(self->cre, bline)) > 0) {
+      _isearch_add_line(self, bline->line_index, count);
+    }
+  }
+
+  self->byte_count = buffer->byte_count;
+  self->action_tail = buffer->action_tail;
+  return EON_OK;
+}
+
+// Keep an index that was current as of old_tail current after undo_suspend
+// dropped actions the index already covers from the buffer's history
+int isearch_update_tail(bview_t* bview, baction_t* old_tail) {
+  isearch_t* self;
+
+  if ((self = bview->isearch) && self->action_tail == old_tail) {
+    self->action_tail = bview->buffer->action_tail;
+  }
+
+  return EON_OK;
+}
+
+// Free isearch state of bview
+int isearch_end(bview_t* bview) {
+  isearch_t* self;
+
+  if (!(self = bview->isearch)) {
+    return EON_OK;
+  }
+
+  _isearch_stop_count(self);
+  _isearch_reset_index(self);
+  if (self->cre) pcre_free(self->cre);
+  if (self->regex) free(self->regex);
+  if (self->lines) free(self->lines);
+  free(self);
+  bview->isearch = NULL;
+  return EON_OK;
+}
+
+// Compile regex into self->cre
+static int _isearch_compile(isearch_t* self, char* regex, int regex_len) {
+  const char* err;
+  int erroffset;
+
+  if (self->cre) pcre_free(self->cre);
+  if (self->regex) free(self->regex);
+
+  self->regex = strndup(regex, regex_len);
+  self->regex_len = regex_len;
+  self->cre = pcre_compile(self->regex, PCRE_CASELESS | PCRE_NO_AUTO_CAPTURE, &err, &erroffset, NULL);
+
+  return self->cre ? EON_OK : EON_ERR;
+}
+
+// Return 1 if every match of regex contains a match of the current pattern:
+// the current pattern is a literal, and regex is it plus a suffix that does
+// not quantify its last char or add an alternative.
+static int _isearch_is_narrowing(isearch_t* self, char* regex, int regex_len) {
+  char* suffix;
+  int suffix_len;
+
+  if (!self->regex
+      || regex_len <= self->regex_len
+      || strncmp(regex, self->regex, self->regex_len) != 0
+      || !_isearch_is_literal(self->regex, self->regex_len)
+     ) {
+    return 0;
+  }
+
+  suffix = regex + self->regex_len;
+  suffix_len = regex_len - self->regex_len;
+
+  if (strchr("*+?{", suffix[0]) || memchr(suffix, '|', suffix_len)) {
+    return 0;
+  }
+
+  return 1;
+}
+
+// Return 1 if regex has no metachars
+static int _isearch_is_literal(char* regex, int regex_len) {
+  int i;
+
+  for (i = 0; i < regex_len; i++) {
+    if (strchr("\\^$.|?*+()[]{}", regex[i])) return 0;
+  }
+
+  return 1;
+}
+
+// Return 1 if the line index is complete and the buffer has not changed since
+// it was built
+static int _isearch_is_index_valid(bview_t* bview) {
+  isearch_t* self;
+  self = bview->isearch;
+
+  return self
+    && self->is_indexed
+    && self->byte_count == bview->buffer->byte_count
+    && self->action_tail == bview->buffer->action_tail ? 1 : 0;
+}
+
+// Forget indexed lines
+static void _isearch_reset_index(isearch_t* self) {
+  self->lines_len = 0;
+  self->match_count = 0;
+  self->is_indexed = 0;
+  self->pct = 0;
+  str_free(&self->pending);
+}
+
+// Keep only indexed lines that still match after narrowing the pattern
+static void _isearch_filter_index(bview_t* bview) {
+  isearch_t* self;
+  bline_t* bline;
+  bint_t i;
+  bint_t n;
+  int count;
+
+  self = bview->isearch;
+  bline = bview->buffer->first_line;
+  self->match_count = 0;
+
+  for (i = 0, n = 0; i < self->lines_len; i++) {
+    bline = _isearch_walk_to(bline, self->lines[i]);
+
+    if ((count = _isearch_count_line(self->cre, bline)) > 0) {
+      self->lines[n++] = self->lines[i];
+      self->match_count += count;
+    }
+  }
+
+  self->lines_len = n;
+}
+
+// Count matches of the current pattern in a forked child. The child scans a
+// copy-on-write snapshot of the buffer and streams back the index.
+static int _isearch_start_count(bview_t* bview) {
+  isearch_t* self;
+  isearch_count_job_t job;
+
+  self = bview->isearch;
+  job.buffer = bview->buffer;
+  job.cre = self->cre;
+  self->byte_count = bview->buffer->byte_count;
+  self->action_tail = bview->buffer->action_tail;
+
+  if (!async_proc_new_fn(bview->editor, bview, &self->count_proc, _isearch_count_child, &job, _isearch_aproc_count_cb)) {
+    return EON_ERR;
+  }
+
+  return EON_OK;
+}
+
+// Kill a running count, which is moot once the pattern changes
+static void _isearch_stop_count(isearch_t* self) {
+  if (!self->count_proc) return;
+
+  kill(self->count_proc->pid, SIGKILL);
+  async_proc_destroy(self->count_proc, 0);
+  self->count_proc = NULL;
+}
+
+// Background count (runs in the forked child). Write records of two int64s:
+// (line_index, num_matches) per matching line, (-2, pct) for progress and
+// (-1, total) when done.
+static int _isearch_count_child(void* udata, int wfd) {
+  isearch_count_job_t* job;
+  bline_t* bline;
+  int64_t recs[EON_ISEARCH_CHILD_RECS * 2];
+  int64_t total;
+  bint_t step;
+  int nrecs;
+  int count;
+
+  job = (isearch_count_job_t*)udata;
+  step = EON_MAX(1, job->buffer->line_count / 100);
+  total = 0;
+  nrecs = 0;
+
+  for (bline = job->buffer->first_line; bline; bline = bline->next) {
+    if ((count = _isearch_count_line(job->cre, bline)) > 0) {
+      recs[nrecs * 2] = (int64_t)bline->line_index;
+      recs[nrecs * 2 + 1] = count;
+      total += count;
+      nrecs += 1;
+    }
+
+    if (nrecs >= EON_ISEARCH_CHILD_RECS - 1 || bline->line_index % step == 0) {
+      recs[nrecs * 2] = -2;
+      recs[nrecs * 2 + 1] = (int64_t)(bline->line_index * 100 / EON_MAX(1, job->buffer->line_count));
+      nrecs += 1;
+
+      if (write(wfd, recs, sizeof(int64_t) * 2 * nrecs) < 0) return EON_ERR;
+
+      nrecs = 0;
+    }
+  }
+
+  recs[nrecs * 2] = -1;
+  recs[nrecs * 2 + 1] = total;
+  nrecs += 1;
+
+  return write(wfd, recs, sizeof(int64_t) * 2 * nrecs) < 0 ? EON_ERR : EON_OK;
+}
+
+// Append index records from the count child. Records may straddle reads, so
+// leftover bytes wait in self->pending.
+static void _isearch_aproc_count_cb(async_proc_t* aproc, char* buf, size_t buf_len) {
+  bview_t* bview;
+  isearch_t* self;
+  int64_t rec[2];
+  size_t off;
+
+  bview = (bview_t*)aproc->owner;
+
+  if (!(self = bview->isearch)) return;
+
+  str_append_len(&self->pending, buf, buf_len);
+
+  for (off = 0; off + sizeof(rec) <= self->pending.len; off += sizeof(rec)) {
+    memcpy(rec, self->pending.data + off, sizeof(rec));
+
+    if (rec[0] >= 0) {
+      _isearch_add_line(self, (bint_t)rec[0], (bint_t)rec[1]);
+
+    } else if (rec[0] == -2) {
+      self->pct = (int)rec[1];
+
+    } else if (rec[0] == -1) {
+      self->pct = 100;
+      self->is_indexed = 1;
+    }
+  }
+
+  if (off > 0) {
+    memmove(self->pending.data, self->pending.data + off, self->pending.len - off);
+    self->pending.len -= off;
+  }
+}
+
+// Add a matching line to the end of the index
+static void _isearch_add_line(isearch_t* self, bint_t line_index, bint_t count) {
+  if (self->lines_len + 1 > self->lines_cap) {
+    self->lines_cap = EON_MAX(1024, self->lines_cap * 2);
+    self->lines = realloc(self->lines, sizeof(bint_t) * self->lines_cap);
+  }
+
+  self->lines[self->lines_len++] = line_index;
+  self->match_count += count;
+}
+
+// Return the number of matches in bline
+static int _isearch_count_line(pcre* cre, bline_t* bline) {
+  return _isearch_count_data(cre, bline->data, bline->data_len);
+}
+
+// Return the number of matches in data
+static int _isearch_count_data(pcre* cre, char* data, bint_t data_len) {
+  int ovector[3];
+  int offset;
+  int count;
+
+  offset = 0;
+  count = 0;
+
+  while (offset <= data_len
+    && pcre_exec(cre, NULL, data, data_len, offset, 0, ovector, 3) >= 0
+  ) {
+    count += 1;
+    offset = ovector[1] > ovector[0] ? ovector[1] : ovector[1] + 1;
+  }
+
+  return count;
+}
+
+// Find the first match in bline starting at or after from_col (dir > 0), or
+// the last one starting at or before from_col (dir < 0). Set ret_col to its
+// start.
+static int _isearch_find_in_line(pcre* cre, bline_t* bline, bint_t from_col, int dir, bint_t* ret_col) {
+  int ovector[3];
+  bint_t from;
+  bint_t col;
+  int offset;
+  int is_found;
+
+  if (from_col < 0 || (dir > 0 && from_col > bline->char_count)) {
+    return EON_ERR;
+  }
+
+  from = from_col >= bline->char_count ? bline->data_len : bline->chars[from_col].index;
+  offset = dir > 0 ? (int)from : 0;
+  is_found = 0;
+
+  while (offset <= bline->data_len
+    && pcre_exec(cre, NULL, bline->data, bline->data_len, offset, 0, ovector, 3) >= 0
+  ) {
+    if (dir < 0 && ovector[0] > from) break;
+
+    bline_get_col(bline, ovector[0], &col);
+    *ret_col = col;
+    is_found = 1;
+
+    if (dir > 0) break;
+
+    offset = ovector[1] > ovector[0] ? ovector[1] : ovector[1] + 1;
+  }
+
+  return is_found ? EON_OK : EON_ERR;
+}
+
+// Walk from bline to the line at line_index
+static bline_t* _isearch_walk_to(bline_t* bline, bint_t line_index) {
+  while (bline->line_index < line_index && bline->next) bline = bline->next;
+  while (bline->line_index > line_index && bline->prev) bline = bline->prev;
+  return bline;
+}
+
+// Return the position of the first indexed line >= line_index
+static bint_t _isearch_lower_bound(isearch_t* self, bint_t line_index) {
+  bint_t lo;
+  bint_t hi;
+  bint_t mid;
+
+  lo = 0;
+  hi = self->lines_len;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+
+    if (self->lines[mid] < line_index) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
@@ -0,0 +1,780 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "uthash.h"
+#include "utlist.h"
+#include "eon.h"
+#include "mlbuf.h"
+
+// Record layout: op byte followed by varints (and raw data for inserts)
+#define EON_JOURNAL_MAGIC "EONJ\x01"
+#define EON_JOURNAL_MAGIC_LEN 5
+#define EON_JOURNAL_VARINT_MAX 10
+#define EON_JOURNAL_OP_INSERT 'I'
+#define EON_JOURNAL_OP_DELETE 'D'
+#define EON_JOURNAL_OP_UNDO 'U'
+#define EON_JOURNAL_OP_REDO 'R'
+#define EON_JOURNAL_OP_CURSOR 'C'
+#define EON_JOURNAL_OP_MERGE 'M'
+
+static void* _journal_writer(void* arg);
+static void _journal_flush_all(editor_t* editor);
+static journal_t* _journal_get(editor_t* editor, buffer_t* buffer, int create);
+static journal_t* _journal_new(editor_t* editor, buffer_t* buffer);
+static int _journal_open(journal_t* journal);
+static int _journal_get_path(char* src_path, char** ret_path);
+static int _journal_mkdir_p(char* path);
+static void _journal_write_header(journal_t* journal);
+static int _journal_write_all(int fd, char* data, size_t data_len);
+static void _journal_append(journal_t* journal, char* head, size_t head_len, char* data, size_t data_len);
+static size_t _journal_put_varint(char* buf, uint64_t val);
+static int _journal_get_varint(char** cur, char* end, uint64_t* ret_val);
+static bline_t* _journal_seek_bline(buffer_t* buffer, bline_t* hint, bint_t line_index);
+
+// Writer thread state. journal_lock guards editor->journal_map membership
+// and each journal's pending buffer; journal_io_lock is held by the writer
+// for the duration of a flush so journals cannot be freed under it. The
+// main thread never takes journal_io_lock while recording: journal files are
+// created and opened by the writer, so a keystroke only appends to memory.
+static pthread_t journal_thread;
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t journal_io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_cond = PTHREAD_COND_INITIALIZER;
+static int journal_is_kicked = 0;
+static int journal_is_stopping = 0;
+static int journal_is_running = 0;
+
+// Start the journal writer thread
+int journal_init(editor_t* editor) {
+  if (!editor->use_journal || editor->headless_mode || journal_is_running) {
+    return EON_OK;
+  }
+
+  journal_is_stopping = 0;
+
+  if (pthread_create(&journal_thread, NULL, _journal_writer, editor) != 0) {
+    EON_RETURN_ERR(editor, "Failed to start journal thread: %s", strerror(errno));
+  }
+
+  journal_is_running = 1;
+  return EON_OK;
+}
+
+// Flush outstanding records and stop the writer thread
+int journal_deinit(editor_t* editor) {
+  if (!journal_is_running) {
+    return EON_OK;
+  }
+
+  pthread_mutex_lock(&journal_lock);
+  journal_is_stopping = 1;
+  pthread_cond_signal(&journal_cond);
+  pthread_mutex_unlock(&journal_lock);
+
+  pthread_join(journal_thread, NULL);
+  journal_is_running = 0;
+  return EON_OK;
+}
+
+// Record a new buffer action
+int journal_record_action(editor_t* editor, buffer_t* buffer, baction_t* action) {
+  journal_t* journal;
+  char head[1 + 3 * EON_JOURNAL_VARINT_MAX];
+  size_t head_len;
+
+  if (!action || !(journal = _journal_get(editor, buffer, 1)) || journal->is_suspended) {
+    return EON_OK;
+  }
+
+  // The record head is built on the stack and the inserted text is copied
+  // straight from the action into the queue
+  head[0] = action->type == MLBUF_BACTION_TYPE_INSERT ? EON_JOURNAL_OP_INSERT : EON_JOURNAL_OP_DELETE;
+  head_len = 1;
+  head_len += _journal_put_varint(head + head_len, (uint64_t)action->start_line_index);
+  head_len += _journal_put_varint(head + head_len, (uint64_t)action->start_col);
+
+  if (action->type == MLBUF_BACTION_TYPE_INSERT) {
+    head_len += _journal_put_varint(head + head_len, (uint64_t)action->data_len);
+    _journal_append(journal, head, head_len, action->data, action->data_len);
+  } else {
+    head_len += _journal_put_varint(head + head_len, (uint64_t)labs((long)action->char_delta));
+    _journal_append(journal, head, head_len, NULL, 0);
+  }
+
+  return EON_OK;
+}
+
+// Record an undo or redo
+int journal_record_undo(editor_t* editor, buffer_t* buffer, int is_redo) {
+  journal_t* journal;
+  char op;
+
+  if (!(journal = _journal_get(editor, buffer, 0)) || journal->is_suspended) {
+    return EON_OK;
+  }
+
+  op = is_redo ? EON_JOURNAL_OP_REDO : EON_JOURNAL_OP_UNDO;
+  _journal_append(journal, &op, 1, NULL, 0);
+  return EON_OK;
+}
+
+// Record that the newest undo action was merged into the one before it, so
+// replay rebuilds the same undo steps
+int journal_record_merge(editor_t* editor, buffer_t* buffer) {
+  journal_t* journal;
+  char op;
+
+  if (!(journal = _journal_get(editor, buffer, 0)) || journal->is_suspended) {
+    return EON_OK;
+  }
+
+  op = EON_JOURNAL_OP_MERGE;
+  _journal_append(journal, &op, 1, NULL, 0);
+  return EON_OK;
+}
+
+// Stop or resume recording actions for a buffer (e.g., while mlbuf replays
+// its own history during undo/redo)
+int journal_suspend(editor_t* editor, buffer_t* buffer, int is_suspended) {
+  journal_t* journal;
+
+  if ((journal = _journal_get(editor, buffer, 0))) {
+    journal->is_suspended = is_suspended;
+  }
+
+  return EON_OK;
+}
+
+// Called when the editor is about to wait for input. Record the active
+// cursor if it moved and wake the writer.
+int journal_idle(editor_t* editor) {
+  journal_t* journal;
+  mark_t* mark;
+  char rec[1 + 2 * EON_JOURNAL_VARINT_MAX];
+  size_t rec_len;
+
+  if (!journal_is_running) {
+    return EON_OK;
+  }
+
+  if (editor->active_edit
+      && (journal = _journal_get(editor, editor->active_edit->buffer, 0))
+      && !journal->is_suspended
+     ) {
+    mark = editor->active_edit->active_cursor->mark;
+
+    if (mark->bline->line_index != journal->cursor_line || mark->col != journal->cursor_col) {
+      journal->cursor_line = mark->bline->line_index;
+      journal->cursor_col = mark->col;
+      rec[0] = EON_JOURNAL_OP_CURSOR;
+      rec_len = 1;
+      rec_len += _journal_put_varint(rec + rec_len, (uint64_t)journal->cursor_line);
+      rec_len += _journal_put_varint(rec + rec_len, (uint64_t)journal->cursor_col);
+      _journal_append(journal, rec, rec_len, NULL, 0);
+    }
+  }
+
+  pthread_mutex_lock(&journal_lock);
+  journal_is_kicked = 1;
+  pthread_cond_signal(&journal_cond);
+  pthread_mutex_unlock(&journal_lock);
+  return EON_OK;
+}
+
+// Return the current end of a buffer's journal records (including queued
+// ones), or -1 if it has none. Pass to journal_rebase after a background save.
+off_t journal_tell(editor_t* editor, buffer_t* buffer) {
+  journal_t* journal;
+  off_t size;
+
+  if (!(journal = _journal_get(editor, buffer, 0))) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&journal_lock);
+  size = journal->size;
+  pthread_mutex_unlock(&journal_lock);
+  return size;
+}
+
+// Rebase the journal onto the file just written to disk, keeping records made
+// at or after mark (edits made while a background save was running). A
+// negative mark keeps nothing.
+int journal_rebase(editor_t* editor, buffer_t* buffer, off_t mark) {
+  journal_t* journal;
+  char* path;
+  char* tail;
+  off_t tail_len;
+
+  if (!(journal = _journal_get(editor, buffer, 0))) {
+    return EON_OK;
+  }
+
+  pthread_mutex_lock(&journal_io_lock);
+  pthread_mutex_lock(&journal_lock);
+
+  tail = NULL;
+  tail_len = mark >= 0 && mark < journal->size ? journal->size - mark : 0;
+
+  // The header now describes the file just written, possibly at a new path
+  journal->hdr_size = (uint64_t)buffer->st.st_size;
+  journal->hdr_mtime = (uint64_t)buffer->st.st_mtime;
+
+  if (buffer->path && strcmp(buffer->path, journal->src_path) != 0) {
+    free(journal->src_path);
+    journal->src_path = strdup(buffer->path);
+  }
+
+  if (journal->fd < 0) {
+    // Not on disk yet, so every record is still queued; keep the tail
+    memmove(journal->pending.data, journal->pending.data + journal->pending.len - tail_len, tail_len);
+    journal->pending.len = tail_len;
+    journal->size = tail_len;
+    goto journal_rebase_done;
+  }
+
+  // Put queued records on disk so the kept tail can be read back
+  _journal_write_all(journal->fd, journal->pending.data, journal->pending.len);
+  journal->pending.len = 0;
+
+  if (tail_len > 0) {
+    tail = malloc(tail_len);
+
+    if (pread(journal->fd, tail, tail_len, journal->base + mark) != tail_len) {
+      tail_len = 0;
+    }
+  }
+
+  // Follow the buffer to its new path on save-as
+  if (_journal_get_path(journal->src_path, &path) == EON_OK && strcmp(path, journal->path) != 0) {
+    rename(journal->path, path);
+    free(journal->path);
+    journal->path = path;
+  } else if (path) {
+    free(path);
+  }
+
+  journal->size = 0;
+
+  if (ftruncate(journal->fd, 0) == 0) {
+    _journal_write_header(journal);
+
+    if (tail_len > 0 && _journal_write_all(journal->fd, tail, tail_len) == EON_OK) {
+      journal->size = tail_len;
+    }
+
+    fdatasync(journal->fd);
+  }
+
+  if (tail) free(tail);
+
+journal_rebase_done:
+  pthread_mutex_unlock(&journal_lock);
+  pthread_mutex_unlock(&journal_io_lock);
+  return EON_OK;
+}
+
+// Remove the journal of a buffer that is being closed
+int journal_destroy(editor_t* editor, buffer_t* buffer) {
+  journal_t* journal;
+
+  if (!(journal = _journal_get(editor, buffer, 0))) {
+    return EON_OK;
+  }
+
+  pthread_mutex_lock(&journal_io_lock);
+  pthread_mutex_lock(&journal_lock);
+  HASH_DEL(editor->journal_map, journal);
+  pthread_mutex_unlock(&journal_lock);
+  pthread_mutex_unlock(&journal_io_lock);
+
+  if (journal->path) unlink(journal->path);
+  if (journal->fd >= 0) close(journal->fd);
+  if (journal->path) free(journal->path);
+  free(journal->src_path);
+  str_free(&journal->pending);
+  str_free(&journal->flushing);
+  free(journal);
+  return EON_OK;
+}
+
+// Replay a journal left behind by a previous session onto a freshly opened
+// buffer. Return EON_OK if anything was recovered.
+int journal_replay(bview_t* bview) {
+  editor_t* editor;
+  buffer_t* buffer;
+  journal_t* journal;
+  bline_t* bline;
+  char* path;
+  char* data;
+  char* cur;
+  char* end;
+  char* good;
+  struct stat st;
+  uint64_t op_line, op_col, op_len, hdr_size, hdr_mtime;
+  bint_t cursor_line, cursor_col;
+  int fd, nrecs;
+  ssize_t nread;
+
+  editor = bview->editor;
+  buffer = bview->buffer;
+
+  if (!journal_is_running || !buffer->path || buffer->ref_count > 1 || _journal_get(editor, buffer, 0)) {
+    return EON_ERR;
+  }
+
+  if (_journal_get_path(buffer->path, &path) != EON_OK) {
+    return EON_ERR;
+  }
+
+  if ((fd = open(path, O_RDWR | O_APPEND)) < 0) {
+    free(path);
+    return EON_ERR;
+  }
+
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    // Another eon has this file open and is journaling it; leave it be
+    close(fd);
+    free(path);
+    return EON_ERR;
+  }
+
+  if (fstat(fd, &st) != 0 || st.st_size <= EON_JOURNAL_MAGIC_LEN) {
+    close(fd);
+    free(path);
+    return EON_ERR;
+  }
+
+  data = malloc(st.st_size);
+
+  for (cur = data; cur < data + st.st_size; cur += nread) {
+    if ((nread = read(fd, cur, (data + st.st_size) - cur)) <= 0) break;
+  }
+
+  end = cur;
+  cur = data;
+
+  // Only replay onto the same version of the file the journal was based on
+  if (end - cur < EON_JOURNAL_MAGIC_LEN
+      || memcmp(cur, EON_JOURNAL_MAGIC, EON_JOURNAL_MAGIC_LEN) != 0
+      || (cur += EON_JOURNAL_MAGIC_LEN, _journal_get_varint(&cur, end, &hdr_size)) != EON_OK
+      || _journal_get_varint(&cur, end, &hdr_mtime) != EON_OK
+      || hdr_size != (uint64_t)buffer->st.st_size
+      || hdr_mtime != (uint64_t)buffer->st.st_mtime
+     ) {
+    // File changed on disk since; the journal no longer applies. We hold
+    // its lock, so no other eon is writing to it.
+    unlink(path);
+    close(fd);
+    free(path);
+    free(data);
+    return EON_ERR;
+  }
+
+  // Keep the journal open for append so the recovered edits stay
+  // recoverable; suspend it while replaying
+  journal = _journal_new(editor, buffer);
+  journal->path = path;
+  journal->fd = fd;
+  journal->is_suspended = 1;
+  buffer_set_styles_enabled(buffer, 0);
+
+  good = cur;
+  bline = NULL;
+  cursor_line = -1;
+  cursor_col = 0;
+  nrecs = 0;
+
+  while (cur < end) {
+    char op = *cur++;
+
+    if (op == EON_JOURNAL_OP_INSERT) {
+      if (_journal_get_varint(&cur, end, &op_line) != EON_OK
+          || _journal_get_varint(&cur, end, &op_col) != EON_OK
+          || _journal_get_varint(&cur, end, &op_len) != EON_OK
+          || (uint64_t)(end - cur) < op_len
+          || !(bline = _journal_seek_bline(buffer, bline, (bint_t)op_line))
+         ) {
+        break;
+      }
+
+      bline_insert(bline, (bint_t)op_col, cur, (bint_t)op_len, NULL);
+      cur += op_len;
+
+    } else if (op == EON_JOURNAL_OP_DELETE) {
+      if (_journal_get_varint(&cur, end, &op_line) != EON_OK
+          || _journal_get_varint(&cur, end, &op_col) != EON_OK
+          || _journal_get_varint(&cur, end, &op_len) != EON_OK
+          || !(bline = _journal_seek_bline(buffer, bline, (bint_t)op_line))
+         ) {
+        break;
+      }
+
+      bline_delete(bline, (bint_t)op_col, (bint_t)op_len);
+
+    } else if (op == EON_JOURNAL_OP_UNDO || op == EON_JOURNAL_OP_REDO) {
+      if (op == EON_JOURNAL_OP_UNDO) {
+        buffer_undo(buffer);
+      } else {
+        buffer_redo(buffer);
+      }
+
+      // Lines touched by undo/redo may be gone; restart seeks from the top
+      bline = NULL;
+
+    } else if (op == EON_JOURNAL_OP_MERGE) {
+      undo_merge(buffer);
+
+    } else if (op == EON_JOURNAL_OP_CURSOR) {
+      if (_journal_get_varint(&cur, end, &op_line) != EON_OK
+          || _journal_get_varint(&cur, end, &op_col) != EON_OK
+         ) {
+        break;
+      }
+
+      cursor_line = (bint_t)op_line;
+      cursor_col = (bint_t)op_col;
+      good = cur;
+      continue;
+
+    } else {
+      // Torn or unknown record; keep what we have
+      break;
+    }
+
+    good = cur;
+    nrecs += 1;
+  }
+
+  // Drop a torn tail so new records append after the last intact one
+  if (good < end && ftruncate(journal->fd, good - data) != 0) {
+    journal->is_suspended = 1;
+  } else {
+    journal->is_suspended = 0;
+  }
+
+  // New records go after the recovered ones
+  pthread_mutex_lock(&journal_lock);
+  journal->base = good - data;
+  pthread_mutex_unlock(&journal_lock);
+
+  free(data);
+  buffer_set_styles_enabled(buffer, 1);
+
+  if (cursor_line >= 0) {
+    mark_move_to(bview->active_cursor->mark, cursor_line, cursor_col);
+  }
+
+  if (nrecs < 1) {
+    return EON_ERR;
+  }
+
+  EON_SET_INFO(editor, "Recovered %d unsaved edits from journal", nrecs);
+  return EON_OK;
+}
+
+// Writer thread: wait to be kicked, flush, then rate-limit fsyncs
+static void* _journal_writer(void* arg) {
+  editor_t* editor;
+  struct timespec interval;
+  int is_stopping;
+
+  editor = (editor_t*)arg;
+  interval.tv_sec = EON_JOURNAL_SYNC_MS / 1000;
+  interval.tv_nsec = (EON_JOURNAL_SYNC_MS % 1000) * 1000000L;
+
+  do {
+    pthread_mutex_lock(&journal_lock);
+
+    while (!journal_is_kicked && !journal_is_stopping) {
+      pthread_cond_wait(&journal_cond, &journal_lock);
+    }
+
+    journal_is_kicked = 0;
+    is_stopping = journal_is_stopping;
+    pthread_mutex_unlock(&journal_lock);
+
+    _journal_flush_all(editor);
+
+    if (!is_stopping) nanosleep(&interval, NULL);
+  } while (!is_stopping);
+
+  return NULL;
+}
+
+// Write and fsync pending records of every journal, opening journal files
+// on first use
+static void _journal_flush_all(editor_t* editor) {
+  journal_t* journal;
+  journal_t* journal_tmp;
+  journal_t* flush_list;
+  str_t swap;
+
+  pthread_mutex_lock(&journal_io_lock);
+
+  // Grab pending records; the main thread keeps appending to a fresh buffer.
+  // The main thread may add journals meanwhile, so walk a list of our own.
+  flush_list = NULL;
+  pthread_mutex_lock(&journal_lock);
+  HASH_ITER(hh, editor->journal_map, journal, journal_tmp) {
+    if (journal->pending.len < 1) continue;
+    swap = journal->flushing;
+    journal->flushing = journal->pending;
+    journal->pending = swap;
+    journal->pending.len = 0;
+    journal->flush_next = flush_list;
+    flush_list = journal;
+  }
+  pthread_mutex_unlock(&journal_lock);
+
+  for (journal = flush_list; journal; journal = journal->flush_next) {
+    if (journal->fd < 0 && _journal_open(journal) != EON_OK) {
+      // Stop queueing records that can never be written
+      pthread_mutex_lock(&journal_lock);
+      journal->is_failed = 1;
+      journal->pending.len = 0;
+      pthread_mutex_unlock(&journal_lock);
+      journal->flushing.len = 0;
+      continue;
+    }
+
+    _journal_write_all(journal->fd, journal->flushing.data, journal->flushing.len);
+    journal->flushing.len = 0;
+    fdatasync(journal->fd);
+  }
+
+  pthread_mutex_unlock(&journal_io_lock);
+}
+
+// Find (or create) the journal for a buffer. A new journal only queues
+// records in memory; the writer thread creates its file on first flush.
+static journal_t* _journal_get(editor_t* editor, buffer_t* buffer, int create) {
+  journal_t* journal;
+
+  HASH_FIND_PTR(editor->journal_map, &buffer, journal);
+
+  if (journal || !create || !journal_is_running || !buffer->path) {
+    return journal;
+  }
+
+  return _journal_new(editor, buffer);
+}
+
+// Add an unopened journal for buffer to the map
+static journal_t* _journal_new(editor_t* editor, buffer_t* buffer) {
+  journal_t* journal;
+
+  journal = calloc(1, sizeof(journal_t));
+  journal->buffer = buffer;
+  journal->src_path = strdup(buffer->path);
+  journal->hdr_size = (uint64_t)buffer->st.st_size;
+  journal->hdr_mtime = (uint64_t)buffer->st.st_mtime;
+  journal->fd = -1;
+  journal->cursor_line = -1;
+
+  pthread_mutex_lock(&journal_lock);
+  HASH_ADD_PTR(editor->journal_map, buffer, journal);
+  pthread_mutex_unlock(&journal_lock);
+  return journal;
+}
+
+// Create and lock the file of a journal. Called by the writer thread with
+// journal_io_lock held. A journal that was replayed is already open, so
+// anything in the file is not ours (e.g. left by an eon that crashed after
+// we opened the buffer) and is truncated rather than appended to.
+static int _journal_open(journal_t* journal) {
+  char* path;
+  int fd;
+
+  if (journal->is_failed || _journal_get_path(journal->src_path, &path) != EON_OK) {
+    return EON_ERR;
+  }
+
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600)) < 0) {
+    free(path);
+    return EON_ERR;
+  }
+
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    // Another eon is journaling this file
+    close(fd);
+    free(path);
+    return EON_ERR;
+  }
+
+  if (ftruncate(fd, 0) != 0) {
+    close(fd);
+    free(path);
+    return EON_ERR;
+  }
+
+  journal->path = path;
+  journal->fd = fd;
+  _journal_write_header(journal);
+  return EON_OK;
+}
+
+// Get journal path for the file at src_path, named after a hash of its
+// absolute path
+static int _journal_get_path(char* src_path, char** ret_path) {
+  char* dir;
+  char* abs_path;
+  char* p;
+  uint64_t hash;
+
+  *ret_path = NULL;
+
+  if (!src_path) {
+    return EON_ERR;
+  }
+
+  util_expand_tilde(EON_JOURNAL_DIR, strlen(EON_JOURNAL_DIR), &dir);
+
+  if (_journal_mkdir_p(dir) != EON_OK) {
+    free(dir);
+    return EON_ERR;
+  }
+
+  // FNV-1a
+  abs_path = realpath(src_path, NULL);
+  hash = 14695981039346656037ULL;
+
+  for (p = abs_path ? abs_path : src_path; *p; p++) {
+    hash ^= (unsigned char)*p;
+    hash *= 1099511628211ULL;
+  }
+
+  if (asprintf(ret_path, "%s/%016llx", dir, (unsigned long long)hash) < 0) {
+    *ret_path = NULL;
+  }
+
+  if (abs_path) free(abs_path);
+  free(dir);
+  return *ret_path ? EON_OK : EON_ERR;
+}
+
+// mkdir -p
+static int _journal_mkdir_p(char* path) {
+  char* tmp;
+  char* p;
+  int rc;
+
+  tmp = strdup(path);
+  rc = EON_OK;
+
+  for (p = tmp + 1; ; p++) {
+    if (*p == '/' || *p == '\0') {
+      char c = *p;
+      *p = '\0';
+
+      if (mkdir(tmp, 0700) != 0 && errno != EEXIST) {
+        rc = EON_ERR;
+        break;
+      }
+
+      *p = c;
+      if (c == '\0') break;
+    }
+  }
+
+  free(tmp);
+  return rc;
+}
+
+// Write journal header (magic, size and mtime of the file on disk)
+static void _journal_write_header(journal_t* journal) {
+  char hdr[EON_JOURNAL_MAGIC_LEN + 2 * EON_JOURNAL_VARINT_MAX];
+  size_t hdr_len;
+
+  memcpy(hdr, EON_JOURNAL_MAGIC, EON_JOURNAL_MAGIC_LEN);
+  hdr_len = EON_JOURNAL_MAGIC_LEN;
+  hdr_len += _journal_put_varint(hdr + hdr_len, journal->hdr_size);
+  hdr_len += _journal_put_varint(hdr + hdr_len, journal->hdr_mtime);
+  _journal_write_all(journal->fd, hdr, hdr_len);
+  journal->base = hdr_len;
+}
+
+// write(2) until done or error
+static int _journal_write_all(int fd, char* data, size_t data_len) {
+  size_t written;
+  ssize_t nbytes;
+
+  for (written = 0; written < data_len; written += nbytes) {
+    if ((nbytes = write(fd, data + written, data_len - written)) <= 0) {
+      return EON_ERR;
+    }
+  }
+
+  return EON_OK;
+}
+
+// Queue a record (head followed by data, if any) for the writer thread
+static void _journal_append(journal_t* journal, char* head, size_t head_len, char* data, size_t data_len) {
+  pthread_mutex_lock(&journal_lock);
+
+  if (journal->is_failed) {
+    pthread_mutex_unlock(&journal_lock);
+    return;
+  }
+
+  str_append_len(&journal->pending, head, head_len);
+  if (data_len > 0) str_append_len(&journal->pending, data, data_len);
+  journal->size += head_len + data_len;
+  pthread_mutex_unlock(&journal_lock);
+}
+
+// Write a LEB128 varint to buf and return its length (at most
+// EON_JOURNAL_VARINT_MAX)
+static size_t _journal_put_varint(char* buf, uint64_t val) {
+  size_t len;
+
+  len = 0;
+
+  do {
+    buf[len] = (char)(val & 0x7f);
+    val >>= 7;
+    if (val) buf[len] |= 0x80;
+    len += 1;
+  } while (val);
+
+  return len;
+}
+
+// Read a LEB128 varint
+static int _journal_get_varint(char** cur, char* end, uint64_t* ret_val) {
+  uint64_t val;
+  int shift;
+  unsigned char c;
+
+  val = 0;
+
+  for (shift = 0; *cur < end && shift < 64; shift += 7) {
+    c = (unsigned char)*(*cur)++;
+    val |= (uint64_t)(c & 0x7f) << shift;
+
+    if (!(c & 0x80)) {
+      *ret_val = val;
+      return EON_OK;
+    }
+  }
+
+  return EON_ERR;
+}
+
+// Walk to line_index from a nearby bline instead of from the top each time
+static bline_t* _journal_seek_bline(buffer_t* buffer, bline_t* hint, bint_t line_index) {
+  if (!hint) hint = buffer->first_line;
+
+  while (hint && hint->line_index < line_index) hint = hint->next;
+  while (hint && hint->line_index > line_index) hint = hint->prev;
+
+  return hint;
+}
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+#include "eon.h"
+#include "mlbuf.h"
+
+// Return a clip holding data, which it takes ownership of. The clip starts
+// with one reference.
+kill_t* kill_new(char* data, bint_t len, uint64_t batch) {
+  kill_t* self;
+  self = calloc(1, sizeof(kill_t));
+  self->data = data;
+  self->len = len;
+  self->cap = len;
+  self->nchars = -1;
+  self->batch = batch;
+  self->refs = 1;
+  return self;
+}
+
+// Take a reference to a clip
+kill_t* kill_ref(kill_t* self) {
+  self->refs += 1;
+  return self;
+}
+
+// Drop a reference to a clip, freeing it with the last one
+void kill_unref(kill_t* self) {
+  if (--self->refs > 0) return;
+
+  if (self->data) free(self->data);
+  free(self);
+}
+
+// Append data to a clip. Capacity doubles, so repeated appends cost
+// O(appended bytes) overall.
+int kill_append(kill_t* self, char* data, bint_t len) {
+  if (self->len + len > self->cap) {
+    self->cap = EON_MAX(self->cap * 2, self->len + len);
+    self->data = realloc(self->data, self->cap + 1);
+  }
+
+  memcpy(self->data + self->len, data, len);
+  self->len += len;
+  self->data[self->len] = '\0';
+  self->nchars = -1;
+  return EON_OK;
+}
+
+// Return the number of chars in a clip, counting them on first use
+bint_t kill_get_nchars(kill_t* self) {
+  uint32_t ch;
+  char* cur;
+  char* stop;
+
+  if (self->nchars >= 0) {
+    return self->nchars;
+  }
+
+  self->nchars = 0;
+  cur = self->data;
+  stop = self->data + self->len;
+
+  while (cur < stop) {
+    cur += EON_MAX(1, utf8_char_to_unicode(&ch, cur, stop));
+    self->nchars += 1;
+  }
+
+  return self->nchars;
+}
+
+// Start a new cut or copy. Clips made until the next batch belong together,
+// one per cursor, so a multi-cursor paste can hand each cursor its own.
+int kill_begin_batch(editor_t* editor) {
+  editor->kill_batch += 1;
+  editor->kill_batch_count = 0;
+  return EON_OK;
+}
+
+// Make a clip the newest in the kill ring, dropping the oldest if full
+int kill_ring_push(editor_t* editor, kill_t* kill) {
+  editor->kill_ring_head = (editor->kill_ring_head + 1) % EON_KILL_RING_SIZE;
+
+  if (editor->kill_ring[editor->kill_ring_head]) {
+    kill_unref(editor->kill_ring[editor->kill_ring_head]);
+  }
+
+  editor->kill_ring[editor->kill_ring_head] = kill_ref(kill);
+  editor->kill_ring_len = EON_MIN(editor->kill_ring_len + 1, EON_KILL_RING_SIZE);
+  editor->kill_ring_pos = 0;
+  return EON_OK;
+}
+
+// Return the nth newest clip in the kill ring, or NULL
+kill_t* kill_ring_get(editor_t* editor, int n) {
+  if (n < 0 || n >= editor->kill_ring_len) {
+    return NULL;
+  }
+
+  return editor->kill_ring[(editor->kill_ring_head - n + EON_KILL_RING_SIZE) % EON_KILL_RING_SIZE];
+}
+
+// Drop all clips in the kill ring
+int kill_ring_destroy(editor_t* editor) {
+  int i;
+
+  for (i = 0; i < EON_KILL_RING_SIZE; i++) {
+    if (editor->kill_ring[i]) {
+      kill_unref(editor->kill_ring[i]);
+      editor->kill_ring[i] = NULL;
+    }
+  }
+
+  editor->kill_ring_len = 0;
+  return EON_OK;
+}
@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <string.h>
+#include "eon.h"
+
+// A minimal LZ4 block format codec, used to compress old undo history. It
+// reads and writes plain LZ4 blocks (no frame header or checksums); the
+// caller keeps the uncompressed length.
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+#define LZ4_MAX_DISTANCE 65535
+#define LZ4_HASH_BITS 12
+
+static uint32_t _lz4_read32(const char* p);
+static uint32_t _lz4_hash(uint32_t seq);
+static char* _lz4_put_len(char* op, size_t len);
+
+// Return the most bytes lz4_compress can write for src_len bytes of input
+size_t lz4_compress_bound(size_t src_len) {
+  return src_len + src_len / 255 + 16;
+}
+
+// Compress src into dst, which must hold lz4_compress_bound(src_len) bytes.
+// Return the compressed length.
+size_t lz4_compress(const char* src, size_t src_len, char* dst) {
+  uint32_t table[1 << LZ4_HASH_BITS];
+  const char* ip;
+  const char* anchor;
+  const char* match;
+  const char* mf_limit;
+  const char* match_limit;
+  const char* end;
+  char* op;
+  char* token;
+  size_t lit_len;
+  size_t match_len;
+  uint32_t h;
+
+  ip = src;
+  anchor = src;
+  end = src + src_len;
+  op = dst;
+
+  if (src_len >= LZ4_MF_LIMIT + 1) {
+    memset(table, 0, sizeof(table));
+    mf_limit = end - LZ4_MF_LIMIT;
+    match_limit = end - LZ4_LAST_LITERALS;
+
+    // Position 0 is never a candidate; table entries are offsets + 1
+    ip += 1;
+
+    while (ip < mf_limit) {
+      h = _lz4_hash(_lz4_read32(ip));
+      match = table[h] ? src + table[h] - 1 : NULL;
+      table[h] = (uint32_t)(ip - src) + 1;
+
+      if (!match || ip - match > LZ4_MAX_DISTANCE || _lz4_read32(match) != _lz4_read32(ip)) {
+        ip += 1;
+        continue;
+      }
+
+      // Extend backwards over literals that also match
+      while (ip > anchor && match > src && ip[-1] == match[-1]) {
+        ip -= 1;
+        match -= 1;
+      }
+
+      // Extend forwards, leaving the last literals alone
+      match_len = LZ4_MIN_MATCH;
+      while (ip + match_len < match_limit && ip[match_len] == match[match_len]) {
+        match_len += 1;
+      }
+
+      lit_len = (size_t)(ip - anchor);
+      token = op++;
+      *token = (char)((lit_len >= 15 ? 15 : lit_len) << 4);
+      if (lit_len >= 15) op = _lz4_put_len(op, lit_len - 15);
+      memcpy(op, anchor, lit_len);
+      op += lit_len;
+
+      op[0] = (char)((ip - match) & 0xff);
+      op[1] = (char)(((ip - match) >> 8) & 0xff);
+      op += 2;
+
+      *token |= (char)(match_len - LZ4_MIN_MATCH >= 15 ? 15 : match_len - LZ4_MIN_MATCH);
+      if (match_len - LZ4_MIN_MATCH >= 15) op = _lz4_put_len(op, match_len - LZ4_MIN_MATCH - 15);
+
+      ip += match_len;
+      anchor = ip;
+    }
+  }
+
+  // Last literals
+  lit_len = (size_t)(end - anchor);
+  token = op++;
+  *token = (char)((lit_len >= 15 ? 15 : lit_len) << 4);
+  if (lit_len >= 15) op = _lz4_put_len(op, lit_len - 15);
+  memcpy(op, anchor, lit_len);
+  op += lit_len;
+
+  return (size_t)(op - dst);
+}
+
+// Decompress src into dst, which must be exactly dst_len bytes long. Return
+// EON_OK, or EON_ERR if src is malformed or does not fill dst.
+int lz4_decompress(const char* src, size_t src_len, char* dst, size_t dst_len) {
+  const uint8_t* ip;
+  const uint8_t* iend;
+  char* op;
+  char* oend;
+  size_t lit_len;
+  size_t match_len;
+  size_t offset;
+  uint8_t token;
+  uint8_t b;
+
+  ip = (const uint8_t*)src;
+  iend = ip + src_len;
+  op = dst;
+  oend = dst + dst_len;
+
+  while (ip < iend) {
+    token = *ip++;
+
+    // Literals
+    lit_len = token >> 4;
+    if (lit_len == 15) {
+      do {
+        if (ip >= iend) return EON_ERR;
+        b = *ip++;
+        lit_len += b;
+      } while (b == 255);
+    }
+
+    if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op)) {
+      return EON_ERR;
+    }
+
+    memcpy(op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+
+    if (ip >= iend) {
+      // The last sequence has literals only
+      break;
+    }
+
+    // Match
+    if (iend - ip < 2) return EON_ERR;
+    offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+
+    if (offset == 0 || offset > (size_t)(op - dst)) {
+      return EON_ERR;
+    }
+
+    match_len = (token & 15);
+    if (match_len == 15) {
+      do {
+        if (ip >= iend) return EON_ERR;
+        b = *ip++;
+        match_len += b;
+      } while (b == 255);
+    }
+    match_len += LZ4_MIN_MATCH;
+
+    if (match_len > (size_t)(oend - op)) {
+      return EON_ERR;
+    }
+
+    // Byte by byte, as the match may overlap what it writes
+    for (; match_len > 0; match_len--, op++) {
+      *op = *(op - offset);
+    }
+  }
+
+  return op == oend ? EON_OK : EON_ERR;
+}
+
+// Read 4 bytes without alignment requirements
+static uint32_t _lz4_read32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Hash 4 bytes into the match table
+static uint32_t _lz4_hash(uint32_t seq) {
+  return (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+// Write the extra bytes of a literal or match length
+static char* _lz4_put_len(char* op, size_t len) {
+  while (len >= 255) {
+    *op++ = (char)255;
+    len -= 255;
+  }
+  *op++ = (char)len;
+  return op;
+}
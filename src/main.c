@@ -14,6 +14,11 @@ int main(int argc, char** argv) {
   memset(&_editor, 0, sizeof(editor_t));
   setlocale(LC_ALL, "");
 
+  // Hand files to an eon that is already running if asked to
+  if (server_forward(argc, argv, &_editor.exit_code) == EON_OK) {
+    return _editor.exit_code;
+  }
+
   if (editor_init(&_editor, argc, argv) == EON_OK) {
 
     if (!_editor.headless_mode) {
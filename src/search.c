@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "eon.h"
+#include "mlbuf.h"
+
+// search_block_t
+typedef struct search_block_s {
+    bline_t* bline;
+    bint_t nlines;
+} search_block_t;
+
+// search_job_t
+typedef struct search_job_s {
+    pcre* cre;
+    search_block_t* blocks;
+    bint_t blocks_cap;
+    bint_t nready;
+    int is_table_done;
+    bint_t next_block;
+    bint_t blocks_done;
+    int is_cancelled;
+    int nrunning;
+    bint_t first_offset;
+    bint_t last_limit;
+    pthread_mutex_t lock;
+    bint_t found_block;
+    bline_t* found_bline;
+    bint_t found_offset;
+} search_job_t;
+
+static int _search_next_st(mark_t* mark, char* regex, int regex_len, int is_wrap);
+static int _search_next_mt(editor_t* editor, mark_t* mark, pcre* cre, int is_wrap);
+static void _search_build_blocks(search_job_t* job, bline_t* start, int is_wrap);
+static void _search_wait(editor_t* editor, search_job_t* job);
+static void* _search_worker(void* arg);
+static void _search_block(search_job_t* job, bint_t b);
+
+// Move mark to the next match of regex after it, wrapping to the start of the
+// buffer if is_wrap. Big buffers are searched by a pool of threads; the user
+// can cancel with Ctrl-C. Return EON_OK on a match.
+int search_next(editor_t* editor, mark_t* mark, char* regex, int regex_len, int is_wrap) {
+  pcre* cre;
+  char* re;
+  const char* err;
+  int erroffset;
+  int rc;
+
+  if (editor->search_threads < 2 || mark->bline->buffer->line_count < EON_SEARCH_MT_MIN_LINES) {
+    return _search_next_st(mark, regex, regex_len, is_wrap);
+  }
+
+  re = strndup(regex, regex_len);
+  cre = pcre_compile(re, PCRE_NO_AUTO_CAPTURE, &err, &erroffset, NULL);
+  free(re);
+
+  if (!cre) {
+    EON_RETURN_ERR(editor, "search: %s", err);
+  }
+
+  rc = _search_next_mt(editor, mark, cre, is_wrap);
+  pcre_free(cre);
+  return rc;
+}
+
+// Search on this thread with mlbuf
+static int _search_next_st(mark_t* mark, char* regex, int regex_len, int is_wrap) {
+  bline_t* orig_bline;
+  bint_t orig_col;
+
+  if (mark_move_next_re(mark, regex, regex_len) == MLBUF_OK) {
+    return EON_OK;
+  }
+
+  if (!is_wrap) return EON_ERR;
+
+  orig_bline = mark->bline;
+  orig_col = mark->col;
+  mark_move_beginning(mark);
+
+  if (mark_move_next_re(mark, regex, regex_len) == MLBUF_OK) {
+    return EON_OK;
+  }
+
+  mark_move_to(mark, orig_bline->line_index, orig_col);
+  return EON_ERR;
+}
+
+// Search in blocks of lines, in order from mark, on a pool of threads. The UI
+// thread only reads the buffer until the search is over, so workers see a
+// stable snapshot of line data without copying it.
+static int _search_next_mt(editor_t* editor, mark_t* mark, pcre* cre, int is_wrap) {
+  search_job_t job;
+  pthread_t threads[EON_SEARCH_MAX_THREADS];
+  bline_t* bline;
+  bint_t col;
+  uint64_t trace_start;
+  int nthreads;
+  int i;
+
+  trace_start = trace_begin(editor);
+
+  // Match after mark on its line, and up to mark on the same line if wrapping
+  bline = mark->bline;
+  MLBUF_BLINE_ENSURE_CHARS(bline);
+
+  memset(&job, 0, sizeof(search_job_t));
+  job.cre = cre;
+  job.first_offset = mark->col + 1 < bline->char_count ? bline->chars[mark->col + 1].index : bline->data_len + 1;
+  job.last_limit = mark->col < bline->char_count ? bline->chars[mark->col].index : bline->data_len;
+  job.blocks_cap = bline->buffer->line_count / EON_SEARCH_BLOCK_LINES + 3;
+  job.blocks = calloc(job.blocks_cap, sizeof(search_block_t));
+  job.found_block = -1;
+  pthread_mutex_init(&job.lock, NULL);
+
+  nthreads = EON_MIN(editor->search_threads, EON_SEARCH_MAX_THREADS);
+  job.nrunning = nthreads;
+
+  for (i = 0; i < nthreads; i++) {
+    if (pthread_create(&threads[i], NULL, _search_worker, &job) != 0) {
+      __atomic_sub_fetch(&job.nrunning, nthreads - i, __ATOMIC_RELEASE);
+      nthreads = i;
+      break;
+    }
+  }
+
+  // Workers start on the first blocks while we lay out the rest
+  _search_build_blocks(&job, bline, is_wrap);
+
+  if (nthreads < 1) {
+    // No threads; search all blocks here
+    while (!job.is_cancelled && (i = (int)job.next_block++) < job.nready) _search_block(&job, i);
+  }
+
+  editor->is_searching = 1;
+  _search_wait(editor, &job);
+  editor->is_searching = 0;
+
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&job.lock);
+  free(job.blocks);
+  trace_end(editor, "search", "search_next", trace_start);
+
+  if (job.is_cancelled) {
+    EON_SET_INFO(editor, "%s", "search: cancelled");
+    return EON_ERR;
+
+  } else if (job.found_block < 0) {
+    return EON_ERR;
+  }
+
+  MLBUF_BLINE_ENSURE_CHARS(job.found_bline);
+  bline_get_col(job.found_bline, job.found_offset, &col);
+  mark_move_to(mark, job.found_bline->line_index, col);
+  return EON_OK;
+}
+
+// Split lines into blocks in search order: from start to the end of the
+// buffer, then from the top back to start if is_wrap. Blocks are published
+// one at a time via nready.
+static void _search_build_blocks(search_job_t* job, bline_t* start, int is_wrap) {
+  search_block_t* block;
+  bline_t* bline;
+  int is_wrapped;
+
+  bline = start;
+  is_wrapped = 0;
+
+  while (bline && job->nready < job->blocks_cap && !__atomic_load_n(&job->is_cancelled, __ATOMIC_RELAXED)) {
+    block = &job->blocks[job->nready];
+    block->bline = bline;
+    block->nlines = 0;
+
+    // A block never crosses the wrap or passes start again
+    while (bline && block->nlines < EON_SEARCH_BLOCK_LINES) {
+      block->nlines += 1;
+      bline = bline->next;
+
+      if (is_wrapped && bline == start->next) {
+        bline = NULL;
+      }
+    }
+
+    __atomic_store_n(&job->nready, job->nready + 1, __ATOMIC_RELEASE);
+
+    if (!bline && is_wrap && !is_wrapped) {
+      is_wrapped = 1;
+      bline = start->buffer->first_line;
+    }
+  }
+
+  __atomic_store_n(&job->is_table_done, 1, __ATOMIC_RELEASE);
+}
+
+// Wait for workers, redrawing progress and watching for Ctrl-C. Other input
+// typed meanwhile is dropped.
+static void _search_wait(editor_t* editor, search_job_t* job) {
+  tb_event_t ev;
+
+  while (__atomic_load_n(&job->nrunning, __ATOMIC_ACQUIRE) > 0) {
+    editor->search_pct = (int)(100 * __atomic_load_n(&job->blocks_done, __ATOMIC_RELAXED) / EON_MAX(1, job->nready));
+
+    if (editor->headless_mode) {
+      usleep(EON_SEARCH_POLL_MS * 1000);
+      continue;
+    }
+
+    editor_display(editor);
+
+    if (tb_peek_event(&ev, EON_SEARCH_POLL_MS) == TB_EVENT_KEY && ev.key == TB_KEY_CTRL_C) {
+      __atomic_store_n(&job->is_cancelled, 1, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+// Claim blocks in order until the table is exhausted, a match is found in an
+// earlier block, or the search is cancelled
+static void* _search_worker(void* arg) {
+  search_job_t* job;
+  bint_t b;
+
+  job = (search_job_t*)arg;
+
+  while (!__atomic_load_n(&job->is_cancelled, __ATOMIC_RELAXED)) {
+    b = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED);
+
+    while (b >= __atomic_load_n(&job->nready, __ATOMIC_ACQUIRE)
+      && !__atomic_load_n(&job->is_table_done, __ATOMIC_ACQUIRE)
+    ) {
+      sched_yield();
+    }
+
+    if (b >= __atomic_load_n(&job->nready, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+
+    _search_block(job, b);
+  }
+
+  __atomic_sub_fetch(&job->nrunning, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+// Search block b, recording the first match if it precedes any found so far
+static void _search_block(search_job_t* job, bint_t b) {
+  search_block_t* block;
+  bline_t* bline;
+  bint_t found;
+  bint_t offset;
+  bint_t i;
+  int ovector[3];
+
+  block = &job->blocks[b];
+  bline = block->bline;
+
+  for (i = 0; i < block->nlines; i++, bline = bline->next) {
+    if (i % 256 == 0) {
+      found = __atomic_load_n(&job->found_block, __ATOMIC_RELAXED);
+
+      if ((found >= 0 && found < b) || __atomic_load_n(&job->is_cancelled, __ATOMIC_RELAXED)) {
+        break;
+      }
+    }
+
+    offset = b == 0 && i == 0 ? job->first_offset : 0;
+
+    if (offset > bline->data_len
+      || pcre_exec(job->cre, NULL, bline->data, bline->data_len, offset, 0, ovector, 3) < 0
+    ) {
+      continue;
+    }
+
+    if (b > 0 && bline == job->blocks[0].bline && ovector[0] > job->last_limit) {
+      // Wrapped back onto the start line, past where we started
+      continue;
+    }
+
+    pthread_mutex_lock(&job->lock);
+
+    if (job->found_block < 0 || b < job->found_block) {
+      job->found_bline = bline;
+      job->found_offset = ovector[0];
+      __atomic_store_n(&job->found_block, b, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&job->lock);
+    break;
+  }
+
+  __atomic_add_fetch(&job->blocks_done, 1, __ATOMIC_RELAXED);
+}
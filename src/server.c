@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "utlist.h"
+#include "eon.h"
+#include "mlbuf.h"
+
+static char* _server_get_path();
+static int _server_is_own_dir(char* dir);
+static int _server_connect(char* path);
+static int _server_write_all(int fd, char* data, size_t len);
+static int _server_peer_is_self(int fd);
+static void _server_accept(async_proc_t* aproc, char* buf, size_t buf_len);
+static void _server_read(async_proc_t* aproc, char* buf, size_t buf_len);
+static void _server_handle(editor_t* editor, server_client_t* client);
+static int _server_open(editor_t* editor, server_client_t* client, char* cwd, char* path);
+static void _server_close_client(editor_t* editor, server_client_t* client);
+
+// If argv asks for it (-e, or -E to also wait until the files are closed),
+// hand the files in argv to an eon that is already running and return EON_OK
+// once it replies. Return EON_ERR to start normally, e.g. if none is running.
+// This runs before editor_init so forwarding skips rc files and kmaps.
+//
+// A request is a few lines ending with an empty one:
+//
+//   cwd <dir>
+//   wait
+//   open <path[:line]>
+//
+// The server replies "ok" once the files are open, and "closed" once they are
+// all closed again if the client waits.
+int server_forward(int argc, char** argv, int* ret_exit_code) {
+  str_t request = {0};
+  char cwd[PATH_MAX];
+  char reply[256];
+  char* path;
+  ssize_t nbytes;
+  size_t reply_len;
+  int is_forward;
+  int is_wait;
+  int is_ok;
+  int fd;
+  int c;
+  int i;
+
+  is_forward = 0;
+  is_wait = 0;
+  opterr = 0;
+  optind = 0;
+
+  while ((c = getopt(argc, argv, EON_OPTSTRING)) != -1) {
+    if (c == 'e') {
+      is_forward = 1;
+    } else if (c == 'E') {
+      is_forward = 1;
+      is_wait = 1;
+    }
+  }
+
+  opterr = 1;
+
+  if (!is_forward || !(path = _server_get_path())) {
+    return EON_ERR;
+  }
+
+  fd = _server_connect(path);
+
+  if (fd < 0 && errno == EPERM) {
+    fprintf(stderr, "eon: not sending files to %s, it belongs to another user\n", path);
+  }
+
+  free(path);
+
+  if (fd < 0) return EON_ERR;
+
+  if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+
+  str_append(&request, "cwd ");
+  str_append(&request, cwd);
+  str_append(&request, "\n");
+
+  if (is_wait) str_append(&request, "wait\n");
+
+  for (i = optind; i < argc; i++) {
+    if (strchr(argv[i], '\n')) continue;
+
+    str_append(&request, "open ");
+    str_append(&request, argv[i]);
+    str_append(&request, "\n");
+  }
+
+  str_append(&request, "\n");
+  _server_write_all(fd, request.data, request.len);
+  str_free(&request);
+
+  // Wait for "ok", and then for "closed" if waiting
+  reply_len = 0;
+  is_ok = 0;
+  *ret_exit_code = EXIT_SUCCESS;
+
+  while (reply_len < sizeof(reply) - 1
+    && (nbytes = read(fd, reply + reply_len, sizeof(reply) - 1 - reply_len)) > 0
+  ) {
+    reply_len += nbytes;
+    reply[reply_len] = '\0';
+
+    if (strncmp(reply, "err ", 4) == 0 && strchr(reply, '\n')) {
+      fprintf(stderr, "eon: %s", reply + 4);
+      *ret_exit_code = EXIT_FAILURE;
+      break;
+
+    } else if (strncmp(reply, "ok\n", 3) == 0) {
+      is_ok = 1;
+
+      if (!is_wait || strstr(reply, "closed\n")) break;
+    }
+  }
+
+  close(fd);
+
+  if (!is_ok && *ret_exit_code == EXIT_SUCCESS) {
+    fprintf(stderr, "eon: no reply from running eon\n");
+    *ret_exit_code = EXIT_FAILURE;
+  }
+
+  return EON_OK;
+}
+
+// Listen for files sent by other eon invocations, unless another eon already
+// is
+int server_init(editor_t* editor) {
+  struct sockaddr_un addr;
+  mode_t old_umask;
+  int fd;
+  int rc;
+
+  if (!editor->use_server || editor->headless_mode) {
+    return EON_OK;
+  }
+
+  if (!(editor->server_path = _server_get_path())) {
+    return EON_ERR;
+  }
+
+  if ((fd = _server_connect(editor->server_path)) >= 0) {
+    // Someone answered; leave it be
+    close(fd);
+    free(editor->server_path);
+    editor->server_path = NULL;
+    return EON_OK;
+
+  } else if (errno == ECONNREFUSED) {
+    // Nobody answered on a socket left by an eon that crashed
+    unlink(editor->server_path);
+
+  } else if (errno == EPERM) {
+    // Not ours; leave it be, and don't listen either
+    goto server_init_failure;
+  }
+
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, editor->server_path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    goto server_init_failure;
+  }
+
+  // Only this user may connect
+  old_umask = umask(077);
+  rc = bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_un));
+  umask(old_umask);
+
+  if (rc != 0 || listen(fd, 16) != 0) {
+    close(fd);
+    goto server_init_failure;
+  }
+
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  editor->server_fd = fd;
+  async_proc_new_watch(editor, editor, &editor->server_proc, fd, _server_accept);
+  return EON_OK;
+
+server_init_failure:
+  free(editor->server_path);
+  editor->server_path = NULL;
+  return EON_ERR;
+}
+
+// Open files for clients whose requests are in. This runs from the top-level
+// loop only, so files never open underneath a prompt.
+int server_idle(editor_t* editor) {
+  server_client_t* client;
+  server_client_t* client_tmp;
+
+  if (!editor->server_clients || editor->loop_depth != 1) {
+    return EON_OK;
+  }
+
+  DL_FOREACH_SAFE(editor->server_clients, client, client_tmp) {
+    if (client->is_ready && !client->is_handled) {
+      _server_handle(editor, client);
+    }
+  }
+
+  return EON_OK;
+}
+
+// Forget a bview that is closing. A waiting client is told once all the files
+// it sent are closed.
+int server_unlink_bview(editor_t* editor, bview_t* bview) {
+  server_client_t* client;
+  server_client_t* client_tmp;
+  int is_found;
+  int i;
+
+  DL_FOREACH_SAFE(editor->server_clients, client, client_tmp) {
+    is_found = 0;
+
+    for (i = client->bviews_len - 1; i >= 0; i--) {
+      if (client->bviews[i] == bview) {
+        client->bviews[i] = client->bviews[--client->bviews_len];
+        is_found = 1;
+      }
+    }
+
+    if (is_found && client->bviews_len < 1) {
+      _server_write_all(client->fd, "closed\n", 7);
+      _server_close_client(editor, client);
+    }
+  }
+
+  return EON_OK;
+}
+
+// Stop listening and let waiting clients go
+int server_deinit(editor_t* editor) {
+  server_client_t* client;
+  server_client_t* client_tmp;
+
+  DL_FOREACH_SAFE(editor->server_clients, client, client_tmp) {
+    if (client->is_wait && client->is_handled) {
+      _server_write_all(client->fd, "closed\n", 7);
+    }
+
+    _server_close_client(editor, client);
+  }
+
+  if (editor->server_proc) async_proc_destroy(editor->server_proc, 0);
+
+  if (editor->server_fd) {
+    close(editor->server_fd);
+    unlink(editor->server_path);
+    editor->server_fd = 0;
+  }
+
+  if (editor->server_path) {
+    free(editor->server_path);
+    editor->server_path = NULL;
+  }
+
+  return EON_OK;
+}
+
+// Return the socket path. The socket lives in a directory only we can enter,
+// in XDG_RUNTIME_DIR if set, else per user in /tmp. Return NULL if that
+// directory can't be made or isn't ours alone.
+static char* _server_get_path() {
+  struct sockaddr_un addr;
+  char* path;
+  char* dir;
+  char* base;
+  int rc;
+
+  if ((base = getenv("XDG_RUNTIME_DIR")) && *base) {
+    rc = asprintf(&dir, "%s/%s", base, EON_SERVER_DIR_NAME);
+  } else {
+    rc = asprintf(&dir, "/tmp/%s-%u", EON_SERVER_DIR_NAME, (unsigned)getuid());
+  }
+
+  if (rc < 0) return NULL;
+
+  if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+    free(dir);
+    return NULL;
+
+  } else if (!_server_is_own_dir(dir)) {
+    // Made by someone else first
+    free(dir);
+    return NULL;
+  }
+
+  rc = asprintf(&path, "%s/%s", dir, EON_SERVER_SOCK_NAME);
+  free(dir);
+
+  if (rc < 0) return NULL;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    free(path);
+    return NULL;
+  }
+
+  return path;
+}
+
+// Return 1 if dir is a real directory owned by us that nobody else can use
+static int _server_is_own_dir(char* dir) {
+  struct stat st;
+
+  if (lstat(dir, &st) != 0) {
+    return 0;
+  }
+
+  return S_ISDIR(st.st_mode)
+    && st.st_uid == getuid()
+    && (st.st_mode & 077) == 0 ? 1 : 0;
+}
+
+// Return a socket connected to path, or -1 with errno set. Fail with EPERM
+// if the socket or the eon listening on it belongs to another user.
+static int _server_connect(char* path) {
+  struct sockaddr_un addr;
+  struct stat st;
+  int fd;
+  int err;
+
+  if (lstat(path, &st) == 0 && (!S_ISSOCK(st.st_mode) || st.st_uid != getuid())) {
+    errno = EPERM;
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    return -1;
+  }
+
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_un)) != 0) {
+    err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  if (!_server_peer_is_self(fd)) {
+    // Don't tell a stranger what we open
+    close(fd);
+    errno = EPERM;
+    return -1;
+  }
+
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+// Write all of data, retrying short writes
+static int _server_write_all(int fd, char* data, size_t len) {
+  ssize_t nbytes;
+
+  while (len > 0) {
+    nbytes = write(fd, data, len);
+
+    if (nbytes < 0 && errno == EINTR) {
+      continue;
+    } else if (nbytes <= 0) {
+      return EON_ERR;
+    }
+
+    data += nbytes;
+    len -= nbytes;
+  }
+
+  return EON_OK;
+}
+
+// Return 1 if the peer on fd runs as the same user as us
+static int _server_peer_is_self(int fd) {
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t cred_len;
+  cred_len = sizeof(struct ucred);
+
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0) {
+    return 0;
+  }
+
+  return cred.uid == getuid() ? 1 : 0;
+#else
+  uid_t uid;
+  gid_t gid;
+
+  if (getpeereid(fd, &uid, &gid) != 0) {
+    return 0;
+  }
+
+  return uid == getuid() ? 1 : 0;
+#endif
+}
+
+// Take new connections
+static void _server_accept(async_proc_t* aproc, char* buf, size_t buf_len) {
+  editor_t* editor;
+  server_client_t* client;
+  int fd;
+
+  editor = aproc->editor;
+
+  while ((fd = accept(editor->server_fd, NULL, NULL)) >= 0) {
+    if (!_server_peer_is_self(fd)) {
+      close(fd);
+      continue;
+    }
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    client = calloc(1, sizeof(server_client_t));
+    client->editor = editor;
+    client->fd = fd;
+    DL_APPEND(editor->server_clients, client);
+    async_proc_new_watch(editor, client, &client->aproc, fd, _server_read);
+
+    // The request has usually arrived already
+    _server_read(client->aproc, NULL, 0);
+  }
+}
+
+// Collect a client's request. Once it is handled, a read only tells us
+// whether a waiting client went away.
+static void _server_read(async_proc_t* aproc, char* buf, size_t buf_len) {
+  server_client_t* client;
+  char data[4096];
+  ssize_t nbytes;
+
+  client = (server_client_t*)aproc->owner;
+
+  while ((nbytes = read(client->fd, data, sizeof(data))) > 0) {
+    if (client->is_ready) continue;
+
+    str_append_len(&client->request, data, nbytes);
+
+    if (client->request.len > EON_SERVER_REQUEST_MAX) {
+      _server_write_all(client->fd, "err request too long\n", 21);
+      _server_close_client(client->editor, client);
+      return;
+
+    } else if (client->request.len >= 2
+      && strcmp(client->request.data + client->request.len - 2, "\n\n") == 0
+    ) {
+      client->is_ready = 1;
+    }
+  }
+
+  if (nbytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    _server_close_client(client->editor, client);
+  }
+}
+
+// Open the files a client sent, then reply
+static void _server_handle(editor_t* editor, server_client_t* client) {
+  char* line;
+  char* next;
+  char* cwd;
+  int nopened;
+
+  client->is_handled = 1;
+  cwd = NULL;
+  nopened = 0;
+  line = client->request.data;
+
+  while ((next = strchr(line, '\n')) != NULL && next > line) {
+    *next = '\0';
+
+    if (strncmp(line, "cwd ", 4) == 0) {
+      cwd = line + 4;
+    } else if (strcmp(line, "wait") == 0) {
+      client->is_wait = 1;
+    } else if (strncmp(line, "open ", 5) == 0) {
+      if (_server_open(editor, client, cwd, line + 5) == EON_OK) nopened += 1;
+    }
+
+    line = next + 1;
+  }
+
+  // Like a bare eon, no paths means a blank buffer
+  if (nopened < 1) {
+    _server_open(editor, client, NULL, NULL);
+  }
+
+  if (nopened > 0) {
+    EON_SET_INFO(editor, "server: opened %d file(s) from another eon", nopened);
+  }
+
+  _server_write_all(client->fd, "ok\n", 3);
+
+  if (!client->is_wait || client->bviews_len < 1) {
+    _server_close_client(editor, client);
+  }
+}
+
+// Open opt_path, relative to the client's cwd, at an optional ":line". Track
+// the bview if the client waits for it to close.
+static int _server_open(editor_t* editor, server_client_t* client, char* cwd, char* opt_path) {
+  bview_t* bview;
+  char* path;
+  char* colon;
+  bint_t linenum;
+
+  path = NULL;
+  linenum = 0;
+
+  if (opt_path && opt_path[0] != '/' && cwd && *cwd) {
+    if (asprintf(&path, "%s/%s", cwd, opt_path) < 0) return EON_ERR;
+  } else if (opt_path) {
+    path = strdup(opt_path);
+  }
+
+  // Take off a trailing ":line" unless it is part of the name
+  if (path
+    && !util_is_file(path, NULL, NULL)
+    && (colon = strrchr(path, ':')) != NULL
+    && colon[1] >= '0' && colon[1] <= '9'
+  ) {
+    *colon = '\0';
+
+    if (util_is_file(path, NULL, NULL)) {
+      linenum = strtoll(colon + 1, NULL, 10);
+    } else {
+      *colon = ':';
+    }
+  }
+
+  bview = NULL;
+  editor_open_bview(editor, NULL, EON_BVIEW_TYPE_EDIT, path, path ? (int)strlen(path) : 0, 1, linenum, &editor->rect_edit, NULL, &bview);
+
+  if (path) free(path);
+
+  if (!bview) return EON_ERR;
+
+  if (client->is_wait) {
+    client->bviews = realloc(client->bviews, sizeof(bview_t*) * (client->bviews_len + 1));
+    client->bviews[client->bviews_len++] = bview;
+  }
+
+  return EON_OK;
+}
+
+// Hang up on a client
+static void _server_close_client(editor_t* editor, server_client_t* client) {
+  if (client->aproc) async_proc_destroy(client->aproc, 0);
+
+  close(client->fd);
+  DL_DELETE(editor->server_clients, client);
+  str_free(&client->request);
+  if (client->bviews) free(client->bviews);
+  free(client);
+}
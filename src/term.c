@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "eon.h"
+
+static int _term_write(editor_t* editor, char* seq);
+static int _term_sgr_len(uint16_t fg, uint16_t bg);
+static int _term_utf8_len(uint32_t ch);
+static int _term_num_len(int n);
+
+// Present the frame in termbox's back buffer. With sync_output on, wrap
+// tb_render in DEC private mode 2026 so terminals that support it swap the
+// frame in at once; others ignore the unknown mode. While tracing, keep a
+// shadow of the last frame to account the cells and bytes termbox writes.
+int term_render(editor_t* editor) {
+  struct tb_cell* back;
+  int w;
+  int h;
+
+  if (editor->trace_enabled) {
+    w = tb_width();
+    h = tb_height();
+    back = tb_cell_buffer();
+
+    if (w != editor->term_w || h != editor->term_h || !editor->term_front) {
+      // Termbox repaints everything after a resize or reinit
+      editor->term_front = realloc(editor->term_front, sizeof(struct tb_cell) * w * h);
+      memset(editor->term_front, 0, sizeof(struct tb_cell) * w * h);
+      editor->term_w = w;
+      editor->term_h = h;
+    }
+
+    editor->term_last_bytes = term_frame_cost(editor->term_front, back, w, h, &editor->term_last_cells);
+    memcpy(editor->term_front, back, sizeof(struct tb_cell) * w * h);
+  }
+
+  if (editor->sync_output) _term_write(editor, "\x1b[?2026h");
+  tb_render();
+  if (editor->sync_output) _term_write(editor, "\x1b[?2026l");
+
+  return EON_OK;
+}
+
+// Forget the shadow frame, e.g. after termbox was reinitialized
+int term_invalidate(editor_t* editor) {
+  editor->term_w = 0;
+  editor->term_h = 0;
+  return EON_OK;
+}
+
+// Free terminal output state
+int term_deinit(editor_t* editor) {
+  if (editor->term_front) free(editor->term_front);
+  if (editor->term_fd > 0) close(editor->term_fd);
+  editor->term_front = NULL;
+  editor->term_fd = 0;
+  return EON_OK;
+}
+
+// Return an estimate of the bytes termbox writes to turn front into back: a
+// cursor move unless the changed cell follows the last one written, an SGR
+// sequence when colors change, then the glyph. The sizes are typical, not
+// what the terminfo entry in use emits. Set optret_cells to the cells changed.
+int term_frame_cost(struct tb_cell* front, struct tb_cell* back, int w, int h, int* optret_cells) {
+  struct tb_cell* b;
+  struct tb_cell* f;
+  uint16_t last_fg;
+  uint16_t last_bg;
+  int cur_x;
+  int cur_y;
+  int cells;
+  int bytes;
+  int x;
+  int y;
+
+  cur_x = cur_y = -1;
+  last_fg = last_bg = 0xffff;
+  cells = 0;
+  bytes = 0;
+
+  for (y = 0; y < h; y++) {
+    for (x = 0; x < w; x++) {
+      b = &back[y * w + x];
+      f = &front[y * w + x];
+
+      if (b->ch == f->ch && b->fg == f->fg && b->bg == f->bg) {
+        continue;
+      }
+
+      if (x != cur_x || y != cur_y) {
+        bytes += 4 + _term_num_len(y + 1) + _term_num_len(x + 1); // ESC [ y ; x H
+      }
+
+      if (b->fg != last_fg || b->bg != last_bg) {
+        bytes += _term_sgr_len(b->fg, b->bg);
+        last_fg = b->fg;
+        last_bg = b->bg;
+      }
+
+      bytes += _term_utf8_len(b->ch);
+      cells += 1;
+      cur_x = x + 1;
+      cur_y = y;
+    }
+  }
+
+  if (optret_cells) *optret_cells = cells;
+
+  return bytes;
+}
+
+// Write an escape sequence straight to the tty
+static int _term_write(editor_t* editor, char* seq) {
+  size_t len;
+
+  if (!editor->term_fd && (editor->term_fd = open("/dev/tty", O_WRONLY | O_NOCTTY)) < 0) {
+    // Don't retry every frame
+    editor->sync_output = 0;
+    return EON_ERR;
+  }
+
+  len = strlen(seq);
+  return write(editor->term_fd, seq, len) == (ssize_t)len ? EON_OK : EON_ERR;
+}
+
+// Return length of the SGR sequence for a cell in 256 color mode:
+// ESC [ 0 (;1)(;4)(;7) (;38;5;N) (;48;5;N) m
+static int _term_sgr_len(uint16_t fg, uint16_t bg) {
+  int len;
+
+  len = 4;
+  if ((fg | bg) & TB_BOLD) len += 2;
+  if ((fg | bg) & TB_UNDERLINE) len += 2;
+  if ((fg | bg) & TB_REVERSE) len += 2;
+  if (fg & 0xff) len += 6 + _term_num_len((fg & 0xff) - 1);
+  if (bg & 0xff) len += 6 + _term_num_len((bg & 0xff) - 1);
+  return len;
+}
+
+// Return number of bytes to encode ch as UTF-8
+static int _term_utf8_len(uint32_t ch) {
+  if (ch < 0x80) return 1;
+  if (ch < 0x800) return 2;
+  if (ch < 0x10000) return 3;
+  return 4;
+}
+
+// Return number of decimal digits in n
+static int _term_num_len(int n) {
+  int len;
+  for (len = 1; n >= 10; n /= 10) len++;
+  return len;
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "eon.h"
+#include "colors.h"
+
+// trace_span_t
+typedef struct trace_span_s {
+    uint64_t seq;
+    const char* cat;
+    const char* name;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    uint64_t allocs;
+    int tid;
+} trace_span_t;
+
+static int _trace_read_span(uint64_t idx, trace_span_t* ret_span);
+static void _trace_fputs_json(FILE* fp, const char* str);
+
+// Spans are claimed with an atomic increment of _trace_head and published by
+// storing idx + 1 in seq, so any thread can record without a lock. Readers
+// copy a slot and drop it if seq changed underneath them.
+static trace_span_t _trace_ring[EON_TRACE_RING_SIZE];
+static uint64_t _trace_head = 0;
+static uint64_t _trace_epoch_ns = 0;
+static int _trace_next_tid = 0;
+static __thread int _trace_tid = 0;
+static __thread uint64_t _trace_allocs = 0;
+
+#ifdef EON_WRAP_MALLOC
+// Linked with -Wl,--wrap for each of these so calls from eon and mlbuf
+// (not libc internals) are counted per thread for trace_allocs
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  _trace_allocs += 1;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size) {
+  _trace_allocs += 1;
+  return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  _trace_allocs += 1;
+  return __real_realloc(ptr, size);
+}
+#endif
+
+// Return monotonic time in ns
+uint64_t trace_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Return a start time for trace_end, or 0 if tracing is off
+uint64_t trace_begin(editor_t* editor) {
+  return editor->trace_enabled ? trace_now() : 0;
+}
+
+// Record a span from start to now. Safe to call from any thread.
+void trace_end(editor_t* editor, const char* cat, const char* name, uint64_t start) {
+  trace_end_allocs(editor, cat, name, start, 0);
+}
+
+// Like trace_end, also noting the heap allocations made during the span
+void trace_end_allocs(editor_t* editor, const char* cat, const char* name, uint64_t start, uint64_t allocs) {
+  trace_span_t* span;
+  uint64_t now;
+  uint64_t idx;
+
+  if (!start || !editor->trace_enabled) return;
+
+  now = trace_now();
+
+  if (!_trace_tid) {
+    _trace_tid = __atomic_add_fetch(&_trace_next_tid, 1, __ATOMIC_RELAXED);
+  }
+
+  idx = __atomic_fetch_add(&_trace_head, 1, __ATOMIC_RELAXED);
+  span = &_trace_ring[idx & (EON_TRACE_RING_SIZE - 1)];
+
+  __atomic_store_n(&span->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  span->cat = cat;
+  span->name = name;
+  span->start_ns = start;
+  span->dur_ns = now - start;
+  span->allocs = allocs;
+  span->tid = _trace_tid;
+  __atomic_store_n(&span->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+// Return the number of heap allocations this thread has made, or 0 if the
+// build does not count them (see EON_WRAP_MALLOC, set by make TRACE_ALLOCS=1)
+uint64_t trace_allocs() {
+  return _trace_allocs;
+}
+
+// Turn span recording on or off
+int trace_set_enabled(editor_t* editor, int is_enabled) {
+  if (is_enabled && !_trace_epoch_ns) {
+    _trace_epoch_ns = trace_now();
+  }
+
+  editor->trace_enabled = is_enabled ? 1 : 0;
+  return EON_OK;
+}
+
+// Draw the last few command timings and the last frame time in the top right
+// corner of the edit area
+int trace_draw_overlay(editor_t* editor) {
+  trace_span_t span;
+  trace_span_t cmds[EON_TRACE_OVERLAY_ROWS];
+  uint64_t frame_ns;
+  uint64_t head;
+  uint64_t idx;
+  int ncmds;
+  int is_frame_found;
+  int x;
+  int i;
+
+  if (!editor->is_trace_overlay || editor->rect_edit.w < EON_TRACE_OVERLAY_W) {
+    return EON_OK;
+  }
+
+  head = __atomic_load_n(&_trace_head, __ATOMIC_ACQUIRE);
+  frame_ns = 0;
+  ncmds = 0;
+  is_frame_found = 0;
+
+  for (idx = head; idx > 0 && head - idx < EON_TRACE_RING_SIZE; idx--) {
+    if (_trace_read_span(idx - 1, &span) != EON_OK) continue;
+
+    if (!is_frame_found && strcmp(span.cat, "draw") == 0) {
+      frame_ns = span.dur_ns;
+      is_frame_found = 1;
+
+    } else if (ncmds < EON_TRACE_OVERLAY_ROWS && strcmp(span.cat, "cmd") == 0) {
+      cmds[ncmds++] = span;
+    }
+
+    if (is_frame_found && ncmds >= EON_TRACE_OVERLAY_ROWS) break;
+  }
+
+  x = editor->rect_edit.w - EON_TRACE_OVERLAY_W;
+  rect_printf(editor->rect_edit, x, 0, TRACE_FG | TB_BOLD, TRACE_BG, " %-*s%8.2fms ",
+    EON_TRACE_OVERLAY_W - 12, "frame", frame_ns / 1e6);
+
+  rect_printf(editor->rect_edit, x, 1, TRACE_FG | TB_BOLD, TRACE_BG, " %-*s%6d cells %6d est B ",
+    EON_TRACE_OVERLAY_W - 27, "output", editor->term_last_cells, editor->term_last_bytes);
+
+  rect_printf(editor->rect_edit, x, 2, TRACE_FG | TB_BOLD, TRACE_BG, " %-*s%6llu evict %6llu rebuild ",
+    EON_TRACE_OVERLAY_W - 29, "chars", (unsigned long long)editor->chars_evictions, (unsigned long long)editor->chars_rebuilds);
+
+  for (i = 0; i < ncmds; i++) {
+    rect_printf(editor->rect_edit, x, i + 3, TRACE_FG, TRACE_BG, " %-*.*s%5llu%8.2fms ",
+      EON_TRACE_OVERLAY_W - 17, EON_TRACE_OVERLAY_W - 18, cmds[i].name, (unsigned long long)cmds[i].allocs, cmds[i].dur_ns / 1e6);
+  }
+
+  return EON_OK;
+}
+
+// Return the index of the next span, for use as a mark with trace_collect
+uint64_t trace_tell() {
+  return __atomic_load_n(&_trace_head, __ATOMIC_ACQUIRE);
+}
+
+// Copy into ret_durs the durations (ns) of spans in cat recorded since mark,
+// optionally only those named name. Return the number copied.
+size_t trace_collect(uint64_t mark, const char* cat, const char* opt_name, uint64_t* ret_durs, size_t max) {
+  trace_span_t span;
+  uint64_t head;
+  uint64_t idx;
+  size_t n;
+
+  head = __atomic_load_n(&_trace_head, __ATOMIC_ACQUIRE);
+  idx = head - mark > EON_TRACE_RING_SIZE ? head - EON_TRACE_RING_SIZE : mark;
+
+  for (n = 0; idx < head && n < max; idx++) {
+    if (_trace_read_span(idx, &span) != EON_OK
+        || strcmp(span.cat, cat) != 0
+        || (opt_name && strcmp(span.name, opt_name) != 0)
+       ) {
+      continue;
+    }
+
+    ret_durs[n++] = span.dur_ns;
+  }
+
+  return n;
+}
+
+// Write the recorded spans to path as a Chrome trace-event JSON file
+int trace_dump(editor_t* editor, char* path) {
+  trace_span_t span;
+  uint64_t head;
+  uint64_t idx;
+  int is_first;
+  FILE* fp;
+
+  if (!(fp = fopen(path, "w"))) {
+    EON_RETURN_ERR(editor, "Failed to open %s for writing", path);
+  }
+
+  head = __atomic_load_n(&_trace_head, __ATOMIC_ACQUIRE);
+  idx = head > EON_TRACE_RING_SIZE ? head - EON_TRACE_RING_SIZE : 0;
+  is_first = 1;
+
+  fputs("{\"traceEvents\":[", fp);
+
+  for (; idx < head; idx++) {
+    if (_trace_read_span(idx, &span) != EON_OK) continue;
+
+    fprintf(fp, "%s\n{\"name\":", is_first ? "" : ",");
+    _trace_fputs_json(fp, span.name);
+    fputs(",\"cat\":", fp);
+    _trace_fputs_json(fp, span.cat);
+    fprintf(fp, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+      (span.start_ns - _trace_epoch_ns) / 1e3, span.dur_ns / 1e3, (int)getpid(), span.tid);
+    if (span.allocs) fprintf(fp, ",\"args\":{\"allocs\":%llu}", (unsigned long long)span.allocs);
+    fputc('}', fp);
+    is_first = 0;
+  }
+
+  fputs("\n],\"displayTimeUnit\":\"ms\"}\n", fp);
+
+  if (fclose(fp) != 0) {
+    EON_RETURN_ERR(editor, "Failed to write %s", path);
+  }
+
+  return EON_OK;
+}
+
+// Copy a published span out of the ring. Return EON_ERR if it was overwritten
+// or is still being written.
+static int _trace_read_span(uint64_t idx, trace_span_t* ret_span) {
+  trace_span_t* span;
+  uint64_t seq;
+
+  span = &_trace_ring[idx & (EON_TRACE_RING_SIZE - 1)];
+  seq = __atomic_load_n(&span->seq, __ATOMIC_ACQUIRE);
+
+  if (seq != idx + 1) return EON_ERR;
+
+  *ret_span = *span;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  if (__atomic_load_n(&span->seq, __ATOMIC_RELAXED) != seq || !ret_span->name || !ret_span->cat) {
+    return EON_ERR;
+  }
+
+  return EON_OK;
+}
+
+// Write str as a JSON string literal
+static void _trace_fputs_json(FILE* fp, const char* str) {
+  fputc('"', fp);
+
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      fputc('\\', fp);
+      fputc(*str, fp);
+    } else if ((unsigned char)*str < 0x20) {
+      fprintf(fp, "\\u%04x", (unsigned char)*str);
+    } else {
+      fputc(*str, fp);
+    }
+  }
+
+  fputc('"', fp);
+}
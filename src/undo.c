@@ -0,0 +1,756 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "uthash.h"
+#include "utlist.h"
+#include "eon.h"
+#include "mlbuf.h"
+
+static undo_t* _undo_get(editor_t* editor, buffer_t* buffer, int create);
+static baction_t* _undo_get_next_action(buffer_t* buffer, int is_redo);
+static int _undo_enforce_cap(editor_t* editor, undo_t* undo);
+static int _undo_sweep_spill(undo_t* undo);
+static int _undo_open_spill(undo_t* undo);
+static int _undo_compact_spill(undo_t* undo);
+static int _undo_compress_action(undo_t* undo, baction_t* action);
+static int _undo_spill_action(undo_t* undo, baction_t* action);
+static int _undo_load_action(undo_t* undo, baction_t* action);
+static undo_spill_t* _undo_find_spill(undo_t* undo, baction_t* action);
+static int _undo_drop_spill(undo_t* undo, undo_spill_t* spill);
+static int _undo_pread(int fd, char* data, size_t len, off_t offset);
+static int _undo_pwrite(int fd, char* data, size_t len, off_t offset);
+static int _undo_is_joined(undo_t* undo, baction_t* action);
+
+// Account for an action that mlbuf just appended to a buffer's history
+int undo_track(editor_t* editor, buffer_t* buffer, baction_t* action) {
+  undo_t* undo;
+  undo_join_t* join;
+  undo_spill_t* spill;
+
+  if (!action || action != buffer->action_tail || buffer->action_undone) {
+    // Not a new action (undo/redo or style-only callback)
+    return EON_OK;
+  }
+
+  undo = _undo_get(editor, buffer, 1);
+
+  if (undo->is_replaying) {
+    // Redo of the newest action
+    return EON_OK;
+  }
+
+  // A freed action's address may be reused; a new action has no spilled
+  // copy and is never joined
+  HASH_FIND_PTR(undo->spill_map, &action, spill);
+
+  if (spill) {
+    _undo_drop_spill(undo, spill);
+  }
+
+  HASH_FIND_PTR(undo->join_map, &action, join);
+
+  if (join) {
+    HASH_DEL(undo->join_map, join);
+    free(join);
+  }
+
+  if (undo->is_suspended) {
+    // Dropped on undo_suspend(0)
+    return EON_OK;
+  }
+
+  undo->mem_bytes += (size_t)action->data_len;
+
+  // First action of the running command; see undo_commit
+  if (!undo->commit_first) {
+    undo->commit_first = action;
+  }
+
+  return EON_OK;
+}
+
+// Join the newest action to the one before it, so one undo or redo applies
+// both. Used for edits that mlbuf records as a delete and an insert.
+int undo_join(editor_t* editor, buffer_t* buffer) {
+  undo_t* undo;
+  undo_join_t* join;
+  baction_t* action;
+
+  action = buffer->action_tail;
+
+  if (!action || buffer->action_undone || action == buffer->actions) {
+    return EON_ERR;
+  }
+
+  undo = _undo_get(editor, buffer, 1);
+  HASH_FIND_PTR(undo->join_map, &action, join);
+
+  if (!join) {
+    join = calloc(1, sizeof(undo_join_t));
+    join->action = action;
+    HASH_ADD_PTR(undo->join_map, action, join);
+  }
+
+  return EON_OK;
+}
+
+// Stop or resume keeping actions in a buffer's history. Actions made while
+// suspended are dropped from the history on resume, so they cannot be undone
+// (e.g. appends to a followed log).
+int undo_suspend(editor_t* editor, buffer_t* buffer, int is_suspended) {
+  undo_t* undo;
+  baction_t* action;
+
+  undo = _undo_get(editor, buffer, 1);
+
+  if (is_suspended) {
+    // A new action discards redo history, so the tail to keep is the last
+    // action that was not undone
+    if (!buffer->action_undone) {
+      undo->suspend_tail = buffer->action_tail;
+    } else if (buffer->action_undone == buffer->actions) {
+      undo->suspend_tail = NULL;
+    } else {
+      undo->suspend_tail = buffer->action_undone->prev;
+    }
+    undo->is_suspended = 1;
+    return EON_OK;
+  }
+
+  if (!undo->is_suspended) {
+    return EON_OK;
+  }
+
+  while ((action = buffer->action_tail) && action != undo->suspend_tail && !buffer->action_undone) {
+    buffer->action_tail = action == buffer->actions ? NULL : action->prev;
+    DL_DELETE(buffer->actions, action);
+    if (action == undo->commit_first) undo->commit_first = NULL;
+    buffer_destroy_action(buffer, action);
+  }
+
+  undo->suspend_tail = NULL;
+  undo->is_suspended = 0;
+  return EON_OK;
+}
+
+// Merge small adjacent actions and enforce the undo memory cap. Called once
+// per command loop iteration with the command that ran, so mlbuf is never
+// mid-action here. Actions of one command merge with each other, and with
+// the ones before only if the same command made those (a run of typing), so
+// e.g. a paste right after typing stays a separate undo step.
+int undo_commit(editor_t* editor, buffer_t* buffer, cmd_func_t func) {
+  undo_t* undo;
+
+  if (!(undo = _undo_get(editor, buffer, 0))) {
+    return EON_OK;
+  }
+
+  // Joined actions stay whole, and typing after one is not folded into it
+  while (buffer->action_tail
+    && (buffer->action_tail != undo->commit_first || func == undo->commit_func)
+    && !_undo_is_joined(undo, buffer->action_tail)
+    && (buffer->action_tail == buffer->actions || !_undo_is_joined(undo, buffer->action_tail->prev))
+    && undo_merge(buffer)
+  ) {
+    journal_record_merge(editor, buffer);
+  }
+
+  undo->commit_first = NULL;
+  undo->commit_func = func;
+
+  if (editor->undo_max_bytes > 0 && undo->mem_bytes > editor->undo_max_bytes) {
+    _undo_enforce_cap(editor, undo);
+  }
+
+  return EON_OK;
+}
+
+// Undo the last action, loading its data back from the spill file if needed.
+// An action joined to the one before it takes that one along.
+int undo_undo(editor_t* editor, buffer_t* buffer) {
+  undo_t* undo;
+  baction_t* action;
+  int rc;
+
+  if (!(action = _undo_get_next_action(buffer, 0))) {
+    return EON_ERR;
+  }
+
+  if ((undo = _undo_get(editor, buffer, 0)) && _undo_load_action(undo, action) != EON_OK) {
+    EON_RETURN_ERR(editor, "Failed to read undo data from spill file%s", "");
+  }
+
+  journal_suspend(editor, buffer, 1);
+  if (undo) undo->is_replaying = 1;
+  rc = buffer_undo(buffer);
+  if (undo) undo->is_replaying = 0;
+  journal_suspend(editor, buffer, 0);
+
+  if (rc != MLBUF_OK) {
+    return EON_ERR;
+  }
+
+  journal_record_undo(editor, buffer, 0);
+
+  if (undo && _undo_is_joined(undo, action)) {
+    return undo_undo(editor, buffer);
+  }
+
+  return EON_OK;
+}
+
+// Redo the last undone action, loading its data back if needed. Actions
+// joined to it come along.
+int undo_redo(editor_t* editor, buffer_t* buffer) {
+  undo_t* undo;
+  baction_t* action;
+  int rc;
+
+  if (!(action = _undo_get_next_action(buffer, 1))) {
+    return EON_ERR;
+  }
+
+  if ((undo = _undo_get(editor, buffer, 0)) && _undo_load_action(undo, action) != EON_OK) {
+    EON_RETURN_ERR(editor, "Failed to read undo data from spill file%s", "");
+  }
+
+  journal_suspend(editor, buffer, 1);
+  if (undo) undo->is_replaying = 1;
+  rc = buffer_redo(buffer);
+  if (undo) undo->is_replaying = 0;
+  journal_suspend(editor, buffer, 0);
+
+  if (rc != MLBUF_OK) {
+    return EON_ERR;
+  }
+
+  journal_record_undo(editor, buffer, 1);
+
+  if (undo && (action = _undo_get_next_action(buffer, 1)) && _undo_is_joined(undo, action)) {
+    return undo_redo(editor, buffer);
+  }
+
+  return EON_OK;
+}
+
+// Return the action the next undo (or redo) would apply, or NULL if none
+baction_t* undo_peek(buffer_t* buffer, int is_redo) {
+  return _undo_get_next_action(buffer, is_redo);
+}
+
+// Free undo bookkeeping for a buffer that is about to be destroyed
+int undo_destroy(editor_t* editor, buffer_t* buffer) {
+  undo_t* undo;
+  undo_spill_t* spill;
+  undo_spill_t* spill_tmp;
+  undo_join_t* join;
+  undo_join_t* join_tmp;
+
+  if (!(undo = _undo_get(editor, buffer, 0))) {
+    return EON_OK;
+  }
+
+  HASH_ITER(hh, undo->spill_map, spill, spill_tmp) {
+    HASH_DEL(undo->spill_map, spill);
+    if (spill->data) free(spill->data);
+    free(spill);
+  }
+
+  HASH_ITER(hh, undo->join_map, join, join_tmp) {
+    HASH_DEL(undo->join_map, join);
+    free(join);
+  }
+
+  if (undo->spill_fd >= 0) close(undo->spill_fd);
+
+  HASH_DEL(editor->undo_map, undo);
+  free(undo);
+  return EON_OK;
+}
+
+// Find (or create) the undo_t for a buffer
+static undo_t* _undo_get(editor_t* editor, buffer_t* buffer, int create) {
+  undo_t* undo;
+  HASH_FIND_PTR(editor->undo_map, &buffer, undo);
+
+  if (!undo && create) {
+    undo = calloc(1, sizeof(undo_t));
+    undo->buffer = buffer;
+    undo->spill_fd = -1;
+    HASH_ADD_PTR(editor->undo_map, buffer, undo);
+  }
+
+  return undo;
+}
+
+// Return the action buffer_undo/buffer_redo would apply next (mirrors mlbuf)
+static baction_t* _undo_get_next_action(buffer_t* buffer, int is_redo) {
+  if (is_redo) {
+    return buffer->action_undone;
+  }
+
+  if (buffer->action_undone) {
+    if (buffer->action_undone == buffer->actions || !buffer->action_undone->prev) {
+      return NULL;
+    }
+
+    return buffer->action_undone->prev;
+  }
+
+  return buffer->action_tail;
+}
+
+// Fold the newest action into the one before it if they are the same kind of
+// single-line edit and touch. Return 1 if merged, else 0.
+int undo_merge(buffer_t* buffer) {
+  baction_t* action;
+  baction_t* prev;
+  bint_t prev_nchars;
+  bint_t action_nchars;
+  char* data;
+  int is_prepend;
+
+  action = buffer->action_tail;
+
+  if (!action || buffer->action_undone || action == buffer->actions) {
+    return 0;
+  }
+
+  prev = action->prev;
+
+  if (prev->type != action->type
+      || prev->line_delta != 0
+      || action->line_delta != 0
+      || prev->start_line_index != action->start_line_index
+      || !prev->data
+      || !action->data
+      || prev->data_len + action->data_len > EON_UNDO_MERGE_MAX_BYTES
+     ) {
+    return 0;
+  }
+
+  prev_nchars = labs((long)prev->char_delta);
+  action_nchars = labs((long)action->char_delta);
+
+  if (action->type == MLBUF_BACTION_TYPE_INSERT && action->start_col == prev->start_col + prev_nchars) {
+    // Typing forward
+    is_prepend = 0;
+
+  } else if (action->type == MLBUF_BACTION_TYPE_DELETE && action->start_col == prev->start_col) {
+    // Deleting forward
+    is_prepend = 0;
+
+  } else if (action->type == MLBUF_BACTION_TYPE_DELETE && action->start_col + action_nchars == prev->start_col) {
+    // Backspacing
+    is_prepend = 1;
+
+  } else {
+    return 0;
+  }
+
+  if (!(data = realloc(prev->data, prev->data_len + action->data_len))) {
+    return 0;
+  }
+
+  if (is_prepend) {
+    memmove(data + action->data_len, data, prev->data_len);
+    memcpy(data, action->data, action->data_len);
+    prev->start_col = action->start_col;
+
+  } else {
+    memcpy(data + prev->data_len, action->data, action->data_len);
+  }
+
+  prev->data = data;
+  prev->data_len += action->data_len;
+  prev->byte_delta += action->byte_delta;
+  prev->char_delta += action->char_delta;
+
+  DL_DELETE(buffer->actions, action);
+  buffer->action_tail = prev;
+  buffer_destroy_action(buffer, action);
+  return 1;
+}
+
+// Shrink resident undo data to 3/4 of the cap. The oldest actions are
+// compressed in memory first. If that is not enough, the oldest compressed
+// (or incompressible) data moves to the spill file.
+static int _undo_enforce_cap(editor_t* editor, undo_t* undo) {
+  baction_t* action;
+  size_t target;
+  int rc;
+
+  _undo_sweep_spill(undo);
+
+  if (undo->mem_bytes <= editor->undo_max_bytes) {
+    return EON_OK;
+  }
+
+  target = (editor->undo_max_bytes / 4) * 3;
+  DL_FOREACH(undo->buffer->actions, action) {
+    if (undo->mem_bytes <= target || action == undo->buffer->action_undone) {
+      // Never compress or spill redo history; mlbuf may free it at any time
+      break;
+    }
+
+    if (action->data && action->data_len >= EON_UNDO_COMPRESS_MIN_BYTES) {
+      _undo_compress_action(undo, action);
+    }
+  }
+
+  if (undo->mem_bytes <= target) {
+    return EON_OK;
+  }
+
+  if (undo->spill_fd < 0 && _undo_open_spill(undo) != EON_OK) {
+    EON_RETURN_ERR(editor, "Failed to create undo spill file%s", "");
+  }
+
+  rc = EON_OK;
+  DL_FOREACH(undo->buffer->actions, action) {
+    if (undo->mem_bytes <= target || action == undo->buffer->action_undone) {
+      break;
+    }
+
+    if (_undo_spill_action(undo, action) != EON_OK) {
+      rc = EON_ERR;
+      break;
+    }
+  }
+
+  if (undo->spill_dead >= EON_UNDO_SPILL_COMPACT_MIN && undo->spill_dead * 2 >= undo->spill_len) {
+    _undo_compact_spill(undo);
+  }
+
+  if (rc != EON_OK) {
+    EON_RETURN_ERR(editor, "Failed to write undo spill file%s", "");
+  }
+
+  return EON_OK;
+}
+
+// Recount resident undo data and drop the copies of actions mlbuf freed (it
+// discards redo history without telling us). Their bytes in the spill file
+// become dead space for _undo_compact_spill.
+static int _undo_sweep_spill(undo_t* undo) {
+  baction_t* action;
+  undo_spill_t* spill;
+  undo_spill_t* spill_tmp;
+  size_t mem_bytes;
+
+  HASH_ITER(hh, undo->spill_map, spill, spill_tmp) {
+    spill->is_live = 0;
+  }
+
+  mem_bytes = 0;
+  DL_FOREACH(undo->buffer->actions, action) {
+    if (action->data) mem_bytes += (size_t)action->data_len;
+
+    if ((spill = _undo_find_spill(undo, action))) {
+      spill->is_live = 1;
+      if (spill->data) mem_bytes += spill->len;
+    }
+  }
+
+  HASH_ITER(hh, undo->spill_map, spill, spill_tmp) {
+    if (!spill->is_live) _undo_drop_spill(undo, spill);
+  }
+
+  undo->mem_bytes = mem_bytes;
+  return EON_OK;
+}
+
+// Create an anonymous spill file
+static int _undo_open_spill(undo_t* undo) {
+  char path[PATH_MAX + 1];
+  char* tmpdir;
+
+  tmpdir = getenv("TMPDIR");
+  snprintf(path, sizeof(path), "%s/eon-undo-XXXXXX", tmpdir && *tmpdir ? tmpdir : "/tmp");
+
+  if ((undo->spill_fd = mkstemp(path)) < 0) {
+    return EON_ERR;
+  }
+
+  unlink(path);
+  undo->spill_len = 0;
+  undo->spill_dead = 0;
+  return EON_OK;
+}
+
+// Copy the live data of the spill file to a new one, leaving out dead space.
+// Disk copies of actions that are back in memory are let go too. On failure
+// the old file is kept as it was.
+static int _undo_compact_spill(undo_t* undo) {
+  undo_spill_t* spill;
+  undo_spill_t* spill_tmp;
+  off_t* offsets;
+  char* data;
+  int old_fd;
+  size_t i;
+  int rc;
+
+  HASH_ITER(hh, undo->spill_map, spill, spill_tmp) {
+    if (spill->offset >= 0 && spill->action->data) {
+      _undo_drop_spill(undo, spill);
+    }
+  }
+
+  old_fd = undo->spill_fd;
+  if (_undo_open_spill(undo) != EON_OK) {
+    undo->spill_fd = old_fd;
+    return EON_ERR;
+  }
+
+  rc = EON_OK;
+  offsets = calloc(HASH_COUNT(undo->spill_map) + 1, sizeof(off_t));
+  i = 0;
+  HASH_ITER(hh, undo->spill_map, spill, spill_tmp) {
+    if (spill->offset < 0) {
+      i += 1;
+      continue;
+    }
+
+    data = malloc(spill->len);
+    if (_undo_pread(old_fd, data, spill->len, spill->offset) != EON_OK
+      || _undo_pwrite(undo->spill_fd, data, spill->len, undo->spill_len) != EON_OK
+    ) {
+      free(data);
+      rc = EON_ERR;
+      break;
+    }
+    free(data);
+
+    offsets[i++] = undo->spill_len;
+    undo->spill_len += spill->len;
+  }
+
+  if (rc != EON_OK) {
+    close(undo->spill_fd);
+    undo->spill_fd = old_fd;
+    free(offsets);
+    return EON_ERR;
+  }
+
+  i = 0;
+  HASH_ITER(hh, undo->spill_map, spill, spill_tmp) {
+    if (spill->offset >= 0) spill->offset = offsets[i];
+    i += 1;
+  }
+
+  close(old_fd);
+  free(offsets);
+  return EON_OK;
+}
+
+// Replace an action's resident data with an LZ4-compressed copy in memory.
+// If a copy of the same data is already in the spill file, just let go of
+// the resident data. Return EON_ERR if the data did not shrink.
+static int _undo_compress_action(undo_t* undo, baction_t* action) {
+  undo_spill_t* spill;
+  char* zdata;
+  size_t zlen;
+
+  if ((spill = _undo_find_spill(undo, action)) && spill->offset >= 0) {
+    undo->mem_bytes -= (size_t)action->data_len;
+    free(action->data);
+    action->data = NULL;
+    return EON_OK;
+  }
+
+  zdata = malloc(lz4_compress_bound((size_t)action->data_len));
+  zlen = lz4_compress(action->data, (size_t)action->data_len, zdata);
+
+  if (zlen >= (size_t)action->data_len) {
+    free(zdata);
+    return EON_ERR;
+  }
+
+  if (!spill) {
+    spill = calloc(1, sizeof(undo_spill_t));
+    spill->action = action;
+    spill->offset = -1;
+    HASH_ADD_PTR(undo->spill_map, action, spill);
+  }
+
+  spill->data = realloc(zdata, zlen);
+  spill->len = zlen;
+  spill->data_len = action->data_len;
+  spill->is_compressed = 1;
+
+  undo->mem_bytes -= (size_t)action->data_len - zlen;
+  free(action->data);
+  action->data = NULL;
+  return EON_OK;
+}
+
+// Move an action's data out of memory to the spill file. Compressed data is
+// written as is. Data already in the spill file (unchanged since it was
+// loaded back) is not written again.
+static int _undo_spill_action(undo_t* undo, baction_t* action) {
+  undo_spill_t* spill;
+
+  spill = _undo_find_spill(undo, action);
+
+  if (spill && spill->offset >= 0) {
+    if (action->data) {
+      undo->mem_bytes -= (size_t)action->data_len;
+      free(action->data);
+      action->data = NULL;
+    }
+    return EON_OK;
+  }
+
+  if (!spill) {
+    if (!action->data || action->data_len < 1) {
+      return EON_OK;
+    }
+
+    // Incompressible or small; write it raw
+    spill = calloc(1, sizeof(undo_spill_t));
+    spill->action = action;
+    spill->offset = -1;
+    spill->data = action->data;
+    spill->len = (size_t)action->data_len;
+    spill->data_len = action->data_len;
+    HASH_ADD_PTR(undo->spill_map, action, spill);
+    action->data = NULL;
+  }
+
+  if (_undo_pwrite(undo->spill_fd, spill->data, spill->len, undo->spill_len) != EON_OK) {
+    if (!spill->is_compressed) {
+      // Put it back as it was
+      action->data = spill->data;
+      spill->data = NULL;
+      _undo_drop_spill(undo, spill);
+    }
+    return EON_ERR;
+  }
+
+  spill->offset = undo->spill_len;
+  undo->spill_len += spill->len;
+  undo->mem_bytes -= spill->len;
+  free(spill->data);
+  spill->data = NULL;
+  return EON_OK;
+}
+
+// Bring an action's data back into memory if it was compressed or spilled.
+// A copy in the spill file is kept, so spilling the action again is free.
+static int _undo_load_action(undo_t* undo, baction_t* action) {
+  undo_spill_t* spill;
+  char* data;
+  char* zdata;
+  int rc;
+
+  if (action->data || !(spill = _undo_find_spill(undo, action))) {
+    return EON_OK;
+  }
+
+  data = malloc(action->data_len);
+  zdata = spill->data;
+
+  if (!zdata && spill->is_compressed) {
+    zdata = malloc(spill->len);
+    rc = _undo_pread(undo->spill_fd, zdata, spill->len, spill->offset);
+  } else if (!zdata) {
+    rc = _undo_pread(undo->spill_fd, data, spill->len, spill->offset);
+  } else {
+    rc = EON_OK;
+  }
+
+  if (rc == EON_OK && spill->is_compressed) {
+    rc = lz4_decompress(zdata, spill->len, data, (size_t)action->data_len);
+  } else if (rc == EON_OK && zdata) {
+    memcpy(data, zdata, spill->len);
+  }
+
+  if (zdata && zdata != spill->data) {
+    free(zdata);
+  }
+
+  if (rc != EON_OK) {
+    free(data);
+    return EON_ERR;
+  }
+
+  action->data = data;
+  undo->mem_bytes += (size_t)action->data_len;
+
+  if (spill->data) {
+    undo->mem_bytes -= spill->len;
+    free(spill->data);
+    spill->data = NULL;
+  }
+
+  if (spill->offset < 0) {
+    _undo_drop_spill(undo, spill);
+  }
+
+  return EON_OK;
+}
+
+// Return the out-of-memory copy of an action's data, or NULL. A copy that no
+// longer matches the action's resident data (merged into since) is dropped.
+static undo_spill_t* _undo_find_spill(undo_t* undo, baction_t* action) {
+  undo_spill_t* spill;
+  HASH_FIND_PTR(undo->spill_map, &action, spill);
+
+  if (spill && action->data && spill->data_len != action->data_len) {
+    _undo_drop_spill(undo, spill);
+    return NULL;
+  }
+
+  return spill;
+}
+
+// Forget a copy of an action's data. Its bytes in the spill file are dead.
+static int _undo_drop_spill(undo_t* undo, undo_spill_t* spill) {
+  if (spill->data) {
+    undo->mem_bytes -= spill->len;
+    free(spill->data);
+  }
+
+  if (spill->offset >= 0) {
+    undo->spill_dead += spill->len;
+  }
+
+  HASH_DEL(undo->spill_map, spill);
+  free(spill);
+  return EON_OK;
+}
+
+// Read exactly len bytes at offset
+static int _undo_pread(int fd, char* data, size_t len, off_t offset) {
+  ssize_t nbytes;
+  size_t nread;
+
+  for (nread = 0; nread < len; nread += nbytes) {
+    nbytes = pread(fd, data + nread, len - nread, offset + nread);
+    if (nbytes <= 0) return EON_ERR;
+  }
+
+  return EON_OK;
+}
+
+// Write exactly len bytes at offset
+static int _undo_pwrite(int fd, char* data, size_t len, off_t offset) {
+  ssize_t nbytes;
+  size_t written;
+
+  for (written = 0; written < len; written += nbytes) {
+    nbytes = pwrite(fd, data + written, len - written, offset + written);
+    if (nbytes <= 0) return EON_ERR;
+  }
+
+  return EON_OK;
+}
+
+// Return 1 if action is undone and redone with the one before it
+static int _undo_is_joined(undo_t* undo, baction_t* action) {
+  undo_join_t* join;
+  HASH_FIND_PTR(undo->join_map, &action, join);
+  return join ? 1 : 0;
+}
@@ -540,6 +540,148 @@ char* util_escape_shell_arg(char* str, int l) {
   return cmd;
 }
 
+// Two-digit pairs for rect_put_num
+static const char util_digits[] =
+  "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+  "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+// Return the termbox cell at rect x,y, clipping *w to the screen. Return NULL
+// if nothing is visible.
+static struct tb_cell* _util_rect_cells(bview_rect_t* rect, int x, int y, int* w) {
+  int sx;
+  int sy;
+  int tw;
+
+  sx = rect->x + x;
+  sy = rect->y + y;
+  tw = tb_width();
+
+  if (sy < 0 || sy >= tb_height() || sx >= tw) {
+    return NULL;
+  }
+
+  if (sx < 0) {
+    *w += sx;
+    sx = 0;
+  }
+
+  if (sx + *w > tw) {
+    *w = tw - sx;
+  }
+
+  return *w > 0 ? tb_cell_buffer() + (ptrdiff_t)(tw * sy + sx) : NULL;
+}
+
+// Fill w cells starting at x,y with ch. Return number of cells written.
+int rect_fill(bview_rect_t rect, int x, int y, int w, uint32_t ch, uint16_t fg, uint16_t bg) {
+  struct tb_cell* cell;
+  int i;
+
+  if (!(cell = _util_rect_cells(&rect, x, y, &w))) {
+    return 0;
+  }
+
+  fg = fg ? fg : rect.fg;
+  bg = bg ? bg : rect.bg;
+
+  for (i = 0; i < w; i++) {
+    cell[i].ch = ch;
+    cell[i].fg = fg;
+    cell[i].bg = bg;
+  }
+
+  return w;
+}
+
+// Write n right-aligned in width cells, like "%*d" of n % 10^width. Return
+// number of cells written.
+int rect_put_num(bview_rect_t rect, int x, int y, int width, unsigned long long n, uint16_t fg, uint16_t bg) {
+  char buf[32];
+  char* p;
+  int len;
+  int idx;
+
+  if (width < 1 || width > (int)sizeof(buf)) {
+    return 0;
+  }
+
+  p = buf + sizeof(buf);
+
+  do {
+    if (n >= 10) {
+      idx = (int)(n % 100) * 2;
+      *--p = util_digits[idx + 1];
+      *--p = util_digits[idx];
+      n /= 100;
+    } else {
+      *--p = (char)('0' + n);
+      n = 0;
+    }
+  } while (n && p - buf >= 2);
+
+  len = (int)(buf + sizeof(buf) - p);
+
+  if (len > width) {
+    // Keep the low width digits, without their leading zeros, so the
+    // gutter reads as "%*d" of n % 10^width did
+    p += len - width;
+    len = width;
+
+    while (len > 1 && *p == '0') {
+      p += 1;
+      len -= 1;
+    }
+  }
+
+  while (len < width) {
+    *--p = ' ';
+    len += 1;
+  }
+
+  return rect_put_str(rect, x, y, p, len, fg, bg);
+}
+
+// Write UTF-8 str of len bytes at x,y, one cell per character. Return number
+// of cells written.
+int rect_put_str(bview_rect_t rect, int x, int y, char* str, int len, uint16_t fg, uint16_t bg) {
+  struct tb_cell* cell;
+  char* stop;
+  uint32_t uni;
+  int w;
+  int i;
+
+  w = len;
+
+  if (!(cell = _util_rect_cells(&rect, x, y, &w))) {
+    return 0;
+  }
+
+  fg = fg ? fg : rect.fg;
+  bg = bg ? bg : rect.bg;
+  stop = str + len;
+
+  for (i = 0; i < w && str < stop; i++) {
+    str += utf8_char_to_unicode(&uni, str, stop);
+    cell[i].ch = uni;
+    cell[i].fg = fg;
+    cell[i].bg = bg;
+  }
+
+  return i;
+}
+
+// Copy len prerendered cells to x,y. Return number of cells written.
+int rect_put_cells(bview_rect_t rect, int x, int y, struct tb_cell* cells, int len) {
+  struct tb_cell* cell;
+
+  if (!(cell = _util_rect_cells(&rect, x, y, &len))) {
+    return 0;
+  }
+
+  memcpy(cell, cells, sizeof(struct tb_cell) * len);
+  return len;
+}
+
 // Adapted from termbox src/demo/keyboard.c
 int rect_printf(bview_rect_t rect, int x, int y, uint16_t fg, uint16_t bg, const char *fmt, ...) {
   char buf[4096];
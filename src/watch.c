@@ -0,0 +1,985 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "uthash.h"
+#include "utlist.h"
+#include "eon.h"
+#include "mlbuf.h"
+
+// watch_job_t
+typedef struct watch_job_s {
+    buffer_t* buffer;
+    char* path;
+} watch_job_t;
+
+// watch_diff_t
+typedef struct watch_diff_s {
+    bint_t start_line;
+    bint_t old_nlines;
+    bint_t new_nlines;
+    int is_to_end;
+    off_t new_start;
+    off_t new_end;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    bint_t nmap;
+} watch_diff_t;
+
+// watch_line_t
+typedef struct watch_line_s {
+    uint64_t hash;
+    bint_t old_count;
+    bint_t new_count;
+    bint_t old_line;
+    bint_t new_line;
+    UT_hash_handle hh;
+} watch_line_t;
+
+// watch_mark_t
+typedef struct watch_mark_s {
+    mark_t* mark;
+    bint_t line;
+    bint_t col;
+} watch_mark_t;
+
+#ifdef __linux__
+static void _watch_read(async_proc_t* aproc, char* buf, size_t buf_len);
+static void _watch_check(editor_t* editor, watch_t* self);
+static int _watch_is_unchanged(buffer_t* buffer, struct stat* st);
+static int _watch_is_saving(editor_t* editor, buffer_t* buffer);
+static int _watch_is_following(editor_t* editor, buffer_t* buffer);
+static int _watch_try_append(editor_t* editor, watch_t* self, struct stat* st);
+static int _watch_tail_matches(buffer_t* buffer, int fd, off_t end);
+static int _watch_start_diff(editor_t* editor, watch_t* self);
+static int _watch_diff_child(void* udata, int wfd);
+static bint_t _watch_get_anchors(bline_t** old_lines, char* data, off_t* new_starts, bint_t start, bint_t old_end, bint_t new_end, bint_t** ret_anchors);
+static void _watch_aproc_diff_cb(async_proc_t* aproc, char* buf, size_t buf_len);
+static int _watch_apply_diff(editor_t* editor, watch_t* self, watch_diff_t* diff, bint_t* map);
+static bint_t _watch_map_line(watch_diff_t* diff, bint_t* map, bint_t line);
+static int _watch_collect_marks(bline_t* bline, bline_t* last, watch_mark_t** ret_marks, bint_t* ret_len);
+static void _watch_done(editor_t* editor, watch_t* self, struct stat* st);
+static void _watch_remove(editor_t* editor, watch_t* self);
+static uint64_t _watch_hash(char* data, bint_t len);
+#endif
+
+// Start watching open files for changes made outside eon
+int watch_init(editor_t* editor) {
+#ifdef __linux__
+  int fd;
+
+  if (!editor->auto_reload || editor->headless_mode) {
+    return EON_OK;
+  }
+
+  if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+    return EON_ERR;
+  }
+
+  editor->watch_fd = fd;
+  async_proc_new_watch(editor, editor, &editor->watch_proc, fd, _watch_read);
+#endif
+  return EON_OK;
+}
+
+// Watch the file of buffer. Files are watched through their directory, so a
+// file replaced by rename (as by git or most editors) is still seen.
+int watch_add(editor_t* editor, buffer_t* buffer) {
+#ifdef __linux__
+  watch_t* self;
+  char* path;
+  char* slash;
+  int wd;
+
+  if (!editor->watch_fd || !buffer->path) {
+    return EON_OK;
+  }
+
+  if (!(path = realpath(buffer->path, NULL))) {
+    return EON_ERR;
+  }
+
+  slash = strrchr(path, '/');
+  *slash = '\0';
+  wd = inotify_add_watch(editor->watch_fd, slash == path ? "/" : path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MASK_ADD);
+
+  HASH_FIND_PTR(editor->watch_map, &buffer, self);
+
+  if (self && (self->wd != wd || strcmp(self->name, slash + 1) != 0)) {
+    // Saved under another name
+    _watch_remove(editor, self);
+    self = NULL;
+  }
+
+  if (wd < 0 || self) {
+    free(path);
+    return wd < 0 ? EON_ERR : EON_OK;
+  }
+
+  self = calloc(1, sizeof(watch_t));
+  self->buffer = buffer;
+  self->wd = wd;
+  self->dir = strdup(slash == path ? "/" : path);
+  self->name = strdup(slash + 1);
+  HASH_ADD_PTR(editor->watch_map, buffer, self);
+  free(path);
+#endif
+  return EON_OK;
+}
+
+// Also look at the file of buffer on every write rather than only when the
+// writer closes it, as a log being followed is never closed
+int watch_follow(editor_t* editor, buffer_t* buffer) {
+#ifdef __linux__
+  watch_t* self;
+
+  HASH_FIND_PTR(editor->watch_map, &buffer, self);
+
+  if (!self || inotify_add_watch(editor->watch_fd, self->dir, IN_MODIFY | IN_MASK_ADD) < 0) {
+    return EON_ERR;
+  }
+
+  return EON_OK;
+#else
+  return EON_ERR;
+#endif
+}
+
+// Stop watching the file of a buffer that is about to be destroyed
+int watch_destroy(editor_t* editor, buffer_t* buffer) {
+#ifdef __linux__
+  watch_t* self;
+
+  HASH_FIND_PTR(editor->watch_map, &buffer, self);
+
+  if (self) _watch_remove(editor, self);
+#endif
+  return EON_OK;
+}
+
+// Append the next chunk of files that grew by more than one read
+int watch_idle(editor_t* editor) {
+#ifdef __linux__
+  watch_t* self;
+  watch_t* tmp;
+
+  HASH_ITER(hh, editor->watch_map, self, tmp) {
+    if (!self->is_append_pending) continue;
+
+    self->is_append_pending = 0;
+    _watch_check(editor, self);
+  }
+#endif
+  return EON_OK;
+}
+
+// Return 0 if watch_idle has chunks left to append, or -1 if not. The editor
+// loop stops waiting for input then.
+int watch_idle_timeout(editor_t* editor) {
+#ifdef __linux__
+  watch_t* self;
+  watch_t* tmp;
+
+  HASH_ITER(hh, editor->watch_map, self, tmp) {
+    if (self->is_append_pending) return 0;
+  }
+#endif
+  return -1;
+}
+
+// Stop watching altogether
+int watch_deinit(editor_t* editor) {
+#ifdef __linux__
+  watch_t* self;
+  watch_t* tmp;
+
+  HASH_ITER(hh, editor->watch_map, self, tmp) {
+    _watch_remove(editor, self);
+  }
+
+  if (editor->watch_proc) async_proc_destroy(editor->watch_proc, 0);
+
+  if (editor->watch_fd) {
+    close(editor->watch_fd);
+    editor->watch_fd = 0;
+  }
+#endif
+  return EON_OK;
+}
+
+#ifdef __linux__
+// Look at the files that inotify says were written. A file written many times
+// since the last read is looked at once.
+static void _watch_read(async_proc_t* aproc, char* buf, size_t buf_len) {
+  editor_t* editor;
+  watch_t* self;
+  watch_t* tmp;
+  struct inotify_event* event;
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t nbytes;
+  char* cur;
+
+  editor = aproc->editor;
+
+  while ((nbytes = read(editor->watch_fd, events, sizeof(events))) > 0) {
+    for (cur = events; cur < events + nbytes; cur += sizeof(struct inotify_event) + event->len) {
+      event = (struct inotify_event*)cur;
+
+      HASH_ITER(hh, editor->watch_map, self, tmp) {
+        if (event->mask & IN_Q_OVERFLOW) {
+          // Events were lost; look at everything
+          self->is_pending = 1;
+
+        } else if (event->len > 0 && self->wd == event->wd && strcmp(self->name, event->name) == 0) {
+          // Another buffer in the same directory may be followed
+          if (!(event->mask & IN_MODIFY) || _watch_is_following(editor, self->buffer)) {
+            self->is_pending = 1;
+          }
+        }
+      }
+    }
+  }
+
+  HASH_ITER(hh, editor->watch_map, self, tmp) {
+    if (!self->is_pending) continue;
+
+    self->is_pending = 0;
+    _watch_check(editor, self);
+  }
+}
+
+// Reload a buffer whose file changed, unless it has edits of its own
+static void _watch_check(editor_t* editor, watch_t* self) {
+  buffer_t* buffer;
+  struct stat st;
+
+  buffer = self->buffer;
+
+  if (stat(buffer->path, &st) != 0 || _watch_is_unchanged(buffer, &st)) {
+    // Deleted, or our own save
+    return;
+
+  } else if (_watch_is_saving(editor, buffer)) {
+    return;
+
+  } else if (buffer->is_unsaved) {
+    if (!self->is_warned) {
+      EON_SET_INFO(editor, "%s changed on disk; not reloading over unsaved changes", buffer->path);
+      self->is_warned = 1;
+    }
+    return;
+
+  } else if (self->diff_proc) {
+    // Look again once the running diff is in
+    self->is_diff_stale = 1;
+    return;
+  }
+
+  if (_watch_try_append(editor, self, &st) != EON_OK) {
+    _watch_start_diff(editor, self);
+  }
+}
+
+// Return 1 if st is the file as the buffer last loaded or saved it
+static int _watch_is_unchanged(buffer_t* buffer, struct stat* st) {
+  return st->st_dev == buffer->st.st_dev
+    && st->st_ino == buffer->st.st_ino
+    && st->st_size == buffer->st.st_size
+    && st->st_mtim.tv_sec == buffer->st.st_mtim.tv_sec
+    && st->st_mtim.tv_nsec == buffer->st.st_mtim.tv_nsec;
+}
+
+// Return 1 if a background save of buffer is running
+static int _watch_is_saving(editor_t* editor, buffer_t* buffer) {
+  bview_t* bview;
+
+  CDL_FOREACH2(editor->all_bviews, bview, all_next) {
+    if (bview->buffer == buffer && bview->save_proc) return 1;
+  }
+
+  return 0;
+}
+
+// Return 1 if a bview of buffer is in follow mode
+static int _watch_is_following(editor_t* editor, buffer_t* buffer) {
+  bview_t* bview;
+
+  CDL_FOREACH2(editor->all_bviews, bview, all_next) {
+    if (bview->buffer == buffer && bview->is_following) return 1;
+  }
+
+  return 0;
+}
+
+// If the file only grew, append the new bytes. Only the appended bytes and a
+// sample of the old tail are read, so this costs the same for any file size.
+// At most EON_WATCH_APPEND_CHUNK bytes are read per call; watch_idle appends
+// the rest a chunk at a time, with a frame and any input in between.
+static int _watch_try_append(editor_t* editor, watch_t* self, struct stat* st) {
+  buffer_t* buffer;
+  watch_mark_t* marks;
+  bview_t** pinned;
+  bview_t* bview;
+  baction_t* appended;
+  mark_t* end;
+  bint_t nmarks;
+  bint_t i;
+  int npinned;
+  int is_following;
+  off_t old_size;
+  off_t len;
+  char* data;
+  char* nl;
+  int fd;
+
+  buffer = self->buffer;
+  old_size = buffer->st.st_size;
+
+  if (st->st_dev != buffer->st.st_dev
+    || st->st_ino != buffer->st.st_ino
+    || st->st_size <= old_size
+    || buffer->byte_count != (bint_t)old_size
+  ) {
+    return EON_ERR;
+  }
+
+  if ((fd = open(buffer->path, O_RDONLY)) < 0) {
+    return EON_ERR;
+  }
+
+  len = EON_MIN(st->st_size - old_size, (off_t)EON_WATCH_APPEND_CHUNK);
+  data = malloc(len);
+
+  if (!_watch_tail_matches(buffer, fd, old_size) || pread(fd, data, len, old_size) != len) {
+    close(fd);
+    free(data);
+    return EON_ERR;
+  }
+
+  close(fd);
+
+  // A partial read stops after its last newline so no line or char is split,
+  // unless a single line fills the chunk
+  if (old_size + len < st->st_size && (nl = memrchr(data, '\n', len)) != NULL) {
+    len = nl - data + 1;
+  }
+
+  // Followed bviews that show the end keep showing it
+  pinned = NULL;
+  npinned = 0;
+
+  CDL_FOREACH2(editor->all_bviews, bview, all_next) {
+    if (bview->buffer == buffer && bview->is_following && bview_is_at_end(bview)) {
+      pinned = realloc(pinned, sizeof(bview_t*) * (npinned + 1));
+      pinned[npinned++] = bview;
+    }
+  }
+
+  // Other marks at the end stay put rather than ride along with the insert
+  MLBUF_BLINE_ENSURE_CHARS(buffer->last_line);
+  _watch_collect_marks(buffer->last_line, buffer->last_line, &marks, &nmarks);
+
+  // A followed log is not something to undo; keep its appends out of the
+  // history so it does not grow with the file
+  is_following = _watch_is_following(editor, buffer);
+  if (is_following) undo_suspend(editor, buffer, 1);
+
+  end = buffer_add_mark(buffer, buffer->last_line, buffer->last_line->char_count);
+  journal_suspend(editor, buffer, 1);
+  mark_insert_before(end, data, (bint_t)len);
+  journal_suspend(editor, buffer, 0);
+  mark_destroy(end);
+
+  for (i = 0; i < nmarks; i++) {
+    mark_move_to(marks[i].mark, marks[i].line, marks[i].col);
+  }
+
+  if (marks) free(marks);
+  free(data);
+
+  // Search only the new lines
+  appended = buffer->action_tail;
+  CDL_FOREACH2(editor->all_bviews, bview, all_next) {
+    if (bview->buffer == buffer) isearch_update_append(bview, appended);
+  }
+
+  if (is_following) {
+    undo_suspend(editor, buffer, 0);
+    CDL_FOREACH2(editor->all_bviews, bview, all_next) {
+      if (bview->buffer == buffer) isearch_update_tail(bview, appended);
+    }
+  }
+
+  for (i = 0; i < npinned; i++) {
+    mark_move_end(pinned[i]->active_cursor->mark);
+    bview_max_viewport_y(pinned[i]);
+  }
+
+  if (pinned) free(pinned);
+
+  // Leave the rest of a big append to watch_idle. If it grew again since, the
+  // next event takes that.
+  self->is_append_pending = old_size + len < st->st_size ? 1 : 0;
+  st->st_size = old_size + len;
+  _watch_done(editor, self, st);
+  return EON_OK;
+}
+
+// Return 1 if the file at fd ends like the buffer does, up to end. Up to
+// EON_WATCH_TAIL_CHECK bytes are compared.
+static int _watch_tail_matches(buffer_t* buffer, int fd, off_t end) {
+  char buf[EON_WATCH_TAIL_CHECK];
+  bline_t* bline;
+  bint_t left;
+  bint_t n;
+  off_t pos;
+
+  left = EON_WATCH_TAIL_CHECK;
+  pos = end;
+
+  for (bline = buffer->last_line; bline && left > 0; bline = bline->prev) {
+    n = EON_MIN(bline->data_len, left);
+
+    if (n > 0
+      && (pread(fd, buf, n, pos - n) != n || memcmp(buf, bline->data + bline->data_len - n, n) != 0)
+    ) {
+      return 0;
+    }
+
+    left -= n;
+    pos -= bline->data_len;
+
+    if (!bline->prev || left < 1) break;
+
+    // The newline ending the line before
+    if (pread(fd, buf, 1, pos - 1) != 1 || buf[0] != '\n') {
+      return 0;
+    }
+
+    left -= 1;
+    pos -= 1;
+  }
+
+  return 1;
+}
+
+// Diff the buffer against the file in a forked child. The child sees a
+// snapshot of the buffer, so editing carries on meanwhile; the result is
+// dropped if the buffer was edited.
+static int _watch_start_diff(editor_t* editor, watch_t* self) {
+  watch_job_t job;
+
+  job.buffer = self->buffer;
+  job.path = self->buffer->path;
+  self->diff_action_tail = self->buffer->action_tail;
+  self->is_diff_stale = 0;
+  str_clear(&self->diff_out);
+
+  if (!async_proc_new_fn(editor, self, &self->diff_proc, _watch_diff_child, &job, _watch_aproc_diff_cb)) {
+    return EON_ERR;
+  }
+
+  return EON_OK;
+}
+
+// Find the lines that changed, as one hunk between the common prefix and
+// suffix, and write a watch_diff_t with where the old lines holding marks
+// went. Lines inside the hunk are matched by patience anchors (lines that
+// occur once on each side).
+static int _watch_diff_child(void* udata, int wfd) {
+  watch_job_t* job;
+  watch_diff_t diff;
+  struct stat st;
+  bline_t** old_lines;
+  bline_t* bline;
+  off_t* new_starts;
+  bint_t* anchors;
+  bint_t* map;
+  bint_t nanchors;
+  bint_t old_n;
+  bint_t new_n;
+  bint_t new_cap;
+  bint_t p;
+  bint_t s;
+  bint_t a;
+  bint_t i;
+  off_t off;
+  char* data;
+  int fd;
+  int rc;
+
+  job = (watch_job_t*)udata;
+
+  if ((fd = open(job->path, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    return EON_ERR;
+  }
+
+  data = NULL;
+
+  if (st.st_size > 0 && (data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return EON_ERR;
+  }
+
+  // Index both sides by line
+  old_n = job->buffer->line_count;
+  old_lines = malloc(sizeof(bline_t*) * old_n);
+
+  for (bline = job->buffer->first_line, i = 0; bline && i < old_n; bline = bline->next, i++) {
+    old_lines[i] = bline;
+  }
+
+  new_cap = 1024;
+  new_starts = malloc(sizeof(off_t) * (new_cap + 1));
+  new_starts[0] = 0;
+  new_n = 1;
+
+  for (off = 0; off < st.st_size; off++) {
+    if (data[off] != '\n') continue;
+
+    if (new_n >= new_cap) {
+      new_cap *= 2;
+      new_starts = realloc(new_starts, sizeof(off_t) * (new_cap + 1));
+    }
+
+    new_starts[new_n++] = off + 1;
+  }
+
+  new_starts[new_n] = st.st_size + 1; // as if a newline followed the file
+
+  #define WATCH_NEW_LEN(pi) (new_starts[(pi) + 1] - new_starts[(pi)] - 1)
+  #define WATCH_LINE_EQ(oi, ni) ( \
+    old_lines[(oi)]->data_len == WATCH_NEW_LEN(ni) \
+    && (WATCH_NEW_LEN(ni) == 0 || memcmp(old_lines[(oi)]->data, data + new_starts[(ni)], WATCH_NEW_LEN(ni)) == 0) \
+  )
+
+  // The last lines are left to the suffix, so a hunk never ends mid-line
+  for (p = 0; p < EON_MIN(old_n, new_n) - 1 && WATCH_LINE_EQ(p, p); p++);
+  for (s = 0; s < EON_MIN(old_n, new_n) - p && WATCH_LINE_EQ(old_n - 1 - s, new_n - 1 - s); s++);
+
+  memset(&diff, 0, sizeof(watch_diff_t));
+  diff.start_line = p;
+  diff.old_nlines = old_n - p - s;
+  diff.new_nlines = new_n - p - s;
+  diff.is_to_end = s == 0 ? 1 : 0;
+  diff.new_start = new_starts[p];
+  diff.new_end = s > 0 ? new_starts[new_n - s] : st.st_size;
+  diff.dev = st.st_dev;
+  diff.ino = st.st_ino;
+  diff.size = st.st_size;
+  diff.mtime = st.st_mtim;
+
+  // Map old lines in the hunk that hold marks: anchored lines exactly, others
+  // by their distance from the anchor above
+  nanchors = _watch_get_anchors(old_lines, data, new_starts, p, old_n - s, new_n - s, &anchors);
+  map = malloc(sizeof(bint_t) * 2 * (diff.old_nlines + 1));
+  a = 0;
+
+  for (i = p; i < old_n - s; i++) {
+    while (a < nanchors && anchors[a * 2] <= i) a++;
+
+    if (!old_lines[i]->marks) continue;
+
+    map[diff.nmap * 2] = i;
+
+    if (a > 0) {
+      map[diff.nmap * 2 + 1] = anchors[(a - 1) * 2 + 1] + (i - anchors[(a - 1) * 2]);
+    } else {
+      map[diff.nmap * 2 + 1] = i;
+    }
+
+    // Stay above the next anchor and inside the hunk
+    if (a < nanchors) {
+      map[diff.nmap * 2 + 1] = EON_MIN(map[diff.nmap * 2 + 1], EON_MAX(p, anchors[a * 2 + 1] - 1));
+    }
+
+    map[diff.nmap * 2 + 1] = EON_MAX(p, EON_MIN(map[diff.nmap * 2 + 1], p + EON_MAX(0, diff.new_nlines - 1)));
+    diff.nmap += 1;
+  }
+
+  #undef WATCH_LINE_EQ
+  #undef WATCH_NEW_LEN
+
+  rc = write(wfd, &diff, sizeof(watch_diff_t)) == sizeof(watch_diff_t) ? EON_OK : EON_ERR;
+
+  if (rc == EON_OK && diff.nmap > 0) {
+    rc = write(wfd, map, sizeof(bint_t) * 2 * diff.nmap) < 0 ? EON_ERR : EON_OK;
+  }
+
+  // The process exits next; leave the rest to it
+  return rc;
+}
+
+// Set ret_anchors to pairs of (old line, new line) in the hunk that occur
+// once on each side, trimmed to the longest run that is in order on both
+// sides. Return the number of pairs.
+static bint_t _watch_get_anchors(bline_t** old_lines, char* data, off_t* new_starts, bint_t start, bint_t old_end, bint_t new_end, bint_t** ret_anchors) {
+  watch_line_t* lines;
+  watch_line_t* line;
+  watch_line_t* tmp;
+  bint_t* cands;
+  bint_t* tails;
+  bint_t* prevs;
+  bint_t* anchors;
+  bint_t ncands;
+  bint_t ntails;
+  bint_t lo;
+  bint_t hi;
+  bint_t mid;
+  bint_t i;
+  bint_t k;
+  uint64_t hash;
+
+  lines = NULL;
+  *ret_anchors = NULL;
+
+  for (i = start; i < old_end; i++) {
+    hash = _watch_hash(old_lines[i]->data, old_lines[i]->data_len);
+    HASH_FIND(hh, lines, &hash, sizeof(uint64_t), line);
+
+    if (!line) {
+      line = calloc(1, sizeof(watch_line_t));
+      line->hash = hash;
+      line->old_line = i;
+      HASH_ADD(hh, lines, hash, sizeof(uint64_t), line);
+    }
+
+    line->old_count += 1;
+  }
+
+  for (i = start; i < new_end; i++) {
+    hash = _watch_hash(data + new_starts[i], new_starts[i + 1] - new_starts[i] - 1);
+    HASH_FIND(hh, lines, &hash, sizeof(uint64_t), line);
+
+    if (line) {
+      line->new_count += 1;
+      line->new_line = i;
+    }
+  }
+
+  // Unique pairs in old line order
+  cands = malloc(sizeof(bint_t) * 2 * (old_end - start + 1));
+  ncands = 0;
+
+  for (i = start; i < old_end; i++) {
+    hash = _watch_hash(old_lines[i]->data, old_lines[i]->data_len);
+    HASH_FIND(hh, lines, &hash, sizeof(uint64_t), line);
+
+    if (line->old_count == 1 && line->new_count == 1
+      && old_lines[i]->data_len == new_starts[line->new_line + 1] - new_starts[line->new_line] - 1
+      && (old_lines[i]->data_len == 0 || memcmp(old_lines[i]->data, data + new_starts[line->new_line], old_lines[i]->data_len) == 0)
+    ) {
+      cands[ncands * 2] = i;
+      cands[ncands * 2 + 1] = line->new_line;
+      ncands += 1;
+    }
+  }
+
+  HASH_ITER(hh, lines, line, tmp) {
+    HASH_DEL(lines, line);
+    free(line);
+  }
+
+  // Longest increasing run of new lines (patience sorting)
+  tails = malloc(sizeof(bint_t) * (ncands + 1));
+  prevs = malloc(sizeof(bint_t) * (ncands + 1));
+  ntails = 0;
+
+  for (i = 0; i < ncands; i++) {
+    lo = 0;
+    hi = ntails;
+
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+
+      if (cands[tails[mid] * 2 + 1] < cands[i * 2 + 1]) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+
+    prevs[i] = lo > 0 ? tails[lo - 1] : -1;
+    tails[lo] = i;
+    if (lo == ntails) ntails += 1;
+  }
+
+  anchors = malloc(sizeof(bint_t) * 2 * (ntails + 1));
+
+  for (k = ntails - 1, i = ntails > 0 ? tails[ntails - 1] : -1; k >= 0 && i >= 0; k--, i = prevs[i]) {
+    anchors[k * 2] = cands[i * 2];
+    anchors[k * 2 + 1] = cands[i * 2 + 1];
+  }
+
+  free(cands);
+  free(tails);
+  free(prevs);
+  *ret_anchors = anchors;
+  return ntails;
+}
+
+// Collect the diff from the child and apply it once it is all in
+static void _watch_aproc_diff_cb(async_proc_t* aproc, char* buf, size_t buf_len) {
+  editor_t* editor;
+  watch_t* self;
+  watch_diff_t diff;
+
+  self = (watch_t*)aproc->owner;
+  editor = aproc->editor;
+
+  if (buf_len > 0) {
+    str_append_len(&self->diff_out, buf, buf_len);
+    return;
+  }
+
+  // Done. Let go of the proc first so a new diff can take its place.
+  aproc->owner_aproc = NULL;
+  self->diff_proc = NULL;
+
+  if (self->diff_out.len >= sizeof(watch_diff_t)) {
+    memcpy(&diff, self->diff_out.data, sizeof(watch_diff_t));
+
+    if (self->diff_out.len == sizeof(watch_diff_t) + sizeof(bint_t) * 2 * diff.nmap
+      && self->buffer->action_tail == self->diff_action_tail
+      && !self->buffer->is_unsaved
+    ) {
+      _watch_apply_diff(editor, self, &diff, (bint_t*)(self->diff_out.data + sizeof(watch_diff_t)));
+    }
+  }
+
+  str_clear(&self->diff_out);
+
+  if (self->is_diff_stale) {
+    self->is_diff_stale = 0;
+    _watch_check(editor, self);
+  }
+}
+
+// Replace the hunk with the new lines from the file, as one undo step, and
+// put marks back where their lines went
+static int _watch_apply_diff(editor_t* editor, watch_t* self, watch_diff_t* diff, bint_t* map) {
+  buffer_t* buffer;
+  watch_mark_t* marks;
+  struct stat st;
+  bline_t* first;
+  bline_t* last;
+  mark_t* start;
+  mark_t* end;
+  bint_t nmarks;
+  bint_t nactions;
+  bint_t i;
+  off_t len;
+  char* data;
+  int fd;
+
+  buffer = self->buffer;
+
+  if ((fd = open(buffer->path, O_RDONLY)) < 0) {
+    return EON_ERR;
+  }
+
+  // Read the new lines, unless the file changed again since the child read it
+  len = diff->new_end - diff->new_start;
+  data = malloc(EON_MAX(1, len));
+
+  if (fstat(fd, &st) != 0
+    || st.st_dev != diff->dev
+    || st.st_ino != diff->ino
+    || st.st_size != diff->size
+    || st.st_mtim.tv_sec != diff->mtime.tv_sec
+    || st.st_mtim.tv_nsec != diff->mtime.tv_nsec
+    || (len > 0 && pread(fd, data, len, diff->new_start) != len)
+  ) {
+    close(fd);
+    free(data);
+    self->is_diff_stale = 1;
+    return EON_ERR;
+  }
+
+  close(fd);
+
+  if (diff->old_nlines < 1 && len < 1) {
+    // Same content; only the timestamp moved
+    free(data);
+    _watch_done(editor, self, &st);
+    return EON_OK;
+  }
+
+  // Note where marks in and just below the hunk belong
+  buffer_get_bline(buffer, diff->start_line, &first);
+
+  if (diff->is_to_end) {
+    last = buffer->last_line;
+  } else {
+    buffer_get_bline(buffer, diff->start_line + diff->old_nlines, &last);
+  }
+
+  _watch_collect_marks(first, last, &marks, &nmarks);
+
+  for (i = 0; i < nmarks; i++) {
+    marks[i].line = _watch_map_line(diff, map, marks[i].line);
+  }
+
+  // Swap the lines
+  MLBUF_BLINE_ENSURE_CHARS(last);
+  start = buffer_add_mark(buffer, first, 0);
+  end = buffer_add_mark(buffer, last, diff->is_to_end ? last->char_count : 0);
+  nactions = 0;
+
+  journal_suspend(editor, buffer, 1);
+
+  if (!mark_is_eq(start, end)) {
+    mark_delete_between_mark(start, end);
+    nactions += 1;
+  }
+
+  if (len > 0) {
+    mark_insert_before(start, data, (bint_t)len);
+    nactions += 1;
+  }
+
+  journal_suspend(editor, buffer, 0);
+
+  if (nactions > 1) undo_join(editor, buffer);
+
+  mark_destroy(start);
+  mark_destroy(end);
+
+  for (i = 0; i < nmarks; i++) {
+    mark_move_to(marks[i].mark, marks[i].line, marks[i].col);
+  }
+
+  if (marks) free(marks);
+  free(data);
+
+  _watch_done(editor, self, &st);
+  EON_SET_INFO(editor, "Reloaded %s (changed on disk)", buffer->path);
+  return EON_OK;
+}
+
+// Return the new line of old line in the hunk or the line just below it
+static bint_t _watch_map_line(watch_diff_t* diff, bint_t* map, bint_t line) {
+  bint_t lo;
+  bint_t hi;
+  bint_t mid;
+
+  if (line >= diff->start_line + diff->old_nlines) {
+    return line - diff->old_nlines + diff->new_nlines;
+  }
+
+  lo = 0;
+  hi = diff->nmap;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+
+    if (map[mid * 2] < line) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo < diff->nmap && map[lo * 2] == line) {
+    return map[lo * 2 + 1];
+  }
+
+  // Marked since the diff started
+  return diff->start_line + EON_MIN(line - diff->start_line, EON_MAX(0, diff->new_nlines - 1));
+}
+
+// Collect the marks on lines bline to last with their line and column
+static int _watch_collect_marks(bline_t* bline, bline_t* last, watch_mark_t** ret_marks, bint_t* ret_len) {
+  watch_mark_t* marks;
+  mark_t* mark;
+  bint_t cap;
+  bint_t len;
+
+  marks = NULL;
+  cap = 0;
+  len = 0;
+
+  for (; bline; bline = bline->next) {
+    DL_FOREACH(bline->marks, mark) {
+      if (len >= cap) {
+        cap = EON_MAX(16, cap * 2);
+        marks = realloc(marks, sizeof(watch_mark_t) * cap);
+      }
+
+      marks[len].mark = mark;
+      marks[len].line = bline->line_index;
+      marks[len].col = mark->col;
+      len += 1;
+    }
+
+    if (bline == last) break;
+  }
+
+  *ret_marks = marks;
+  *ret_len = len;
+  return EON_OK;
+}
+
+// The buffer matches the file again
+static void _watch_done(editor_t* editor, watch_t* self, struct stat* st) {
+  memcpy(&self->buffer->st, st, sizeof(struct stat));
+  self->buffer->is_unsaved = 0;
+  self->is_warned = 0;
+  journal_rebase(editor, self->buffer, -1);
+}
+
+// Forget a watch, dropping the inotify watch on its directory if no other
+// buffer lives there
+static void _watch_remove(editor_t* editor, watch_t* self) {
+  watch_t* other;
+  watch_t* tmp;
+  int is_shared;
+
+  if (self->diff_proc) {
+    // Nobody wants this diff any more
+    kill(self->diff_proc->pid, SIGKILL);
+    async_proc_destroy(self->diff_proc, 0);
+  }
+
+  HASH_DEL(editor->watch_map, self);
+  is_shared = 0;
+
+  HASH_ITER(hh, editor->watch_map, other, tmp) {
+    if (other->wd == self->wd) is_shared = 1;
+  }
+
+  if (!is_shared) inotify_rm_watch(editor->watch_fd, self->wd);
+
+  str_free(&self->diff_out);
+  free(self->dir);
+  free(self->name);
+  free(self);
+}
+
+// Return an FNV-1a hash of a line
+static uint64_t _watch_hash(char* data, bint_t len) {
+  uint64_t hash;
+  bint_t i;
+
+  hash = 14695981039346656037ULL;
+
+  for (i = 0; i < len; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+#endif
@@ -0,0 +1,489 @@
+#include <stdlib.h>
+#include <string.h>
+#include "eon.h"
+#include "mlbuf.h"
+
+static wrap_t* _wrap_ensure(bview_t* bview);
+static void _wrap_rebuild(bview_t* bview, wrap_t* wrap);
+static bint_t _wrap_measure(bline_t* bline, int w);
+static bint_t _wrap_find_line(wrap_t* wrap, bint_t line_index, bint_t* ret_offset);
+static bint_t _wrap_tree_sum(bint_t* tree, bint_t pos);
+static void _wrap_tree_add(bint_t* tree, bint_t n, bint_t pos, bint_t delta);
+static void _wrap_tree_build(wrap_t* wrap);
+static void _wrap_set_rows(wrap_t* wrap, bint_t line_index, bint_t rows);
+static void _wrap_insert(wrap_t* wrap, bint_t line_index, bint_t* rows, bint_t count);
+static void _wrap_remove(wrap_t* wrap, bint_t line_index, bint_t count);
+static wrap_block_t* _wrap_splice_blocks(wrap_t* wrap, bint_t at, bint_t nremove, bint_t nadd);
+static void _wrap_free_blocks(wrap_t* wrap);
+
+// Return 1 if bview soft wraps its lines, else 0
+int wrap_is_enabled(bview_t* bview) {
+  return bview->editor->soft_wrap
+    && EON_BVIEW_IS_EDIT(bview)
+    && bview->rect_buffer.w > 0 ? 1 : 0;
+}
+
+// Return number of display rows bline takes when wrapped at width w. The cell
+// after the last char gets a row too, so a cursor at eol always fits.
+bint_t wrap_rows_for_bline(bline_t* bline, int w) {
+  MLBUF_BLINE_ENSURE_CHARS(bline);
+  return w < 1 ? 1 : bline->char_vwidth / w + 1;
+}
+
+// Return the display row of the first row of line_index
+bint_t wrap_row_of_line(bview_t* bview, bint_t line_index) {
+  wrap_t* wrap;
+  wrap_block_t* block;
+  bint_t offset;
+  bint_t b;
+  bint_t row;
+  bint_t i;
+
+  if (!(wrap = _wrap_ensure(bview))) {
+    return line_index;
+  }
+
+  b = _wrap_find_line(wrap, EON_MIN(line_index, wrap->n), &offset);
+  row = _wrap_tree_sum(wrap->row_tree, b);
+
+  if (b < wrap->nblocks) {
+    block = &wrap->blocks[b];
+    for (i = 0; i < offset; i++) row += block->rows[i];
+  }
+
+  return row;
+}
+
+// Return the line shown at display row. Set optret_subrow to the wrapped row
+// within that line.
+bint_t wrap_line_at_row(bview_t* bview, bint_t row, bint_t* optret_subrow) {
+  wrap_t* wrap;
+  wrap_block_t* block;
+  bint_t pos;
+  bint_t step;
+  bint_t i;
+
+  if (!(wrap = _wrap_ensure(bview)) || wrap->n < 1) {
+    if (optret_subrow) *optret_subrow = 0;
+    return row;
+  }
+
+  if (row < 0) row = 0;
+
+  // Walk down the block tree for the last block starting at or before row
+  for (step = 1; step * 2 <= wrap->nblocks; step *= 2);
+
+  for (pos = 0; step > 0; step /= 2) {
+    if (pos + step <= wrap->nblocks && wrap->row_tree[pos + step] <= row) {
+      pos += step;
+      row -= wrap->row_tree[pos];
+    }
+  }
+
+  if (pos >= wrap->nblocks) {
+    // Past the end; clamp to last row of last line
+    block = &wrap->blocks[wrap->nblocks - 1];
+    if (optret_subrow) *optret_subrow = block->rows[block->len - 1] - 1;
+    return wrap->n - 1;
+  }
+
+  // Then scan the block itself
+  block = &wrap->blocks[pos];
+  for (i = 0; i < block->len - 1 && row >= block->rows[i]; i++) {
+    row -= block->rows[i];
+  }
+
+  if (optret_subrow) *optret_subrow = row;
+
+  return _wrap_tree_sum(wrap->line_tree, pos) + i;
+}
+
+// Return total number of display rows
+bint_t wrap_row_count(bview_t* bview) {
+  wrap_t* wrap;
+
+  if (!(wrap = _wrap_ensure(bview))) {
+    return bview->buffer->line_count;
+  }
+
+  return _wrap_tree_sum(wrap->row_tree, wrap->nblocks);
+}
+
+// Recount the rows of one edited or freshly drawn line
+int wrap_update_line(bview_t* bview, bline_t* bline) {
+  wrap_t* wrap;
+
+  wrap = bview->wrap;
+
+  if (!wrap || wrap->is_dirty || bline->line_index >= wrap->n) {
+    return EON_OK;
+  }
+
+  _wrap_set_rows(wrap, bline->line_index, wrap_rows_for_bline(bline, wrap->w));
+
+  return EON_OK;
+}
+
+// Keep the index current after an edit that added or removed lines. Entries
+// for removed lines are dropped and ones for new lines spliced in, so the
+// cost is bounded by the lines touched plus one block, not the buffer.
+int wrap_update_lines(bview_t* bview, baction_t* action) {
+  wrap_t* wrap;
+  buffer_t* buffer;
+  bline_t* bline;
+  bint_t* rows;
+  bint_t start;
+  bint_t nadd;
+  bint_t nremove;
+  bint_t i;
+
+  wrap = bview->wrap;
+  buffer = bview->buffer;
+
+  if (!wrap || wrap->is_dirty) {
+    return EON_OK;
+  }
+
+  // An undo or redo replays an older action whose deltas no longer describe
+  // this edit
+  if (action != buffer->action_tail
+      || buffer->action_undone
+      || !action->start_line
+      || action->start_line_index + EON_MAX(0, -action->line_delta) >= wrap->n
+     ) {
+    return wrap_invalidate(bview);
+  }
+
+  start = action->start_line_index;
+  nadd = EON_MAX(0, action->line_delta);
+  nremove = EON_MAX(0, -action->line_delta);
+
+  if (nremove > 0) {
+    _wrap_remove(wrap, start + 1, nremove);
+  }
+
+  if (nadd > 0) {
+    rows = malloc(sizeof(bint_t) * nadd);
+    for (i = 0, bline = action->start_line->next; i < nadd; i++) {
+      rows[i] = bline ? _wrap_measure(bline, wrap->w) : 1;
+      if (bline) bline = bline->next;
+    }
+    _wrap_insert(wrap, start + 1, rows, nadd);
+    free(rows);
+  }
+
+  _wrap_set_rows(wrap, start, wrap_rows_for_bline(action->start_line, wrap->w));
+
+  if (wrap->n != buffer->line_count) {
+    wrap->is_dirty = 1;
+  }
+
+  return EON_OK;
+}
+
+// Mark the index stale (buffer replaced or edit replayed)
+int wrap_invalidate(bview_t* bview) {
+  if (bview->wrap) bview->wrap->is_dirty = 1;
+
+  return EON_OK;
+}
+
+// Free the index
+int wrap_destroy(bview_t* bview) {
+  if (!bview->wrap) return EON_OK;
+
+  _wrap_free_blocks(bview->wrap);
+  if (bview->wrap->blocks) free(bview->wrap->blocks);
+  if (bview->wrap->line_tree) free(bview->wrap->line_tree);
+  if (bview->wrap->row_tree) free(bview->wrap->row_tree);
+
+  free(bview->wrap);
+  bview->wrap = NULL;
+  return EON_OK;
+}
+
+// Return an up-to-date index, or NULL if bview does not wrap
+static wrap_t* _wrap_ensure(bview_t* bview) {
+  wrap_t* wrap;
+
+  if (!wrap_is_enabled(bview)) {
+    return NULL;
+  }
+
+  if (!bview->wrap) {
+    bview->wrap = calloc(1, sizeof(wrap_t));
+    bview->wrap->is_dirty = 1;
+  }
+
+  wrap = bview->wrap;
+
+  if (wrap->is_dirty
+      || wrap->w != bview->rect_buffer.w
+      || wrap->tab_width != bview->buffer->tab_width
+      || wrap->n != bview->buffer->line_count
+     ) {
+    _wrap_rebuild(bview, wrap);
+  }
+
+  return wrap;
+}
+
+// Count rows of every line into blocks and build the block trees. Lines are
+// not decoded here; see _wrap_measure.
+static void _wrap_rebuild(bview_t* bview, wrap_t* wrap) {
+  wrap_block_t* block;
+  bline_t* bline;
+  bint_t n;
+  bint_t fill;
+  bint_t i;
+
+  n = bview->buffer->line_count;
+  fill = EON_WRAP_BLOCK_SIZE * 3 / 4;
+
+  _wrap_free_blocks(wrap);
+  _wrap_splice_blocks(wrap, 0, 0, EON_MAX(1, (n + fill - 1) / fill));
+
+  wrap->n = n;
+  wrap->w = bview->rect_buffer.w;
+  wrap->tab_width = bview->buffer->tab_width;
+
+  block = wrap->blocks;
+  for (i = 0, bline = bview->buffer->first_line; i < n; i++) {
+    if (block->len >= fill) block += 1;
+    block->rows[block->len] = bline ? _wrap_measure(bline, wrap->w) : 1;
+    block->sum += block->rows[block->len];
+    block->len += 1;
+    if (bline) bline = bline->next;
+  }
+
+  _wrap_tree_build(wrap);
+  wrap->is_dirty = 0;
+}
+
+// Return the rows of bline at width w. A line whose chars are not decoded (or
+// were evicted) is estimated from its byte length, exact for plain ASCII, so
+// building the index never decodes the buffer. bview_draw corrects the count
+// of each line it shows via wrap_update_line.
+static bint_t _wrap_measure(bline_t* bline, int w) {
+  if (w < 1) return 1;
+  if (bline->is_chars_dirty) return bline->data_len / w + 1;
+  return bline->char_vwidth / w + 1;
+}
+
+// Return the block holding line_index and set ret_offset to its position
+// within the block. line_index == n maps past the last block.
+static bint_t _wrap_find_line(wrap_t* wrap, bint_t line_index, bint_t* ret_offset) {
+  bint_t pos;
+  bint_t step;
+
+  for (step = 1; step * 2 <= wrap->nblocks; step *= 2);
+
+  for (pos = 0; step > 0; step /= 2) {
+    if (pos + step <= wrap->nblocks && wrap->line_tree[pos + step] <= line_index) {
+      pos += step;
+      line_index -= wrap->line_tree[pos];
+    }
+  }
+
+  *ret_offset = line_index;
+  return pos;
+}
+
+// Return the sum of the first pos entries of a block tree
+static bint_t _wrap_tree_sum(bint_t* tree, bint_t pos) {
+  bint_t sum;
+
+  for (sum = 0; pos > 0; pos -= pos & -pos) {
+    sum += tree[pos];
+  }
+
+  return sum;
+}
+
+// Add delta to entry pos (1-based) of a block tree
+static void _wrap_tree_add(bint_t* tree, bint_t n, bint_t pos, bint_t delta) {
+  for (; pos <= n; pos += pos & -pos) {
+    tree[pos] += delta;
+  }
+}
+
+// Build the line and row trees over the blocks in O(blocks)
+static void _wrap_tree_build(wrap_t* wrap) {
+  bint_t n;
+  bint_t i;
+  bint_t j;
+
+  n = wrap->nblocks;
+
+  if (n + 1 > wrap->tree_cap) {
+    wrap->tree_cap = n + 1;
+    wrap->line_tree = realloc(wrap->line_tree, sizeof(bint_t) * wrap->tree_cap);
+    wrap->row_tree = realloc(wrap->row_tree, sizeof(bint_t) * wrap->tree_cap);
+  }
+
+  wrap->line_tree[0] = 0;
+  wrap->row_tree[0] = 0;
+
+  for (i = 1; i <= n; i++) {
+    wrap->line_tree[i] = wrap->blocks[i - 1].len;
+    wrap->row_tree[i] = wrap->blocks[i - 1].sum;
+  }
+
+  for (i = 1; i <= n; i++) {
+    j = i + (i & -i);
+    if (j > n) continue;
+    wrap->line_tree[j] += wrap->line_tree[i];
+    wrap->row_tree[j] += wrap->row_tree[i];
+  }
+}
+
+// Set the row count of one line in O(log blocks)
+static void _wrap_set_rows(wrap_t* wrap, bint_t line_index, bint_t rows) {
+  wrap_block_t* block;
+  bint_t offset;
+  bint_t b;
+  bint_t delta;
+
+  b = _wrap_find_line(wrap, line_index, &offset);
+  if (b >= wrap->nblocks) return;
+
+  block = &wrap->blocks[b];
+  delta = rows - block->rows[offset];
+  if (delta == 0) return;
+
+  block->rows[offset] = rows;
+  block->sum += delta;
+  _wrap_tree_add(wrap->row_tree, wrap->nblocks, b + 1, delta);
+}
+
+// Insert count entries before line_index. A block that would overflow is
+// split into half-full blocks so the next insert nearby stays cheap.
+static void _wrap_insert(wrap_t* wrap, bint_t line_index, bint_t* rows, bint_t count) {
+  wrap_block_t* block;
+  bint_t* merged;
+  bint_t offset;
+  bint_t total;
+  bint_t fill;
+  bint_t nblocks;
+  bint_t b;
+  bint_t i;
+
+  b = _wrap_find_line(wrap, line_index, &offset);
+
+  if (b >= wrap->nblocks) {
+    // Appending; extend the last block
+    b = wrap->nblocks - 1;
+    offset = wrap->blocks[b].len;
+  }
+
+  block = &wrap->blocks[b];
+
+  if (block->len + count <= EON_WRAP_BLOCK_SIZE) {
+    memmove(block->rows + offset + count, block->rows + offset, sizeof(bint_t) * (block->len - offset));
+    memcpy(block->rows + offset, rows, sizeof(bint_t) * count);
+    for (i = 0; i < count; i++) block->sum += rows[i];
+    block->len += count;
+  } else {
+    total = block->len + count;
+    merged = malloc(sizeof(bint_t) * total);
+    memcpy(merged, block->rows, sizeof(bint_t) * offset);
+    memcpy(merged + offset, rows, sizeof(bint_t) * count);
+    memcpy(merged + offset + count, block->rows + offset, sizeof(bint_t) * (block->len - offset));
+
+    fill = EON_WRAP_BLOCK_SIZE / 2;
+    nblocks = (total + fill - 1) / fill;
+    block = _wrap_splice_blocks(wrap, b, 1, nblocks);
+
+    for (i = 0; i < total; i++) {
+      if (block->len >= fill) block += 1;
+      block->rows[block->len] = merged[i];
+      block->sum += merged[i];
+      block->len += 1;
+    }
+    free(merged);
+  }
+
+  wrap->n += count;
+  _wrap_tree_build(wrap);
+}
+
+// Remove count entries starting at line_index, dropping emptied blocks and
+// merging the block at the cut with its neighbor when both fit in one
+static void _wrap_remove(wrap_t* wrap, bint_t line_index, bint_t count) {
+  wrap_block_t* block;
+  wrap_block_t* next;
+  bint_t offset;
+  bint_t nremove;
+  bint_t b;
+  bint_t i;
+
+  b = 0;
+
+  while (count > 0) {
+    b = _wrap_find_line(wrap, line_index, &offset);
+    if (b >= wrap->nblocks) break;
+
+    block = &wrap->blocks[b];
+    nremove = EON_MIN(count, block->len - offset);
+
+    for (i = offset; i < offset + nremove; i++) block->sum -= block->rows[i];
+    memmove(block->rows + offset, block->rows + offset + nremove, sizeof(bint_t) * (block->len - offset - nremove));
+    block->len -= nremove;
+    wrap->n -= nremove;
+    count -= nremove;
+
+    if (block->len < 1 && wrap->nblocks > 1) {
+      _wrap_splice_blocks(wrap, b, 1, 0);
+    }
+
+    // Fix up the line tree for the next lookup
+    _wrap_tree_build(wrap);
+  }
+
+  if (b > 0 && b >= wrap->nblocks) b = wrap->nblocks - 1;
+  if (b + 1 < wrap->nblocks) {
+    block = &wrap->blocks[b];
+    next = &wrap->blocks[b + 1];
+    if (block->len + next->len <= EON_WRAP_BLOCK_SIZE) {
+      memcpy(block->rows + block->len, next->rows, sizeof(bint_t) * next->len);
+      block->len += next->len;
+      block->sum += next->sum;
+      _wrap_splice_blocks(wrap, b + 1, 1, 0);
+    }
+  }
+
+  _wrap_tree_build(wrap);
+}
+
+// Replace nremove blocks at index at with nadd empty ones. Return the first
+// added block.
+static wrap_block_t* _wrap_splice_blocks(wrap_t* wrap, bint_t at, bint_t nremove, bint_t nadd) {
+  bint_t i;
+
+  for (i = at; i < at + nremove; i++) {
+    free(wrap->blocks[i].rows);
+  }
+
+  if (wrap->nblocks - nremove + nadd > wrap->blocks_cap) {
+    wrap->blocks_cap = EON_MAX(wrap->blocks_cap * 2, wrap->nblocks - nremove + nadd);
+    wrap->blocks = realloc(wrap->blocks, sizeof(wrap_block_t) * wrap->blocks_cap);
+  }
+
+  memmove(wrap->blocks + at + nadd, wrap->blocks + at + nremove, sizeof(wrap_block_t) * (wrap->nblocks - at - nremove));
+  wrap->nblocks += nadd - nremove;
+
+  for (i = at; i < at + nadd; i++) {
+    wrap->blocks[i].rows = malloc(sizeof(bint_t) * EON_WRAP_BLOCK_SIZE);
+    wrap->blocks[i].len = 0;
+    wrap->blocks[i].sum = 0;
+  }
+
+  return wrap->blocks + at;
+}
+
+// Free every block
+static void _wrap_free_blocks(wrap_t* wrap) {
+  if (wrap->nblocks > 0) {
+    _wrap_splice_blocks(wrap, 0, wrap->nblocks, 0);
+  }
+}